@@ -11,12 +11,14 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <esp_log.h>
+#include <rom/ets_sys.h>
 
 #include <fastmath.h>
 
 #include "BleGamePad.h"
 
 #include "Calibration.h"
+#include "DeltaCodec.h"
 #include "MadgwickAHRS.h"
 #include "Vector3.h"
 #include "espidf_MPU6886.h"
@@ -263,20 +265,31 @@ using namespace ESPIDF;
 void parent_task(void *arg) {
 	I2CMaster *i2c = new I2CMaster(&ESPIDF::M5Stick_Grove);
 
-	data_u data;
+	// 受け取り済みのキーフレームを2byte目で通知して、差分のみ受け取る
+	DeltaDecoder decoder;
+	data_delta_u data;
+	uint8_t command[2];
+	uint32_t timestamps[DELTA_SAMPLES];
+	Quaternion samples[DELTA_SAMPLES];
+	uint8_t count;
+
 	while (true) {
 		vTaskDelay(10 / portTICK_RATE_MS);
-		i2c->read_bytes(15, 0x23, data.raw, sizeof(data_u));
+		command[0] = COMMAND_GET_DELTA;
+		command[1] = decoder.get_keyframe();
+		if (i2c->send_bytes(15, command, sizeof(command)) != ESP_OK) continue;
+		ets_delay_us(15);
+		if (i2c->receive_bytes(15, data.raw, sizeof(data_delta_u)) != ESP_OK) continue;
+
+		if (data.version != PROTOCOL_VERSION_2 || !data_verify(&data)) continue;
+		if (data.flags & DATA_FLAG_CALIBRATING) continue;
 
 		/*
-		printf("[0x%8x 0x%8x] (%.3f %.3f %.3f) %.3f\n",
-			  data.header, data.footer,
-			  data.ahrs.x, data.ahrs.y, data.ahrs.z,
-			  data.ahrs.w);
+		printf("[%5u %3u %u] %02x\n", data.sequence, data.keyframe, data.count, data.flags);
 		*/
 
-		if (data.header == 0x01020304 && data.footer == 0xa7f32249) {
-			worker_data.ahrs = data.ahrs;
+		if (decoder.decode(&data, timestamps, samples, &count) && count > 0) {
+			worker_data.ahrs = samples[0];
 		}
 	}
 }
@@ -14,7 +14,9 @@
 #include <AtoMatrix.h>
 
 #include "Calibration.h"
+#include "DeltaCodec.h"
 #include "MadgwickAHRS.h"
+#include "Snapshot.h"
 #include "Vector3.h"
 #include "data.h"
 #include "espidf_MPU6886.h"
@@ -72,10 +74,13 @@ void setNumber(uint8_t number, uint8_t color) {
 using namespace ESPIDF;
 
 static IAHRS *ahrs;
+// AHRSタスクが更新毎に公開する姿勢
+static Snapshot<Quaternion> rotation;
+// COMMAND_GET_DELTAの応答、キーフレームの通知はスレーブタスクから受け取る
+static DeltaEncoder deltas;
+static Snapshot<data_delta_u> delta;
 
 static void i2c_slave_task(void *arg) {
-	SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
-
 	I2CSlave *slave = (I2CSlave *)arg;
 	uint8_t *rx	 = (uint8_t *)malloc(RX_BUFFER_LENGTH);
 
@@ -87,19 +92,26 @@ static void i2c_slave_task(void *arg) {
 
 	while (1) {
 		vTaskDelay(1);
-		xSemaphoreTake(mutex, portMAX_DELAY);
 		slave->read_bytes(rx, 64, 0);
 
 		switch (rx[0]) {
 			case COMMAND_GET_QUATERNION:
-				data.ahrs = ahrs->q;
+				rotation.read(&data.ahrs);
 				slave->write_bytes(data.raw, sizeof(data_u), true, 10 / portTICK_RATE_MS);
 				printf("%x %x %f \n", data.header, data.footer, data.ahrs.w);
 				break;
+			case COMMAND_GET_DELTA: {
+				deltas.acknowledge(rx[1]);
+				data_delta_u frame;
+				delta.read(&frame);
+				slave->write_bytes(frame.raw, sizeof(data_delta_u), true, 10 / portTICK_RATE_MS);
+				break;
+			}
+			case COMMAND_ACK_KEYFRAME:
+				deltas.acknowledge(rx[1]);
+				break;
 		}
-		xSemaphoreGive(mutex);
 	}
-	vSemaphoreDelete(mutex);
 	vTaskDelete(NULL);
 }
 
@@ -109,6 +121,11 @@ static void ahrs_task(void *arg) {
 
 	ahrs = new MadgwickAHRS(0.15f);
 	ahrs->reset();
+	rotation.publish(ahrs->q);
+
+	data_delta_u frame;
+	deltas.fill(&frame, DATA_FLAG_CALIBRATING);
+	delta.publish(frame);
 
 	Vector3<int32_t> g, a;
 
@@ -127,10 +144,16 @@ static void ahrs_task(void *arg) {
 	while (true) {
 		vTaskDelay(0);
 
+		uint32_t timestamp = esp_timer_get_time();
 		calib->getAccelAdc(&a);
 		calib->getGyroAdcWithCalibrate(&g);
 
 		ahrs->update(g * s, a * t);
+		rotation.publish(ahrs->q);
+
+		deltas.push(timestamp, ahrs->q);
+		deltas.fill(&frame, 0);
+		delta.publish(frame);
 	}
 }
 
@@ -1,23 +1,57 @@
 #include <M5Stack.h>
 #include <WiFi.h>
-#include <Wire.h>
 #include <Preferences.h>
+#include <esp_timer.h>
 
+#include "JointPoller.h"
 #include "OscClient.h"
+#include "OscSender.h"
+#include "Skeleton.h"
 #include "data.h"
+#include "i2c.h"
+#include "i2cqueue.h"
+
+using namespace ESPIDF;
 
 // uint8_t who[128];
 
 OscClient* osc;
+OscSender* sender;
+JointPoller* poller;
 VMTJointArgument_t osc_args;
 
-data_u data;
-
 Preferences pref;
 
+// Port A (I2C0) と Port C (I2C1) の2系統、バス毎にポーリングタスクを別コアで動かす
+#define I2C_BUS_COUNT 2
+I2CQueue* i2c_queue[I2C_BUS_COUNT];
+
+// バス毎のトランザクション単位の統計、ポーリング単位の統計はJointPollerが持つ
+I2CStatistics bus_statistics[I2C_BUS_COUNT];
+
+// 1関節あたりの目標更新レート
+#define POLL_RATE_HZ 120
+// Workerがこれ以上姿勢が変わらなければ短い応答にする [0.1度]、0なら使わない
+#define ADAPTIVE_THRESHOLD 10
+
+// 全Workerに同じ時刻の姿勢を保持させる頻度、0なら同期しない
+#define SYNC_RATE_HZ 10
+// Workerからの応答、COMMAND_GET_RAWにするとIMUの値を受け取りParent側で姿勢を計算する
+#define WORKER_REPLY COMMAND_GET_BATCH
+// OSC送信タスクのコア、WiFiのタスクと同じPRO_CPU
+#define OSC_SENDER_CORE 0
+// OSCの送信レート [Hz]、各関節の姿勢は送信時刻まで角速度で進める（0でポーリング毎に送信）
+#define OSC_OUTPUT_RATE_HZ 120
+// 可動関節の姿勢の平滑化（One Euro Filter）の初期値、CONFIGURE_CMD_SMOOTHINGで変更する
+// 静止中のカットオフ周波数 [Hz]、0で平滑化しない
+#define SMOOTHING_MIN_CUTOFF 0.0f
+// 角速度 1rad/s 毎に上げるカットオフ周波数 [Hz]
+#define SMOOTHING_BETA 0.0f
+
 struct JointConfigure {
 	char root_serial[20];
-	uint16_t reserved;
+	uint8_t bus;
+	uint8_t reserved;
 	uint8_t address;
 	uint8_t tracker_index;
 	Vector3<float> bone;
@@ -26,13 +60,16 @@ struct JointConfigure {
 
 struct Joint_s {
 	char root_serial[20];
-	uint16_t reserved;
+	uint8_t bus;
+	uint8_t reserved;
 	uint8_t address;
 	uint8_t tracker_index;
 	Vector3<float> bone;
 	Quaternion rotation;
-	Quaternion calibrate;
-	Quaternion xy_correction;
+	osc_string_t osc_serial;  // 追従するトラッカー、root_serialかSkeletonの原点の関節から作る
+	uint8_t output;		  // OSC_MESSAGE_JOINT / FOLLOW / ROOM
+	int8_t node;		  // Skeletonの関節番号
+	polled_joint_t* poll;	  // 可動関節のみ、ポーリングの状態と姿勢の補正
 };
 
 // ボーンはIMUの座標系で
@@ -47,6 +84,86 @@ uint16_t vmt_port;
 
 bool fix_send = true;
 
+// 可動関節のroot_serialが自分の関節のトラッカー（VMT_<番号>）なら、その関節の子としてまとめて位置を求める
+Skeleton skeleton;
+
+static Joint_s* joint_of(int node) {
+	return node < fix_bone_count ? fix_bone + node : movable + (node - fix_bone_count);
+}
+
+static int find_tracker(const char* serial) {
+	if (strncmp(serial, "VMT_", 4) != 0) return -1;
+	int index = atoi(serial + 4);
+	for (int i = 0; i < fix_bone_count; i++) {
+		if (fix_bone[i].tracker_index == index) return fix_bone[i].node;
+	}
+	for (int i = 0; i < movable_count; i++) {
+		if (movable[i].tracker_index == index) return movable[i].node;
+	}
+	return -1;
+}
+
+static void build_skeleton() {
+	// 固定関節はroot_serialのトラッカーに追従するVMTのJointとして送り、子の原点にする
+	// root_serialが無ければ、ルームの座標系で送る
+	skeleton.clear();
+	for (int i = 0; i < fix_bone_count; i++) {
+		Joint_s* j = fix_bone + i;
+		j->node	   = skeleton.add(j->bone, j->rotation, j->root_serial[0] != '\0');
+		j->output  = j->root_serial[0] ? OSC_MESSAGE_JOINT : OSC_MESSAGE_ROOM;
+		j->osc_serial.set(j->root_serial);
+	}
+	for (int i = 0; i < movable_count; i++) {
+		Joint_s* j = movable + i;
+		j->node	   = skeleton.add(j->bone, Quaternion::identify());
+	}
+	for (int i = 0; i < movable_count; i++) skeleton.set_parent(movable[i].node, find_tracker(movable[i].root_serial));
+	skeleton.build();
+
+	// 可動関節は原点の関節のトラッカー、原点がルートならそのroot_serialに追従させる
+	for (int i = 0; i < movable_count; i++) {
+		Joint_s* j	   = movable + i;
+		int origin	   = skeleton.get_origin(j->node);
+		Joint_s* o	   = joint_of(origin);
+		char serial[20] = "";
+		if (skeleton.is_anchor(origin)) {
+			snprintf(serial, sizeof(serial), "VMT_%d", o->tracker_index);
+		} else {
+			strncpy(serial, o->root_serial, sizeof(serial) - 1);
+		}
+		j->output = serial[0] ? OSC_MESSAGE_FOLLOW : OSC_MESSAGE_ROOM;
+		j->osc_serial.set(serial);
+
+		j->poll->node		 = j->node;
+		j->poll->output	 = j->output;
+		j->poll->serial	 = &j->osc_serial;
+		j->poll->tracker_index = j->tracker_index;
+	}
+}
+
+static void add_pose(Joint_s* j) {
+	if (j->output == OSC_MESSAGE_JOINT) {
+		sender->add_joint(&osc_args);
+	} else if (j->output == OSC_MESSAGE_ROOM) {
+		sender->add_room(&osc_args);
+	} else {
+		sender->add_follow(&osc_args);
+	}
+}
+
+// 姿勢を受け取った関節を画面に表示する
+static void print_joint(void* context, polled_joint_t* p, esp_err_t result, size_t fresh, int64_t now) {
+	if (fresh == 0) return;
+
+	int index					   = poller->index_of(p);
+	Quaternion q				   = p->rotation;
+	const i2c_device_stat_t* stat = poller->get_statistics()->find(p->address);
+	uint32_t failures		   = stat->nacks + stat->timeouts + stat->errors;
+	M5.Lcd.setCursor(0, 25 + 11 * (index + 1));
+	// 劣化したWorkerは番号の後に!を付ける
+	M5.Lcd.printf("%2d%c v%d [%4u] %3.3f, %3.3f, %3.3f, %3.3f      \n", p->address, p->link.get_health() ? '!' : ' ', p->link.get_protocol(), failures, q.x, q.y, q.z, q.w);
+}
+
 void printBone() {
 	M5.Lcd.fillRect(0, 90, 320, 120, BLACK);
 	M5.Lcd.setCursor(0, 90 + 2);
@@ -68,6 +185,10 @@ void printBone() {
 #define CONFIGURE_CMD_FIXBONE 0xf729adc8
 #define CONFIGURE_CMD_MOVABLE 0xab8cf912
 #define CONFIGURE_CMD_HOST 0x431fac89
+#define CONFIGURE_CMD_I2C_STATS 0x5e7a11c3
+#define CONFIGURE_CMD_TELEMETRY 0x3d6b92e4
+#define CONFIGURE_CMD_DESTINATION 0x6e0c47b5
+#define CONFIGURE_CMD_SMOOTHING 0x2b5d0e91
 
 union configure_u {
 	char raw[128];
@@ -82,7 +203,7 @@ union configure_u {
 			};
 			struct {
 				char root_serial[20];
-				uint8_t reserved_0;
+				uint8_t bus;
 				uint8_t bone_index;
 				uint8_t address;
 				uint8_t tracker_index;
@@ -100,7 +221,14 @@ union configure_u {
 				uint8_t ip2;
 				uint8_t ip3;
 				uint16_t port;
-				uint16_t reserved_2;
+				uint8_t destination;  // CONFIGURE_CMD_DESTINATIONのみ、1 ~ OSC_DESTINATIONS - 1
+				uint8_t messages;	  // OSC_MESSAGE_*
+				uint8_t divider;
+				uint8_t reserved_2[3];
+			};
+			struct {
+				float min_cutoff;	// [Hz]、0で平滑化しない
+				float beta;		// [Hz / (rad/s)]
 			};
 		};
 	};
@@ -108,6 +236,63 @@ union configure_u {
 
 #define CONFIGURE_DONE 0x7921a8ca
 
+static void print_i2c_statistics() {
+	static char text[1024];
+	for (int i = 0; i < I2C_BUS_COUNT; i++) {
+		bus_statistics[i].format(text, sizeof(text));
+		printf("bus %d\n%s", i, text);
+	}
+	if (!poller) return;
+	poller->get_statistics()->format(text, sizeof(text));
+	printf("poll\n%s", text);
+}
+
+static void print_telemetry() {
+	if (!poller) return;
+	printf("addr health rate  age[us] temp   bias               imu  slave cmd   uptime[s]\n");
+	for (int i = 0; i < poller->size(); i++) {
+		polled_joint_t* p		  = poller->get(i);
+		const data_telemetry_u* t = p->link.get_telemetry();
+		if (t->version != PROTOCOL_VERSION_2) {
+			printf("%4d -\n", p->address);
+			continue;
+		}
+
+		printf("%4d   0x%02x %4u %8u ", p->address, p->link.get_health(), t->fusion_rate, t->sample_age);
+		if (t->temperature == TELEMETRY_NO_TEMPERATURE) {
+			printf("   -   ");
+		} else {
+			printf("%6.2f ", t->temperature * 0.01f);
+		}
+		printf("[%5d %5d %5d] %5u %5u %5u %9u\n", t->bias[0], t->bias[1], t->bias[2], t->imu_errors, t->slave_errors, t->command_errors, t->uptime / 1000);
+	}
+
+	output_stat_t o;
+	sender->read_output_statistics(&o);
+	printf("osc %u/s skipped %u | jitter avg %uus max %uus | age avg %uus max %uus\n", o.frames, o.skipped,
+		  o.frames ? (uint32_t)(o.jitter_sum / o.frames) : 0, o.jitter_max,
+		  o.poses ? (uint32_t)(o.age_sum / o.poses) : 0, o.age_max);
+
+	static char text[160];
+	osc_send_stat_t n;
+	osc->read_statistics(&n);
+	OscClient::format(&n, text, sizeof(text));
+	printf("%s", text);
+}
+
+// 送信の集計が更新されたら画面下に表示する、止まりの原因がWiFiかを見分ける
+static void print_network_status() {
+	static uint32_t shown = 0;
+	osc_send_stat_t n;
+	uint32_t version = osc->read_statistics(&n);
+	if (version == shown) return;
+	shown = version;
+
+	M5.Lcd.setCursor(0, 222);
+	M5.Lcd.printf("udp %3u/s %6uB/s end %4u/%5uus fail %u/%u    ", n.per_second(n.datagrams), n.per_second(n.bytes),
+			    n.datagrams ? (uint32_t)(n.latency_sum / n.datagrams) : 0, n.latency_max, n.failures, n.failures_total);
+}
+
 static void
 uart_configure_task(void* arg) {
 	configure_u cmd;
@@ -119,6 +304,7 @@ uart_configure_task(void* arg) {
 
 	char key_fix[5] = "fix0";
 	char key_mov[5] = "mov0";
+	char key_dst[5] = "dst0";
 
 	uint32_t ip;
 
@@ -180,6 +366,26 @@ uart_configure_task(void* arg) {
 
 				host_configured = true;
 				break;
+			case CONFIGURE_CMD_DESTINATION:
+				M5.Lcd.printf(" configure destination %d: %d.%d.%d.%d:%d", cmd.destination, cmd.ip0, cmd.ip1, cmd.ip2, cmd.ip3, cmd.port);
+				if (cmd.destination < 1 || cmd.destination >= OSC_DESTINATIONS) continue;
+				key_dst[3] = '0' + cmd.destination;
+				pref.putBytes(key_dst, cmd.data, 12);
+				break;
+			case CONFIGURE_CMD_SMOOTHING:
+				M5.Lcd.printf(" configure smoothing: %.2fHz, %.3f", cmd.min_cutoff, cmd.beta);
+				pref.putFloat("cutoff", cmd.min_cutoff);
+				pref.putFloat("beta", cmd.beta);
+				// 再起動せずに反映する
+				if (!poller) break;
+				for (int i = 0; i < poller->size(); i++) poller->get(i)->smoothing.set_parameters(cmd.min_cutoff, cmd.beta);
+				break;
+			case CONFIGURE_CMD_I2C_STATS:
+				print_i2c_statistics();
+				break;
+			case CONFIGURE_CMD_TELEMETRY:
+				print_telemetry();
+				break;
 		}
 
 		if (wifi_configured && bone_configured && host_configured) {
@@ -195,7 +401,8 @@ uart_configure_task(void* arg) {
 bool main_loop_start;
 
 void setup() {
-	M5.begin(true, false, false, true);
+	// I2CはESP-IDFドライバで直接扱うので、M5側では初期化しない
+	M5.begin(true, false, false, false);
 	pref.begin("JTracker", false);
 
 	xTaskCreate(uart_configure_task, "configure_task", 1024 * 4, nullptr, 10, nullptr);
@@ -251,6 +458,19 @@ void setup() {
 	M5.Lcd.printf("->%d.%d.%d.%d", vmt_host[0], vmt_host[1], vmt_host[2], vmt_host[3]);
 
 	osc	    = new OscClient(vmt_host, vmt_port);
+	sender   = new OscSender(osc);
+	sender->set_rate(OSC_OUTPUT_RATE_HZ);
+
+	// 送信先0はVMT、それ以外はCONFIGURE_CMD_DESTINATIONで追加したもの
+	char key_dst[5] = "dst1";
+	for (int i = 1; i < OSC_DESTINATIONS; i++, key_dst[3]++) {
+		configure_u dst;
+		if (pref.getBytes(key_dst, dst.data, 12) != 12) continue;
+		uint8_t ip[4] = {dst.ip0, dst.ip1, dst.ip2, dst.ip3};
+		osc->set_destination(i, ip, dst.port, dst.messages, dst.divider);
+	}
+	// WiFiと同じコアで送信し、loopはI2Cのポーリングに専念させる
+	sender->begin(OSC_SENDER_CORE);
 	osc_args = {nullptr,			  // Serial
 			  1.0f, 0.0f, 0.0f, 0.0f,  // qw, qz, qy, qx
 			  0.0f, 1.0f, 0.0f,		  // z, y, x
@@ -261,8 +481,7 @@ void setup() {
 	for (int i = 0; i < fix_bone_count; i++) {
 		Joint_s* j = fix_bone + i;
 		pref.getBytes(key, j, sizeof(JointConfigure));
-		j->calibrate	  = {0.0f, 0.0f, 0.0f, 1.0f};
-		j->xy_correction = {0.0f, 0.0f, 0.0f, 1.0f};
+		j->poll = nullptr;
 		key[3]++;
 	}
 
@@ -271,102 +490,104 @@ void setup() {
 	for (int i = 0; i < movable_count; i++) {
 		Joint_s* j = movable + i;
 		pref.getBytes(key, j, sizeof(JointConfigure));
-		j->calibrate	  = {0.0f, 0.0f, 0.0f, 1.0f};
-		j->xy_correction = {0.0f, 0.0f, 0.0f, 1.0f};
+		if (j->bus >= I2C_BUS_COUNT) j->bus = 0;
 		key[3]++;
 	}
 
+	const wire_s* wires[] = {&M5Stack_Internal, &M5Stack_PortC};
+	for (int b = 0; b < I2C_BUS_COUNT; b++) {
+		i2c_queue[b] = nullptr;
+		for (int i = 0; i < movable_count; i++) {
+			if (b > 0 && movable[i].bus != b) continue;
+
+			I2CMaster* master = new I2CMaster(wires[b]);
+			master->set_statistics(bus_statistics + b);
+			i2c_queue[b] = new I2CQueue(master, JOINT_POLLER_BATCH, b);
+			break;
+		}
+	}
+
+	JointPoller* p = new JointPoller(sender, &skeleton, POLL_RATE_HZ);
+	p->set_sync_rate(SYNC_RATE_HZ);
+	p->set_enable(osc_args.enable);
+	p->set_observer(print_joint, nullptr);
+	float min_cutoff = pref.getFloat("cutoff", SMOOTHING_MIN_CUTOFF);
+	float beta	  = pref.getFloat("beta", SMOOTHING_BETA);
+	for (int i = 0; i < movable_count; i++) {
+		Joint_s* j = movable + i;
+		j->poll	   = p->add(j->address, i2c_queue[j->bus], WORKER_REPLY, true, ADAPTIVE_THRESHOLD);
+		j->poll->smoothing.set_parameters(min_cutoff, beta);
+	}
+
+	build_skeleton();
+	poller = p;
+
 	printBone();
 }
 
-uint8_t cmd[1];
-
 void loop() {
 	if (!main_loop_start) {
 		delay(1000);
 		return;
 	}
-	int py = 25;
-
 	if (osc_args.enable && fix_send) {
 		osc_args.enable = false;
+		osc_args.time	= 0.0f;
 		for (int i = 0; i < fix_bone_count; i++) {
 			Joint_s* j	 = fix_bone + i;
-			osc_args.serial = j->root_serial;
+			osc_args.serial = &j->osc_serial;
 			osc_args.index	 = j->tracker_index;
 			osc_args.set(j->rotation, j->rotation * j->bone);
-			osc->send_joint(&osc_args);
+			add_pose(j);
 		}
 		osc_args.enable = true;
 	}
 
-	cmd[0] = COMMAND_GET_QUATERNION;
-	for (int i = 0; i < movable_count; i++) {
-		py += 11;
-
-		Joint_s* j = movable + i;
-
-		osc_args.serial = j->root_serial;
-		osc_args.index	 = j->tracker_index;
-
-		i2c_err_t err = Wire.writeTransmission(j->address, cmd, 1, true);
-		delayMicroseconds(15);
-		i2c_err_t err2 = Wire.readTransmission(j->address, data.raw, sizeof(data_u));
-
-		if (err != ESP_OK || err2 != ESP_OK) continue;
-		if (data.header != SYNC_HEADER || data.footer != SYNC_FOOTER) continue;
-
-		M5.Lcd.setCursor(0, py);
-		M5.Lcd.printf("%2d [%d, %d] %3.3f, %3.3f, %3.3f, %3.3f      \n", j->address, err, err2, data.ahrs.x, data.ahrs.y, data.ahrs.z, data.ahrs.w);
-
-		j->rotation = data.ahrs;
-
-		if (osc_args.enable) {
-			Quaternion rot	    = j->rotation * j->calibrate;
-			Vector3<float> pos = rot * j->bone;
-			osc_args.set(j->xy_correction * rot, j->xy_correction * pos);
-			osc->send_follow(&osc_args);
-		}
-	}
+	// Workerのポーリングから、受け取った姿勢のOSC送信まで
+	poller->poll();
 
 	M5.update();
 	if (M5.BtnA.wasPressed()) {
 		// 原点設定（キャリブレーション）
 		for (int i = 0; i < movable_count; i++) {
-			Joint_s* j	  = movable + i;
-			j->calibrate	  = j->rotation.inverse();
-			j->xy_correction = Quaternion::identify();
+			polled_joint_t* p = movable[i].poll;
+			p->calibrate	  = p->rotation.inverse();
+			p->xy_correction  = Quaternion::identify();
 		}
 	}
 
 	if (M5.BtnB.wasPressed()) {
 		// XY平面回転補正
 		for (int i = 0; i < movable_count; i++) {
-			Joint_s* j	  = movable + i;
-			Vector3<float> b = (j->rotation * j->calibrate) * j->bone;
-			float _05_theta  = (atan2(b.y, b.x) + 3.1415926535897932384626433832795f * 0.5f) * 0.5f;
-			j->xy_correction = Quaternion::xyzw(0.0f, 0.0f, cosf(_05_theta), sinf(_05_theta));
+			polled_joint_t* p = movable[i].poll;
+			Vector3<float> b  = (p->rotation * p->calibrate) * movable[i].bone;
+			float _05_theta   = (atan2(b.y, b.x) + 3.1415926535897932384626433832795f * 0.5f) * 0.5f;
+			p->xy_correction  = Quaternion::xyzw(0.0f, 0.0f, cosf(_05_theta), sinf(_05_theta));
 		}
 	}
 
 	if (M5.BtnC.wasPressed()) {
 		osc_args.enable = 1 - osc_args.enable;
+		poller->set_enable(osc_args.enable);
 		M5.Lcd.setCursor(190, 18);
 		M5.Lcd.print(osc_args.enable ? "RUNNING" : "STOP   ");
 
 		if (!osc_args.enable) {
 			osc_args.serial = nullptr;
+			osc_args.time	= 0.0f;
 			osc_args.set({0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f});
 			for (int i = 0; i < fix_bone_count; i++) {
 				osc_args.index = fix_bone[i].tracker_index;
-				osc->send_joint(&osc_args);
+				add_pose(fix_bone + i);
 			}
 			for (int i = 0; i < movable_count; i++) {
 				osc_args.index = movable[i].tracker_index;
-				osc->send_follow(&osc_args);
+				add_pose(movable + i);
 			}
+			sender->end_frame();
 		}
 	}
 
+	print_network_status();
 	delay(1);
 }
@@ -0,0 +1,64 @@
+#pragma once
+
+// ホスト向けWiFiUDP代替、POSIXソケットでそのまま送信する
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class IPAddress {
+    public:
+	IPAddress() { memset(octets, 0, 4); }
+	IPAddress(const uint8_t* address) { memcpy(octets, address, 4); }
+	uint8_t octets[4];
+};
+
+class WiFiUDP {
+    public:
+	~WiFiUDP() {
+		if (fd >= 0) close(fd);
+	}
+
+	uint8_t begin(uint16_t port) {
+		fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0) return 0;
+
+		sockaddr_in local;
+		memset(&local, 0, sizeof(local));
+		local.sin_family	   = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+		local.sin_port	   = htons(port);
+		// 同じポートを使う別プロセスがいても送信はできるので、bindの失敗は無視する
+		bind(fd, (sockaddr*)&local, sizeof(local));
+		return 1;
+	}
+
+	int beginPacket(IPAddress address, uint16_t port) {
+		memset(&destination, 0, sizeof(destination));
+		destination.sin_family = AF_INET;
+		destination.sin_port   = htons(port);
+		memcpy(&destination.sin_addr.s_addr, address.octets, 4);
+		length = 0;
+		return fd >= 0;
+	}
+
+	size_t write(const uint8_t* data, size_t size) {
+		if (length + size > sizeof(buffer)) size = sizeof(buffer) - length;
+		memcpy(buffer + length, data, size);
+		length += size;
+		return size;
+	}
+
+	int endPacket() {
+		return sendto(fd, buffer, length, 0, (sockaddr*)&destination, sizeof(destination)) >= 0;
+	}
+
+    private:
+	int fd = -1;
+	sockaddr_in destination;
+	uint8_t buffer[1500];
+	size_t length = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+// ホスト向けI2Cドライバ代替、SCLのピン番号が同じポート同士を同じバスとして接続する
+// 実装は src/virtual_i2c.cpp
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>  // 実機のドライバヘッダ同様に推移的に読み込む
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int i2c_port_t;
+typedef int gpio_num_t;
+
+typedef enum {
+	I2C_MODE_SLAVE	= 0,
+	I2C_MODE_MASTER = 1,
+} i2c_mode_t;
+
+typedef enum {
+	I2C_MASTER_WRITE = 0,
+	I2C_MASTER_READ  = 1,
+} i2c_rw_t;
+
+typedef enum {
+	I2C_MASTER_ACK	    = 0,
+	I2C_MASTER_NACK	    = 1,
+	I2C_MASTER_LAST_NACK = 2,
+} i2c_ack_type_t;
+
+typedef enum {
+	GPIO_PULLUP_DISABLE = 0,
+	GPIO_PULLUP_ENABLE	= 1,
+} gpio_pullup_t;
+
+typedef struct {
+	i2c_mode_t mode;
+	gpio_num_t sda_io_num;
+	gpio_pullup_t sda_pullup_en;
+	gpio_num_t scl_io_num;
+	gpio_pullup_t scl_pullup_en;
+	union {
+		struct {
+			uint32_t clk_speed;
+		} master;
+		struct {
+			uint8_t addr_10bit_en;
+			uint16_t slave_addr;
+		} slave;
+	};
+} i2c_config_t;
+
+typedef struct VirtualCommand* i2c_cmd_handle_t;
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t* conf);
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags);
+esp_err_t i2c_driver_delete(i2c_port_t port);
+
+i2c_cmd_handle_t i2c_cmd_link_create();
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en);
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, uint8_t* data, size_t data_len, bool ack_en);
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t* data, i2c_ack_type_t ack);
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t* data, size_t data_len, i2c_ack_type_t ack);
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait);
+
+int i2c_slave_read_buffer(i2c_port_t port, uint8_t* data, size_t max_size, TickType_t ticks_to_wait);
+int i2c_slave_write_buffer(i2c_port_t port, const uint8_t* data, int size, TickType_t ticks_to_wait);
+esp_err_t i2c_reset_tx_fifo(i2c_port_t port);
+esp_err_t i2c_reset_rx_fifo(i2c_port_t port);
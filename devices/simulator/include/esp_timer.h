@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/// プロセス起動からの経過時間 [us]
+int64_t esp_timer_get_time();
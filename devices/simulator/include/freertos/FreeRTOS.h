@@ -0,0 +1,28 @@
+#pragma once
+
+// ホスト向けFreeRTOS代替、シミュレータで使う範囲のみ
+// タスクはスレッド、tickは1ms固定
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+typedef struct VirtualQueue* QueueHandle_t;
+typedef struct VirtualSemaphore* SemaphoreHandle_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define tskNO_AFFINITY ((BaseType_t)0x7fffffff)
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter,
+						     UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter,
+				   UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t period);
+TickType_t xTaskGetTickCount();
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// 仮想I2Cバスに接続するデバイス
+/// 1トランザクションは begin -> write / read -> end の順に呼ばれる
+class VirtualDevice {
+    public:
+	virtual ~VirtualDevice() {}
+
+	virtual void begin(bool read) {}
+	virtual void write(const uint8_t* data, size_t length) = 0;
+	virtual void read(uint8_t* data, size_t length)		= 0;
+	virtual void end() {}
+};
+
+/// レジスタマップを持つセンサ用、最初に書き込まれた1byteがレジスタアドレス
+class VirtualRegisterDevice : public VirtualDevice {
+    public:
+	VirtualRegisterDevice();
+
+	void begin(bool read);
+	void write(const uint8_t* data, size_t length);
+	void read(uint8_t* data, size_t length);
+
+    protected:
+	/// 読み出し開始時に呼ばれる、センサ値のレジスタを更新する
+	virtual void latch() {}
+
+	void set_big_endian(uint8_t registry, int16_t value);
+	void set_little_endian(uint8_t registry, int16_t value);
+
+	uint8_t registers[256];
+	uint8_t pointer;
+	bool pointer_written;
+};
+
+/// scl（ピン番号）で識別されるバスに、addressでデバイスを接続します
+bool virtual_bus_attach(int scl, uint8_t address, VirtualDevice* device);
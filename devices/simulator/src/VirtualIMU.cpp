@@ -0,0 +1,101 @@
+#include "VirtualIMU.h"
+
+#include <esp_timer.h>
+#include <math.h>
+
+// 実機ドライバ側の換算と揃える（±8G: 4096LSB/G, ±2000dps: 32768/2000 LSB/dps）
+static const float ACCEL_LSB = 32768.0f / 8.0f;
+static const float GYRO_LSB	 = 32768.0f / 2000.0f * 180.0f / 3.14159265358979323846f;
+static const float MAG_LSB	 = 32768.0f / 4.0f;
+
+static const Vector3<float> GRAVITY	= {0.0f, 0.0f, 1.0f};
+static const Vector3<float> MAGNETIC = {0.3f, 0.0f, -0.4f};  // [gauss]
+
+static int16_t noise_of(uint32_t* seed, int16_t amplitude) {
+	if (amplitude <= 0) return 0;
+	*seed = *seed * 1664525u + 1013904223u;
+	return (int16_t)((*seed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+static int16_t saturate(float value) {
+	if (value > 32767.0f) return 32767;
+	if (value < -32768.0f) return -32768;
+	return (int16_t)value;
+}
+
+static void measure(VirtualMotion* motion, virtual_imu_noise_t* noise, uint32_t* seed, Vector3<int16_t>* accel, Vector3<int16_t>* gyro) {
+	Quaternion q;
+	Vector3<float> w;
+	motion->sample(esp_timer_get_time(), &q, &w);
+
+	Vector3<float> a = q.rotate(GRAVITY) * ACCEL_LSB;
+	accel->x		  = saturate(a.x) + noise_of(seed, noise->accel_noise);
+	accel->y		  = saturate(a.y) + noise_of(seed, noise->accel_noise);
+	accel->z		  = saturate(a.z) + noise_of(seed, noise->accel_noise);
+
+	Vector3<float> g = w * GYRO_LSB;
+	gyro->x		  = saturate(g.x) + noise->gyro_bias.x + noise_of(seed, noise->gyro_noise);
+	gyro->y		  = saturate(g.y) + noise->gyro_bias.y + noise_of(seed, noise->gyro_noise);
+	gyro->z		  = saturate(g.z) + noise->gyro_bias.z + noise_of(seed, noise->gyro_noise);
+}
+
+VirtualMPU6886::VirtualMPU6886(VirtualMotion* motion, virtual_imu_noise_t noise, uint32_t seed) {
+	this->motion = motion;
+	this->noise  = noise;
+	this->seed   = seed;
+
+	registers[0x75] = 0x19;  // WHO_AM_I
+}
+
+void VirtualMPU6886::latch() {
+	Vector3<int16_t> a, g;
+	measure(motion, &noise, &seed, &a, &g);
+
+	set_big_endian(0x3b, a.x);
+	set_big_endian(0x3d, a.y);
+	set_big_endian(0x3f, a.z);
+	set_big_endian(0x41, 0);  // 25℃
+	set_big_endian(0x43, g.x);
+	set_big_endian(0x45, g.y);
+	set_big_endian(0x47, g.z);
+}
+
+VirtualLSM9DS1::VirtualLSM9DS1(VirtualMotion* motion, virtual_imu_noise_t noise, uint32_t seed) {
+	this->motion = motion;
+	this->noise  = noise;
+	this->seed   = seed;
+
+	registers[0x0f] = 0x68;  // WHO_AM_I
+	registers[0x17] = 0x07;  // STATUS_REG, 全データ更新済み
+}
+
+void VirtualLSM9DS1::latch() {
+	Vector3<int16_t> a, g;
+	measure(motion, &noise, &seed, &a, &g);
+
+	set_little_endian(0x15, 0);  // OUT_TEMP
+	set_little_endian(0x18, g.x);
+	set_little_endian(0x1a, g.y);
+	set_little_endian(0x1c, g.z);
+	set_little_endian(0x28, a.x);
+	set_little_endian(0x2a, a.y);
+	set_little_endian(0x2c, a.z);
+}
+
+VirtualLSM9DS1::Magnetometer::Magnetometer(VirtualMotion* motion) {
+	this->motion = motion;
+
+	registers[0x0f] = 0x3d;  // WHO_AM_I
+	registers[0x27] = 0x0f;  // STATUS_REG_M
+}
+
+void VirtualLSM9DS1::Magnetometer::latch() {
+	Quaternion q;
+	Vector3<float> w;
+	motion->sample(esp_timer_get_time(), &q, &w);
+
+	Vector3<float> m = q.rotate(MAGNETIC) * MAG_LSB;
+	set_little_endian(0x28, saturate(m.x));
+	set_little_endian(0x2a, saturate(m.y));
+	set_little_endian(0x2c, saturate(m.z));
+}
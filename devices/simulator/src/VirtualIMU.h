@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "VirtualBus.h"
+#include "VirtualMotion.h"
+
+/// ジャイロのゼロバイアスと、ADC値に乗せる一様ノイズの振幅
+struct virtual_imu_noise_t {
+	Vector3<int16_t> gyro_bias;
+	int16_t gyro_noise;
+	int16_t accel_noise;
+};
+
+/// MPU6886のレジスタマップ、±8G / ±2000dpsのビッグエンディアン
+class VirtualMPU6886 : public VirtualRegisterDevice {
+    public:
+	VirtualMPU6886(VirtualMotion* motion, virtual_imu_noise_t noise, uint32_t seed);
+
+	static const uint8_t address = 0x68;
+
+    protected:
+	void latch();
+
+    private:
+	VirtualMotion* motion;
+	virtual_imu_noise_t noise;
+	uint32_t seed;
+};
+
+/// LSM9DS1の加速度・ジャイロ側のレジスタマップ、リトルエンディアン
+class VirtualLSM9DS1 : public VirtualRegisterDevice {
+    public:
+	VirtualLSM9DS1(VirtualMotion* motion, virtual_imu_noise_t noise, uint32_t seed);
+
+	static const uint8_t address = 0x6b;
+
+	/// 磁気センサ側（別アドレス）
+	class Magnetometer : public VirtualRegisterDevice {
+	    public:
+		Magnetometer(VirtualMotion* motion);
+
+		static const uint8_t address = 0x1e;
+
+	    protected:
+		void latch();
+
+	    private:
+		VirtualMotion* motion;
+	};
+
+    protected:
+	void latch();
+
+    private:
+	VirtualMotion* motion;
+	virtual_imu_noise_t noise;
+	uint32_t seed;
+};
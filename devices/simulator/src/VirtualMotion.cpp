@@ -0,0 +1,87 @@
+#include "VirtualMotion.h"
+
+#include <math.h>
+#include <stdio.h>
+
+static const float PI = 3.14159265358979323846f;
+
+VirtualMotion::VirtualMotion(Vector3<float> axis, float amplitude, float frequency, int64_t start_us) {
+	float n = sqrtf(axis.Dot2());
+	if (n > 0.0f) axis *= 1.0f / n;
+
+	this->axis	 = axis;
+	this->amplitude = amplitude;
+	this->frequency = frequency;
+	this->start_us  = start_us;
+}
+
+bool VirtualMotion::load(const char* path) {
+	FILE* f = fopen(path, "r");
+	if (f == nullptr) return false;
+
+	keys.clear();
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		long long t;
+		key_t k;
+		if (sscanf(line, "%lld,%f,%f,%f,%f", &t, &k.q.x, &k.q.y, &k.q.z, &k.q.w) != 5) continue;
+		k.time = t;
+		k.q.normalize();
+		keys.push_back(k);
+	}
+	fclose(f);
+
+	return keys.size() >= 2;
+}
+
+Quaternion VirtualMotion::interpolate(int64_t time_us) {
+	int64_t span = keys.back().time - keys.front().time;
+	int64_t t	 = keys.front().time + (span > 0 ? time_us % span : 0);
+
+	size_t i = 1;
+	while (i < keys.size() - 1 && keys[i].time < t) i++;
+
+	key_t& a = keys[i - 1];
+	key_t& b = keys[i];
+	float r	 = b.time > a.time ? (float)(t - a.time) / (b.time - a.time) : 0.0f;
+
+	// nlerp、最短経路になるように符号を揃える
+	Quaternion q1 = b.q;
+	if (a.q.x * q1.x + a.q.y * q1.y + a.q.z * q1.z + a.q.w * q1.w < 0.0f) q1 *= -1.0f;
+	Quaternion q = a.q * (1.0f - r);
+	q += q1 * r;
+	q.normalize();
+	return q;
+}
+
+void VirtualMotion::sample(int64_t time_us, Quaternion* orientation, Vector3<float>* gyro) {
+	int64_t t = time_us - start_us;
+	if (t < 0) {
+		*orientation = keys.empty() ? Quaternion::identify() : keys.front().q;
+		*gyro	   = {0.0f, 0.0f, 0.0f};
+		return;
+	}
+
+	if (keys.empty()) {
+		float w	    = 2.0f * PI * frequency;
+		float s	    = t / 1000000.0f;
+		float angle = amplitude * sinf(w * s);
+		float rate  = amplitude * w * cosf(w * s);
+
+		float h	   = sinf(angle * 0.5f);
+		*orientation = {axis.x * h, axis.y * h, axis.z * h, cosf(angle * 0.5f)};
+		*gyro	   = axis * rate;
+		return;
+	}
+
+	// 角速度は前後1msの差分から求める
+	const int64_t dt = 1000;
+	Quaternion q0	 = interpolate(t - dt);
+	Quaternion q1	 = interpolate(t + dt);
+	Quaternion d	 = q0.inverse() * q1;
+	if (d.w < 0.0f) d *= -1.0f;
+
+	float k	   = 2.0f / (2.0f * dt / 1000000.0f);
+	*orientation = interpolate(t);
+	*gyro	   = {d.x * k, d.y * k, d.z * k};
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "Vector3.h"
+
+/// 仮想IMUに与える姿勢の時系列
+/// 合成（1軸まわりの正弦波回転）か、記録済みCSV（time_us, qx, qy, qz, qw）を繰り返し再生する
+class VirtualMotion {
+    public:
+	/// start_us までは静止（ジャイロのゼロバイアス測定用）
+	VirtualMotion(Vector3<float> axis, float amplitude, float frequency, int64_t start_us);
+
+	bool load(const char* path);
+
+	/// 時刻timeでのセンサの姿勢と、センサ座標系の角速度 [rad/s]
+	void sample(int64_t time_us, Quaternion* orientation, Vector3<float>* gyro);
+
+    private:
+	Quaternion interpolate(int64_t time_us);
+
+	Vector3<float> axis;
+	float amplitude, frequency;
+	int64_t start_us;
+
+	struct key_t {
+		int64_t time;
+		Quaternion q;
+	};
+	std::vector<key_t> keys;
+};
@@ -0,0 +1,137 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_timer.h>
+#include <pthread.h>
+#include <rom/ets_sys.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+void ets_delay_us(uint32_t us) {
+	int64_t end = esp_timer_get_time() + us;
+	while (esp_timer_get_time() < end) std::this_thread::yield();
+}
+
+TickType_t xTaskGetTickCount() { return (TickType_t)(esp_timer_get_time() / 1000); }
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter,
+						     UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+	std::thread thread(task, parameter);
+	if (handle) *handle = nullptr;
+	thread.detach();
+	return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameter,
+				   UBaseType_t priority, TaskHandle_t* handle) {
+	return xTaskCreatePinnedToCore(task, name, stack_depth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+	if (task == nullptr) pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) {
+	if (ticks == 0) {
+		std::this_thread::yield();
+	} else {
+		std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+	}
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t period) {
+	*previous_wake += period;
+	int32_t remain = (int32_t)(*previous_wake - xTaskGetTickCount());
+	if (remain > 0) vTaskDelay(remain);
+}
+
+static std::chrono::steady_clock::time_point deadline_of(TickType_t wait) {
+	return std::chrono::steady_clock::now() + std::chrono::milliseconds(wait);
+}
+
+struct VirtualQueue {
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::vector<uint8_t>> items;
+	size_t length;
+	size_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+	VirtualQueue* queue = new VirtualQueue();
+	queue->length	    = length;
+	queue->item_size    = item_size;
+	return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	auto ready = [queue] { return queue->items.size() < queue->length; };
+	if (wait == portMAX_DELAY) {
+		queue->changed.wait(lock, ready);
+	} else if (!queue->changed.wait_until(lock, deadline_of(wait), ready)) {
+		return pdFALSE;
+	}
+
+	const uint8_t* p = (const uint8_t*)item;
+	queue->items.emplace_back(p, p + queue->item_size);
+	queue->changed.notify_all();
+	return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	auto ready = [queue] { return !queue->items.empty(); };
+	if (wait == portMAX_DELAY) {
+		queue->changed.wait(lock, ready);
+	} else if (!queue->changed.wait_until(lock, deadline_of(wait), ready)) {
+		return pdFALSE;
+	}
+
+	memcpy(item, queue->items.front().data(), queue->item_size);
+	queue->items.pop_front();
+	queue->changed.notify_all();
+	return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	return queue->items.size();
+}
+
+void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+struct VirtualSemaphore {
+	std::timed_mutex mutex;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new VirtualSemaphore(); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+	if (wait == portMAX_DELAY) {
+		semaphore->mutex.lock();
+		return pdTRUE;
+	}
+	return semaphore->mutex.try_lock_for(std::chrono::milliseconds(wait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	semaphore->mutex.unlock();
+	return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "IIMU.h"
+#include "i2c.h"
+
+// ドライバのヘッダは実装を含み、同じ翻訳単位に複数入れられないので生成関数を分けている
+IIMU* create_mpu6886(ESPIDF::I2CMaster* master);
+IIMU* create_lsm9ds1(ESPIDF::I2CMaster* master);
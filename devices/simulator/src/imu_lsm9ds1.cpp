@@ -0,0 +1,4 @@
+#include "espidf_LSM9DS1.h"
+#include "imu.h"
+
+IIMU* create_lsm9ds1(ESPIDF::I2CMaster* master) { return new ESPIDF::LSM9DS1(master, 0); }
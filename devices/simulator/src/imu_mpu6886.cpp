@@ -0,0 +1,4 @@
+#include "espidf_MPU6886.h"
+#include "imu.h"
+
+IIMU* create_mpu6886(ESPIDF::I2CMaster* master) { return new ESPIDF::MPU6886(master); }
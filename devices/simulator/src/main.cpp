@@ -0,0 +1,703 @@
+// 実機なしで Worker x N -> Parent -> OSC を1プロセスで動かすシミュレータ
+// Workerは仮想IMUを読み、Parentは実機と同じI2CQueue / BusSchedulerで仮想バス越しにポーリングする
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "Calibration.h"
+#include "CompactCodec.h"
+#include "JointPoller.h"
+#include "OscClient.h"
+#include "OscSender.h"
+#include "Skeleton.h"
+#include "VirtualIMU.h"
+#include "VirtualMotion.h"
+#include "WorkerSlave.h"
+#include "data.h"
+#include "i2c.h"
+#include "i2cqueue.h"
+#include "imu.h"
+
+using namespace ESPIDF;
+
+#define MAX_WORKERS BUS_SCHEDULER_MAX_SLOTS
+#define I2C_BUS_COUNT 2
+
+// 実機のParentと同じ値
+#define POLL_RATE_HZ 120
+#define OSC_OUTPUT_RATE_HZ 120
+
+// 実機のWorkerと同じ値
+#define TEMPERATURE_INTERVAL_US 1000000
+
+// AHRS更新毎の姿勢と、その元になったIMUの読み出し時刻
+// Parentはv1の応答を照合して端到端の遅延を求める
+#define SAMPLE_HISTORY 32
+struct sampled_t {
+	Quaternion q;
+	int64_t sampled_at;
+};
+
+struct SimWorker {
+	uint8_t address;
+	uint8_t bus;
+	VirtualMotion* motion;
+	IIMU* imu;
+	WorkerSlave* slave;  // 実機のWorkerと同じスレーブ応答
+
+	// Workerの時計はParentと独立に進む（起動時刻のずれとクロックの誤差）
+	uint32_t clock_offset;
+	int32_t clock_ppm;
+
+	// AHRSタスクとParent側の照合用
+	std::mutex mutex;
+	sampled_t history[SAMPLE_HISTORY];
+	int history_head;
+};
+
+struct SimJoint {
+	char root_serial[20];
+	uint8_t bus;
+	uint8_t tracker_index;
+	Vector3<float> bone;
+	osc_string_t osc_serial;
+	int8_t node;  // Skeletonの関節番号
+
+	polled_joint_t* poll;
+	SimWorker* worker;
+	uint8_t sync_seen;  // 最後に集計した同期のid
+};
+
+struct sim_destination_t {
+	uint16_t port;
+	unsigned messages;  // OSC_MESSAGE_*
+	unsigned divider;
+};
+
+struct sim_options_t {
+	int workers;
+	int seconds;
+	int buses;
+	uint8_t host[4];
+	uint16_t port;
+	uint32_t rate;
+	uint8_t protocol;
+	uint8_t reply;
+	bool staged;
+	bool bundle;
+	uint32_t output_rate;
+	uint32_t sync_rate;
+	uint8_t adaptive;
+	int stationary;
+	const char* imu;
+	const char* motion;
+	int chain;  // 何関節毎に親子の列を切るか
+	float min_cutoff;  // 姿勢の平滑化、0で平滑化しない
+	float beta;
+	int destinations;  // 追加の送信先（-hのホストの別ポート）
+	sim_destination_t destination[OSC_DESTINATIONS - 1];
+};
+
+struct sim_report_t {
+	uint32_t polls, failures, duplicates, samples, messages, datagrams, coalesced, dropped, matched;
+	uint64_t poll_sum, age_sum;
+	uint32_t poll_max, age_max;
+	uint32_t syncs, sync_max;  // 同期した姿勢の数、指定時刻からのずれ
+	uint64_t sync_sum;
+	uint32_t clocks, clock_max;  // ClockSyncで変換した時刻の誤差
+	uint64_t clock_sum;
+	float angle_sum, angle_max;  // 仮想IMUの真の姿勢との差 [度]
+	uint32_t smoothed;		  // 平滑化した姿勢を真の姿勢と比べた数
+	float smooth_sum, smooth_max;
+};
+
+static SimWorker workers[MAX_WORKERS];
+static SimJoint joints[MAX_WORKERS];
+static Skeleton skeleton;
+static JointPoller* poller;
+static sim_report_t report;
+static bool smoothing;
+
+static I2CQueue* i2c_queue[I2C_BUS_COUNT];
+static I2CStatistics bus_statistics[I2C_BUS_COUNT];
+
+static uint32_t worker_clock(SimWorker* w, int64_t now) { return (uint32_t)(now + now * w->clock_ppm / 1000000) + w->clock_offset; }
+
+// WorkerSlaveに渡すWorkerの時計
+static uint32_t worker_time(void* context) { return worker_clock((SimWorker*)context, esp_timer_get_time()); }
+
+// Workerの時刻をシミュレータの実時間に戻す、nowに近い時刻のみ
+static int64_t worker_real(SimWorker* w, uint32_t time, int64_t now) { return now + (int32_t)(time - worker_clock(w, now)); }
+
+// 実機のWorkerのdata_updateと同じ流れ、IMUの読み出し時刻だけ照合用に残す
+static void worker_update_task(void* arg) {
+	SimWorker* w = (SimWorker*)arg;
+
+	Calibration* calib = new Calibration(w->imu, 128);
+	calib->regist(Calibration::Mode::Gyro);
+
+	Vector3<int32_t> g, a;
+	I2CMaster* master	 = (I2CMaster*)w->imu->getI2CMaster();
+	Telemetry* telemetry = w->slave->get_telemetry();
+	uint32_t offset_at	 = 0;
+	bool calibrating	 = true;
+	while (true) {
+		vTaskDelay(1);
+		telemetry->set_calibration(calib->getMode());
+		if (!calib->proccess()) {
+			vTaskDelay(15 / portTICK_RATE_MS);
+		} else {
+			// シミュレータではゼロバイアスの測定を1回だけにして、静止期間内に収める
+			if (calibrating) {
+				calibrating = false;
+				w->slave->set_calibrating(false);
+			}
+
+			int64_t sampled_at = esp_timer_get_time();
+			uint32_t timestamp = worker_clock(w, sampled_at);
+			calib->getAccelAdc(&a);
+			if (master->get_last_error() != ESP_OK) telemetry->count_imu_error();
+			calib->getGyroAdc(&g);
+			if (master->get_last_error() != ESP_OK) telemetry->count_imu_error();
+
+			// IIMUからは温度を読めないので、ゼロバイアスのみ
+			if (timestamp - offset_at >= TEMPERATURE_INTERVAL_US) {
+				offset_at = timestamp;
+				telemetry->set_offset(calib->g);
+			}
+
+			Quaternion q = w->slave->update(timestamp, g, a);
+
+			std::lock_guard<std::mutex> lock(w->mutex);
+			w->history_head			   = (w->history_head + 1) % SAMPLE_HISTORY;
+			w->history[w->history_head] = {q, sampled_at};
+		}
+	}
+}
+
+static void worker_slave_task(void* arg) {
+	SimWorker* w = (SimWorker*)arg;
+	while (true) w->slave->serve();
+}
+
+/// v1で受信した姿勢のIMU読み出し時刻、見つからない（キャリブレーション中を含む）場合は0
+static int64_t find_sampled_at(SimWorker* w, Quaternion* q) {
+	std::lock_guard<std::mutex> lock(w->mutex);
+	for (int i = 0; i < SAMPLE_HISTORY; i++) {
+		sampled_t* sampled = w->history + (w->history_head + SAMPLE_HISTORY - i) % SAMPLE_HISTORY;
+		if (memcmp(&sampled->q, q, sizeof(Quaternion)) == 0) return sampled->sampled_at;
+	}
+	return 0;
+}
+
+static void setup_workers(sim_options_t* options) {
+	const wire_s* wires[] = {&M5Stack_Internal, &M5Stack_PortC};
+
+	for (int k = 0; k < options->workers; k++) {
+		SimWorker* w = workers + k;
+		w->address   = 10 + k;
+		w->bus	   = k % options->buses;
+		w->clock_offset = 0x9e3779b9u * (k + 1);
+		w->clock_ppm	 = (k % 5 - 2) * 20;
+		w->history_head = 0;
+
+		// 関節毎に回転軸と周期をずらす、最初の6秒はキャリブレーションのため静止
+		Vector3<float> axis = {(float)(k % 3 == 0), (float)(k % 3 == 1), (float)(k % 3 == 2)};
+		bool still		  = k >= options->workers - options->stationary;
+		w->motion		  = new VirtualMotion(axis, still ? 0.0f : 0.8f, 0.5f + 0.1f * k, 6000000);
+		if (options->motion && !w->motion->load(options->motion)) {
+			fprintf(stderr, "failed to load motion %s\n", options->motion);
+			exit(1);
+		}
+
+		// Workerごとに独立したIMU用バス（sclのピン番号で区別する）
+		int scl = 1000 + k;
+		int sda = 2000 + k;
+
+		virtual_imu_noise_t noise = {{(int16_t)(k * 3 - 20), (int16_t)(7 - k), (int16_t)(k - 5)}, 4, 20};
+		if (strcmp(options->imu, "lsm9ds1") == 0) {
+			virtual_bus_attach(scl, VirtualLSM9DS1::address, new VirtualLSM9DS1(w->motion, noise, k + 1));
+			virtual_bus_attach(scl, VirtualLSM9DS1::Magnetometer::address, new VirtualLSM9DS1::Magnetometer(w->motion));
+		} else {
+			virtual_bus_attach(scl, VirtualMPU6886::address, new VirtualMPU6886(w->motion, noise, k + 1));
+		}
+
+		I2CMaster* master = new I2CMaster((i2c_port_t)(200 + k), (gpio_num_t)scl, (gpio_num_t)sda, 400000);
+		w->imu		   = strcmp(options->imu, "lsm9ds1") == 0 ? create_lsm9ds1(master) : create_mpu6886(master);
+
+		const wire_s* wire = wires[w->bus];
+		I2CSlave* slave    = new I2CSlave((i2c_port_t)(100 + k), wire->io_scl, wire->io_sda, w->address);
+		ESP_ERROR_CHECK(slave->get_last_error());
+		w->slave = new WorkerSlave(slave, worker_time, w);
+		w->slave->set_protocol(options->protocol);
+
+		xTaskCreate(worker_slave_task, "i2c_slave", 1024 * 8, w, 10, nullptr);
+		xTaskCreate(worker_update_task, "update_ahrs", 1024 * 8, w, 10, nullptr);
+	}
+}
+
+/// 完了したポーリング毎に、ポーリング遅延・同期のずれ・時刻と姿勢の誤差を集計する
+static void measure(void* context, polled_joint_t* p, esp_err_t result, size_t fresh, int64_t now) {
+	SimJoint* j		  = joints + poller->index_of(p);
+	uint32_t latency = now - p->submitted_at;
+	report.polls++;
+	report.poll_sum += latency;
+	if (report.poll_max < latency) report.poll_max = latency;
+
+	if (result != ESP_OK) {
+		report.failures++;
+		return;
+	}
+	if (fresh == 0) {
+		report.duplicates++;
+		return;
+	}
+	report.samples += fresh;
+
+	const worker_sync_t* synced = p->link.get_sync();
+	if (synced->id != j->sync_seen) {
+		j->sync_seen = synced->id;
+		if (synced->id == poller->get_sync_id()) {
+			int32_t dev	= worker_real(j->worker, synced->sample.time, now) - poller->get_sync_target();
+			uint32_t abs = dev < 0 ? -dev : dev;
+			report.syncs++;
+			report.sync_sum += abs;
+			if (report.sync_max < abs) report.sync_max = abs;
+		}
+	}
+
+	// v2はWorkerのサンプル時刻をClockSyncでParentの時刻に直したもの、v1はAHRS更新の履歴と照合する
+	Quaternion q	   = p->rotation;
+	int64_t sampled_at = p->sampled_at;
+	if (p->link.get_protocol() == PROTOCOL_VERSION_1) {
+		sampled_at = find_sampled_at(j->worker, &q);
+	} else if (sampled_at > 0) {
+		uint32_t time = p->link.get_samples()[fresh - 1].time;
+		int64_t error = sampled_at - worker_real(j->worker, time, now);
+		uint32_t abs  = error < 0 ? -error : error;
+		// サンプル時刻の真の姿勢と比べる、Worker / Parentどちらで姿勢を計算しても同じ基準になる
+		Quaternion truth;
+		Vector3<float> rate;
+		j->worker->motion->sample(worker_real(j->worker, time, now), &truth, &rate);
+		float cos_half = fminf(fabsf(truth.x * q.x + truth.y * q.y + truth.z * q.z + truth.w * q.w), 1.0f);
+		float angle	   = 2.0f * acosf(cos_half) * 57.29578f;
+		report.angle_sum += angle;
+		if (report.angle_max < angle) report.angle_max = angle;
+
+		if (smoothing) {
+			Quaternion s = p->smoothed;
+			cos_half	   = fminf(fabsf(truth.x * s.x + truth.y * s.y + truth.z * s.z + truth.w * s.w), 1.0f);
+			angle		   = 2.0f * acosf(cos_half) * 57.29578f;
+			report.smoothed++;
+			report.smooth_sum += angle;
+			if (report.smooth_max < angle) report.smooth_max = angle;
+		}
+
+		report.clocks++;
+		report.clock_sum += abs;
+		if (report.clock_max < abs) report.clock_max = abs;
+	}
+
+	if (sampled_at > 0) {
+		uint32_t age = esp_timer_get_time() - sampled_at;
+		report.matched++;
+		report.age_sum += age;
+		if (report.age_max < age) report.age_max = age;
+	}
+}
+
+static void setup_parent(sim_options_t* options, OscSender* sender) {
+	const wire_s* wires[] = {&M5Stack_Internal, &M5Stack_PortC};
+	for (int b = 0; b < options->buses; b++) {
+		I2CMaster* master = new I2CMaster(wires[b]);
+		master->set_statistics(bus_statistics + b);
+		i2c_queue[b] = new I2CQueue(master, JOINT_POLLER_BATCH, b);
+	}
+
+	poller = new JointPoller(sender, &skeleton, options->rate);
+	poller->set_sync_rate(options->sync_rate);
+	poller->set_observer(measure, nullptr);
+	smoothing = options->min_cutoff > 0.0f;
+
+	for (int k = 0; k < options->workers; k++) {
+		SimJoint* j = joints + k;
+		SimWorker* w = workers + k;
+		// chain関節毎に、先頭はルームの座標系、続く関節は1つ前の関節のトラッカーに繋ぐ
+		if (k % options->chain == 0) {
+			j->root_serial[0] = '\0';
+		} else {
+			snprintf(j->root_serial, sizeof(j->root_serial), "VMT_%d", k);
+		}
+		j->bus		  = w->bus;
+		j->tracker_index = k + 1;
+		j->bone		  = {0.0f, 0.3f, 0.0f};
+		j->worker		  = w;
+		j->sync_seen	  = 0;
+		j->node		  = skeleton.add(j->bone, Quaternion::identify());
+
+		j->poll = poller->add(w->address, i2c_queue[j->bus], options->reply, options->staged, options->adaptive);
+		j->poll->smoothing.set_parameters(options->min_cutoff, options->beta);
+	}
+
+	// 実機のbuild_skeleton()と同じく、root_serialが自分の関節のトラッカーならその子にする
+	for (int k = 0; k < options->workers; k++) {
+		SimJoint* j = joints + k;
+		int parent  = -1;
+		if (strncmp(j->root_serial, "VMT_", 4) == 0) {
+			int index = atoi(j->root_serial + 4);
+			for (int i = 0; i < options->workers; i++) {
+				if (joints[i].tracker_index == index) parent = joints[i].node;
+			}
+		}
+		skeleton.set_parent(j->node, parent);
+	}
+	skeleton.build();
+
+	for (int k = 0; k < options->workers; k++) {
+		SimJoint* j = joints + k;
+		SimJoint* o = joints + skeleton.get_origin(j->node);
+		j->osc_serial.set(o->root_serial);
+		j->poll->node		 = j->node;
+		j->poll->output	 = o->root_serial[0] ? OSC_MESSAGE_FOLLOW : OSC_MESSAGE_ROOM;
+		j->poll->serial	 = &j->osc_serial;
+		j->poll->tracker_index = j->tracker_index;
+	}
+}
+
+static void print_report(int64_t elapsed, sim_report_t* r, int workers_count) {
+	int calibrated = 0;
+	worker_packet_t packet;
+	for (int k = 0; k < workers_count; k++) {
+		workers[k].slave->read(&packet);
+		if (!(packet.v2.flags & DATA_FLAG_CALIBRATING)) calibrated++;
+	}
+
+	printf("%3ds poll %5u/s fail %4u dup %4u samples %5u/s osc %5u/s (udp %4u/s, coalesced %3u, dropped %u) | poll avg %4uus max %5uus | age avg %5uus max %6uus (%u) | ready %d/%d\n",
+		  (int)(elapsed / 1000000), r->polls, r->failures, r->duplicates, r->samples, r->messages, r->datagrams, r->coalesced, r->dropped,
+		  r->polls ? (uint32_t)(r->poll_sum / r->polls) : 0, r->poll_max,
+		  r->matched ? (uint32_t)(r->age_sum / r->matched) : 0, r->age_max, r->matched,
+		  calibrated, workers_count);
+	if (r->clocks) printf("     clock err avg %4uus max %5uus | angle err avg %5.2f max %6.2f deg\n", (uint32_t)(r->clock_sum / r->clocks), r->clock_max, r->angle_sum / r->clocks, r->angle_max);
+	if (r->smoothed) printf("     smoothed angle err avg %5.2f max %6.2f deg\n", r->smooth_sum / r->smoothed, r->smooth_max);
+	if (r->syncs) printf("     sync %4u/s | dev avg %4uus max %5uus\n", r->syncs, (uint32_t)(r->sync_sum / r->syncs), r->sync_max);
+	fflush(stdout);
+}
+
+static void print_output(OscSender* sender) {
+	output_stat_t o;
+	sender->read_output_statistics(&o);
+	printf("     output %4u/s skipped %3u | jitter avg %4uus max %5uus | extrapolate avg %5uus max %6uus\n", o.frames, o.skipped,
+		  o.frames ? (uint32_t)(o.jitter_sum / o.frames) : 0, o.jitter_max,
+		  o.poses ? (uint32_t)(o.age_sum / o.poses) : 0, o.age_max);
+}
+
+static void print_network(OscClient* osc) {
+	char text[160];
+	osc_send_stat_t n;
+	if (osc->read_statistics(&n) == 0) return;
+	OscClient::format(&n, text, sizeof(text));
+	printf("     %s", text);
+}
+
+static void print_telemetry(int workers_count) {
+	printf("telemetry\naddr health rate  age[us] bias               imu  slave cmd\n");
+	for (int k = 0; k < workers_count; k++) {
+		WorkerLink* link		  = &joints[k].poll->link;
+		const data_telemetry_u* t = link->get_telemetry();
+		if (t->version != PROTOCOL_VERSION_2) {
+			printf("%4d -\n", workers[k].address);
+			continue;
+		}
+		printf("%4d   0x%02x %4u %8u [%5d %5d %5d] %5u %5u %5u\n", workers[k].address, link->get_health(), t->fusion_rate, t->sample_age,
+			  t->bias[0], t->bias[1], t->bias[2], t->imu_errors, t->slave_errors, t->command_errors);
+	}
+}
+
+struct bench_result_t {
+	uint64_t send_us;
+	uint64_t bytes;
+	uint32_t datagrams;
+	float angle_max;	 // CompactDecoderで復元した姿勢の誤差 [度]
+	float position_max;	 // [mm]
+};
+
+/// 同じ関節数のフレームを、送信先の形式を変えて自分宛てに送り、送信時間とデータグラムの大きさを比べる
+static void run_benchmark(int joint_count, int frames) {
+	int rx = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family	   = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t local_length = sizeof(local);
+	int buffer_size	   = 4 * 1024 * 1024;
+	setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+	bind(rx, (sockaddr*)&local, sizeof(local));
+	getsockname(rx, (sockaddr*)&local, &local_length);
+
+	const uint8_t host[4] = {127, 0, 0, 1};
+	const struct {
+		const char* name;
+		uint8_t messages;
+	} formats[] = {
+		{"osc", OSC_MESSAGE_FOLLOW},
+		{"compact", OSC_MESSAGE_FOLLOW | OSC_FORMAT_COMPACT},
+		{"compact -pos", OSC_MESSAGE_FOLLOW | OSC_FORMAT_COMPACT | OSC_FORMAT_NO_POSITION},
+	};
+
+	static osc_string_t serials[MAX_WORKERS];
+	for (int k = 0; k < joint_count; k++) {
+		char serial[OSC_STRING_CAPACITY];
+		snprintf(serial, sizeof(serial), "VMT_%d", k);
+		serials[k].set(serial);
+	}
+
+	printf("transport benchmark: %d joints x %d frames\n", joint_count, frames);
+	printf("format        send[us/frame] bytes/frame bytes/joint datagrams/frame angle err max[deg] pos err max[mm]\n");
+
+	static uint8_t datagram[OscClient::bundle_limit];
+	static compact_pose_t poses[COMPACT_MAX_JOINTS];
+	for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+		OscClient* client = new OscClient(host, ntohs(local.sin_port));
+		client->set_destination(0, host, ntohs(local.sin_port), formats[f].messages);
+
+		bench_result_t r;
+		memset(&r, 0, sizeof(r));
+		VMTJointArgument_t args[MAX_WORKERS];
+		for (int n = 0; n < frames; n++) {
+			for (int k = 0; k < joint_count; k++) {
+				float a	   = 0.001f * n + 0.3f * k;
+				Quaternion q = Quaternion::xyzw(sinf(a) * 0.6f, cosf(a * 0.7f) * 0.5f, 0.3f, 1.0f);
+				q.normalize();
+				args[k] = {serials + k, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -0.004f, 1, k};
+				args[k].set(q, q * Vector3<float>::xyz(0.0f, 0.0f, -0.4f));
+			}
+
+			int64_t start = esp_timer_get_time();
+			client->begin_bundle();
+			for (int k = 0; k < joint_count; k++) client->send_follow(args + k);
+			client->end_bundle();
+			r.send_us += esp_timer_get_time() - start;
+
+			ssize_t length;
+			while ((length = recv(rx, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0) {
+				r.datagrams++;
+				r.bytes += length;
+
+				compact_header_t header;
+				if (!(formats[f].messages & OSC_FORMAT_COMPACT)) continue;
+				if (!CompactDecoder::decode(datagram, length, &header, poses)) {
+					printf("decode error\n");
+					continue;
+				}
+
+				for (int i = 0; i < header.count; i++) {
+					VMTJointArgument_t* a = args + poses[i].index;
+					Quaternion q	    = poses[i].rotation;
+					float dot		    = fminf(fabsf(q.x * a->qx + q.y * a->qy + q.z * a->qz + q.w * a->qw), 1.0f);
+					float angle	    = 2.0f * acosf(dot) * 57.29578f;
+					if (r.angle_max < angle) r.angle_max = angle;
+					if (poses[i].flags & COMPACT_FLAG_POSITION) {
+						Vector3<float> p = poses[i].position;
+						float d		 = fmaxf(fabsf(p.x - a->x), fmaxf(fabsf(p.y - a->y), fabsf(p.z - a->z))) * 1000.0f;
+						if (r.position_max < d) r.position_max = d;
+					}
+				}
+			}
+		}
+
+		printf("%-13s %14.2f %11.1f %11.1f %15.2f %19.3f %15.2f\n", formats[f].name, (double)r.send_us / frames, (double)r.bytes / frames,
+			  (double)r.bytes / frames / joint_count, (double)r.datagrams / frames, r.angle_max, r.position_max);
+		delete client;
+	}
+
+	// 送信を除いた、OSCメッセージの組み立てだけに掛かる時間
+	static uint8_t message[OscClient::message_limit];
+	VMTJointArgument_t arg = {serials, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -0.004f, 1, 0};
+	int64_t encode_us = 0;
+	uint64_t encoded  = 0;
+	for (int n = 0; n < frames; n++) {
+		int64_t start = esp_timer_get_time();
+		for (int k = 0; k < joint_count; k++) {
+			float a	   = 0.001f * n + 0.3f * k;
+			Quaternion q = Quaternion::xyzw(sinf(a) * 0.6f, cosf(a * 0.7f) * 0.5f, 0.3f, 1.0f);
+			q.normalize();
+			arg.serial = serials + k;
+			arg.index  = k;
+			arg.set(q, q * Vector3<float>::xyz(0.0f, 0.0f, -0.4f));
+			encoded += OscClient::encode(OSC_MESSAGE_FOLLOW, &arg, message);
+		}
+		encode_us += esp_timer_get_time() - start;
+	}
+	printf("%-13s %14.2f %11.1f %11.1f\n", "osc encode", (double)encode_us / frames, (double)encoded / frames, (double)encoded / frames / joint_count);
+
+	close(rx);
+}
+
+static void usage(const char* name) {
+	fprintf(stderr,
+		   "usage: %s [-n workers] [-t seconds] [-b buses] [-h host] [-p port] [-r rate_hz] [-v 1|2] [-s|-d|-f] [-c] [-u] [-o output_hz] [-x port[:messages[:divider]]] [-y sync_hz] [-a tenth_deg] [-z stationary] [-i mpu6886|lsm9ds1] [-m motion.csv] [-j chain] [-e min_cutoff[:beta]] [-k frames]\n"
+		   "  motion.csv: time_us, qx, qy, qz, qw (繰り返し再生)\n"
+		   "  messages: 16進数、1: /VMT/Joint/Driver, 2: /VMT/Follow/Driver, 4: /JointTracker/Telemetry, 8: /VMT/Room/Driver\n",
+		   name);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+	sim_options_t options = {16, 20, 1, {127, 0, 0, 1}, 39570, POLL_RATE_HZ, PROTOCOL_VERSION_2, COMMAND_GET_BATCH, true, true, OSC_OUTPUT_RATE_HZ, 0, 0, 0, "mpu6886", nullptr, 3, 0.0f, 0.0f};
+
+	int benchmark = 0;
+	int c;
+	while ((c = getopt(argc, argv, "n:t:b:h:p:r:v:sdfcuo:x:y:a:z:i:m:j:e:k:")) != -1) {
+		switch (c) {
+			case 'n':
+				options.workers = atoi(optarg);
+				break;
+			case 't':
+				options.seconds = atoi(optarg);
+				break;
+			case 'b':
+				options.buses = atoi(optarg);
+				break;
+			case 'h':
+				if (inet_pton(AF_INET, optarg, options.host) != 1) usage(argv[0]);
+				break;
+			case 'p':
+				options.port = atoi(optarg);
+				break;
+			case 'r':
+				options.rate = atoi(optarg);
+				break;
+			case 'v':
+				options.protocol = atoi(optarg);
+				break;
+			case 's':
+				options.reply = COMMAND_GET_QUATERNION_V2;
+				break;
+			case 'd':
+				options.reply = COMMAND_GET_DELTA;
+				break;
+			case 'f':
+				options.reply = COMMAND_GET_RAW;
+				break;
+			case 'c':
+				options.staged = false;
+				break;
+			case 'u':
+				options.bundle = false;
+				break;
+			case 'o':
+				options.output_rate = atoi(optarg);
+				break;
+			case 'x': {
+				if (options.destinations >= OSC_DESTINATIONS - 1) usage(argv[0]);
+				sim_destination_t* d = options.destination + options.destinations++;
+				unsigned port = 0;
+				d->messages   = OSC_MESSAGE_ALL;
+				d->divider	   = 1;
+				if (sscanf(optarg, "%u:%x:%u", &port, &d->messages, &d->divider) < 1 || port == 0 || port > 65535) usage(argv[0]);
+				d->port = port;
+				break;
+			}
+			case 'y':
+				options.sync_rate = atoi(optarg);
+				break;
+			case 'a':
+				options.adaptive = atoi(optarg);
+				break;
+			case 'z':
+				options.stationary = atoi(optarg);
+				break;
+			case 'i':
+				options.imu = optarg;
+				break;
+			case 'm':
+				options.motion = optarg;
+				break;
+			case 'j':
+				options.chain = atoi(optarg);
+				break;
+			case 'e':
+				if (sscanf(optarg, "%f:%f", &options.min_cutoff, &options.beta) < 1 || options.min_cutoff < 0.0f) usage(argv[0]);
+				break;
+			case 'k':
+				benchmark = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (options.workers < 1 || options.workers > MAX_WORKERS) usage(argv[0]);
+	if (options.buses < 1 || options.buses > I2C_BUS_COUNT) usage(argv[0]);
+	if (options.chain < 1) usage(argv[0]);
+
+	if (benchmark > 0) {
+		run_benchmark(options.workers, benchmark);
+		return 0;
+	}
+
+	setup_workers(&options);
+
+	OscClient* osc	   = new OscClient(options.host, options.port);
+	OscSender* sender = new OscSender(osc);
+	for (int i = 0; i < options.destinations; i++) {
+		sim_destination_t* d = options.destination + i;
+		osc->set_destination(i + 1, options.host, d->port, d->messages, d->divider);
+	}
+	sender->set_rate(options.output_rate);
+	// beginしなければ、OscSenderは送信タスクを使わず1メッセージずつ送る
+	if (options.bundle) sender->begin(0);
+	setup_parent(&options, sender);
+	uint32_t sender_datagrams = 0, sender_coalesced = 0, sender_dropped = 0, poses = 0;
+
+	memset(&report, 0, sizeof(report));
+
+	int64_t start	     = esp_timer_get_time();
+	int64_t next_report = start + 1000000;
+	int64_t end		     = start + (int64_t)options.seconds * 1000000;
+
+	// 実機Parentのloop()と同じ処理
+	while (esp_timer_get_time() < end) {
+		poller->poll();
+
+		int64_t now = esp_timer_get_time();
+		if (now >= next_report) {
+			report.messages  = poller->get_poses() - poses;
+			report.datagrams = sender->get_datagrams() - sender_datagrams;
+			report.coalesced = sender->get_coalesced() - sender_coalesced;
+			report.dropped   = sender->get_dropped() - sender_dropped;
+			poses += report.messages;
+			sender_datagrams += report.datagrams;
+			sender_coalesced += report.coalesced;
+			sender_dropped += report.dropped;
+			print_report(now - start, &report, options.workers);
+			if (options.bundle && options.output_rate > 0) print_output(sender);
+			print_network(osc);
+			memset(&report, 0, sizeof(report));
+			next_report += 1000000;
+		}
+
+		vTaskDelay(1);
+	}
+
+	static char text[2048];
+	for (int b = 0; b < options.buses; b++) {
+		bus_statistics[b].format(text, sizeof(text));
+		printf("bus %d\n%s", b, text);
+	}
+	poller->get_statistics()->format(text, sizeof(text));
+	printf("poll\n%s", text);
+	print_telemetry(options.workers);
+
+	return 0;
+}
@@ -0,0 +1,317 @@
+#include <driver/i2c.h>
+#include <esp_timer.h>
+#include <rom/ets_sys.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "VirtualBus.h"
+
+struct VirtualBus {
+	std::timed_mutex mutex;
+	std::map<uint8_t, VirtualDevice*> devices;
+};
+
+/// スレーブモードのポート、マスターからの書き込みをrxに、スレーブの応答をtxに持つ
+struct VirtualSlave : public VirtualDevice {
+	std::mutex mutex;
+	std::condition_variable received;
+	std::deque<uint8_t> rx, tx;
+	size_t rx_length, tx_length;
+
+	void write(const uint8_t* data, size_t length) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int i = 0; i < length && rx.size() < rx_length; i++) rx.push_back(data[i]);
+		received.notify_all();
+	}
+
+	void read(uint8_t* data, size_t length) {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int i = 0; i < length; i++) {
+			// FIFOが空の場合、実機同様に不定値（0xff）を返す
+			if (tx.empty()) {
+				data[i] = 0xff;
+			} else {
+				data[i] = tx.front();
+				tx.pop_front();
+			}
+		}
+	}
+};
+
+struct VirtualPort {
+	i2c_config_t conf;
+	bool installed;
+	VirtualBus* bus;
+	VirtualSlave* slave;
+};
+
+enum class Op {
+	Start,
+	Write,
+	Read,
+	Stop,
+};
+
+struct VirtualStep {
+	Op op;
+	std::vector<uint8_t> data;
+	uint8_t* destination;
+	size_t length;
+	bool ack;
+};
+
+struct VirtualCommand {
+	std::vector<VirtualStep> steps;
+};
+
+static std::mutex registry_mutex;
+static std::map<int, VirtualBus*> buses;
+static std::map<i2c_port_t, VirtualPort*> ports;
+
+static VirtualBus* bus_of(int scl) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	VirtualBus*& bus = buses[scl];
+	if (bus == nullptr) bus = new VirtualBus();
+	return bus;
+}
+
+static VirtualPort* port_of(i2c_port_t port) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	auto p = ports.find(port);
+	return p == ports.end() ? nullptr : p->second;
+}
+
+bool virtual_bus_attach(int scl, uint8_t address, VirtualDevice* device) {
+	VirtualBus* bus = bus_of(scl);
+	std::lock_guard<std::timed_mutex> lock(bus->mutex);
+	if (bus->devices.count(address)) return false;
+	bus->devices[address] = device;
+	return true;
+}
+
+VirtualRegisterDevice::VirtualRegisterDevice() {
+	memset(registers, 0, sizeof(registers));
+	pointer		   = 0;
+	pointer_written = false;
+}
+
+void VirtualRegisterDevice::begin(bool read) {
+	if (read) {
+		latch();
+	} else {
+		pointer_written = false;
+	}
+}
+
+void VirtualRegisterDevice::write(const uint8_t* data, size_t length) {
+	for (int i = 0; i < length; i++) {
+		if (!pointer_written) {
+			pointer		   = data[i];
+			pointer_written = true;
+		} else {
+			registers[pointer++] = data[i];
+		}
+	}
+}
+
+void VirtualRegisterDevice::read(uint8_t* data, size_t length) {
+	for (int i = 0; i < length; i++) data[i] = registers[pointer++];
+}
+
+void VirtualRegisterDevice::set_big_endian(uint8_t registry, int16_t value) {
+	registers[registry]			= (uint16_t)value >> 8;
+	registers[(uint8_t)(registry + 1)] = value & 0xff;
+}
+
+void VirtualRegisterDevice::set_little_endian(uint8_t registry, int16_t value) {
+	registers[registry]			= value & 0xff;
+	registers[(uint8_t)(registry + 1)] = (uint16_t)value >> 8;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t* conf) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	VirtualPort*& p = ports[port];
+	if (p == nullptr) p = new VirtualPort();
+	p->conf = *conf;
+	return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len, int intr_alloc_flags) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr || p->installed) return ESP_ERR_INVALID_STATE;
+
+	p->bus	 = bus_of(p->conf.scl_io_num);
+	p->slave = nullptr;
+	if (mode == I2C_MODE_SLAVE) {
+		p->slave		   = new VirtualSlave();
+		p->slave->rx_length = slv_rx_buf_len;
+		p->slave->tx_length = slv_tx_buf_len;
+		if (!virtual_bus_attach(p->conf.scl_io_num, p->conf.slave.slave_addr, p->slave)) return ESP_ERR_INVALID_STATE;
+	}
+
+	p->installed = true;
+	return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr) return ESP_ERR_INVALID_ARG;
+	p->installed = false;
+	return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create() { return new VirtualCommand(); }
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd) { delete cmd; }
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) {
+	cmd->steps.push_back({Op::Start, {}, nullptr, 0, false});
+	return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd) {
+	cmd->steps.push_back({Op::Stop, {}, nullptr, 0, false});
+	return ESP_OK;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en) {
+	cmd->steps.push_back({Op::Write, {data}, nullptr, 1, ack_en});
+	return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, uint8_t* data, size_t data_len, bool ack_en) {
+	cmd->steps.push_back({Op::Write, std::vector<uint8_t>(data, data + data_len), nullptr, data_len, ack_en});
+	return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t* data, i2c_ack_type_t ack) {
+	return i2c_master_read(cmd, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t* data, size_t data_len, i2c_ack_type_t ack) {
+	cmd->steps.push_back({Op::Read, {}, data, data_len, false});
+	return ESP_OK;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr || !p->installed || p->slave != nullptr) return ESP_ERR_INVALID_STATE;
+
+	VirtualBus* bus = p->bus;
+	std::unique_lock<std::timed_mutex> lock(bus->mutex, std::defer_lock);
+	if (!lock.try_lock_for(std::chrono::milliseconds(ticks_to_wait))) return ESP_ERR_TIMEOUT;
+
+	// 1byte = 8bit + ACK、START/STOPを各1bitとしてバス占有時間を見積もる
+	int64_t start = esp_timer_get_time();
+	uint64_t bits = 0;
+
+	esp_err_t result	 = ESP_OK;
+	VirtualDevice* device = nullptr;
+	bool addressed		 = false;
+
+	for (VirtualStep& step : cmd->steps) {
+		switch (step.op) {
+			case Op::Start:
+				bits++;
+				if (device) device->end();
+				device	 = nullptr;
+				addressed = true;
+				break;
+			case Op::Stop:
+				bits++;
+				if (device) device->end();
+				device = nullptr;
+				break;
+			case Op::Write: {
+				bits += 9 * step.data.size();
+				const uint8_t* data = step.data.data();
+				size_t length	    = step.data.size();
+				if (addressed) {
+					addressed = false;
+
+					auto d = bus->devices.find(data[0] >> 1);
+					if (d == bus->devices.end()) {
+						if (step.ack) result = ESP_FAIL;
+						break;
+					}
+					device = d->second;
+					device->begin(data[0] & I2C_MASTER_READ);
+					data++;
+					length--;
+				}
+				if (device && length > 0) device->write(data, length);
+				break;
+			}
+			case Op::Read:
+				bits += 9 * step.length;
+				if (device) {
+					device->read(step.destination, step.length);
+				} else {
+					memset(step.destination, 0xff, step.length);
+				}
+				break;
+		}
+		if (result != ESP_OK) break;
+	}
+	if (device) device->end();
+
+	uint32_t speed = p->conf.master.clk_speed ? p->conf.master.clk_speed : 100000;
+	int64_t end	= start + bits * 1000000 / speed;
+	int64_t now	= esp_timer_get_time();
+	if (end > now) ets_delay_us(end - now);
+
+	return result;
+}
+
+int i2c_slave_read_buffer(i2c_port_t port, uint8_t* data, size_t max_size, TickType_t ticks_to_wait) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr || p->slave == nullptr) return -1;
+
+	VirtualSlave* s = p->slave;
+	std::unique_lock<std::mutex> lock(s->mutex);
+	if (ticks_to_wait > 0) {
+		s->received.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), [s] { return !s->rx.empty(); });
+	}
+
+	size_t n = 0;
+	while (n < max_size && !s->rx.empty()) {
+		data[n++] = s->rx.front();
+		s->rx.pop_front();
+	}
+	return n;
+}
+
+int i2c_slave_write_buffer(i2c_port_t port, const uint8_t* data, int size, TickType_t ticks_to_wait) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr || p->slave == nullptr) return -1;
+
+	VirtualSlave* s = p->slave;
+	std::lock_guard<std::mutex> lock(s->mutex);
+	int n = 0;
+	while (n < size && s->tx.size() < s->tx_length) s->tx.push_back(data[n++]);
+	return n;
+}
+
+esp_err_t i2c_reset_tx_fifo(i2c_port_t port) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr || p->slave == nullptr) return ESP_ERR_INVALID_ARG;
+
+	std::lock_guard<std::mutex> lock(p->slave->mutex);
+	p->slave->tx.clear();
+	return ESP_OK;
+}
+
+esp_err_t i2c_reset_rx_fifo(i2c_port_t port) {
+	VirtualPort* p = port_of(port);
+	if (p == nullptr || p->slave == nullptr) return ESP_ERR_INVALID_ARG;
+
+	std::lock_guard<std::mutex> lock(p->slave->mutex);
+	p->slave->rx.clear();
+	return ESP_OK;
+}
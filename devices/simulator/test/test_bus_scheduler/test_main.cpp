@@ -0,0 +1,141 @@
+// BusSchedulerのポーリング順序、静止中の間隔、応答しないWorkerのバックオフを確かめる
+
+#include <BusScheduler.h>
+#include <unity.h>
+
+// 目標100Hz、10msおき
+#define RATE 100
+#define INTERVAL 10000
+// 起動直後の動きがあったとみなす期間を過ぎた時刻
+#define T0 10000000
+
+static BusScheduler* scheduler;
+static uint8_t indices[BUS_SCHEDULER_MAX_SLOTS];
+
+void setUp() { scheduler = new BusScheduler(RATE); }
+
+void tearDown() { delete scheduler; }
+
+void test_add_is_limited() {
+	for (int i = 0; i < BUS_SCHEDULER_MAX_SLOTS; i++) TEST_ASSERT_EQUAL(i, scheduler->add(0x10 + i));
+	TEST_ASSERT_EQUAL(-1, scheduler->add(0x40));
+	TEST_ASSERT_EQUAL(BUS_SCHEDULER_MAX_SLOTS, scheduler->size());
+	TEST_ASSERT_EQUAL(0x13, scheduler->get(3)->address);
+	TEST_ASSERT_EQUAL(INTERVAL, scheduler->get(3)->interval);
+}
+
+void test_commit_sets_next_due() {
+	scheduler->add(0x10);
+	TEST_ASSERT_EQUAL(1, scheduler->schedule(T0, indices, BUS_SCHEDULER_MAX_SLOTS));
+	// 投入できなかったスロットは次回も返る
+	TEST_ASSERT_EQUAL(1, scheduler->schedule(T0 + 100, indices, BUS_SCHEDULER_MAX_SLOTS));
+
+	scheduler->commit(0, T0 + 100);
+	TEST_ASSERT_EQUAL(0, scheduler->schedule(T0 + 100 + INTERVAL - 1, indices, BUS_SCHEDULER_MAX_SLOTS));
+	TEST_ASSERT_EQUAL(1, scheduler->schedule(T0 + 100 + INTERVAL, indices, BUS_SCHEDULER_MAX_SLOTS));
+}
+
+void test_late_slots_first() {
+	for (int i = 0; i < 3; i++) scheduler->add(0x10 + i);
+	scheduler->commit(0, T0 - 3000);
+	scheduler->commit(1, T0 - 1000);
+	scheduler->commit(2, T0 - 5000);
+	// 期限はそれぞれ7ms・9ms・5ms後
+	TEST_ASSERT_EQUAL(3, scheduler->schedule(T0 + INTERVAL, indices, BUS_SCHEDULER_MAX_SLOTS));
+	TEST_ASSERT_EQUAL(2, indices[0]);
+	TEST_ASSERT_EQUAL(0, indices[1]);
+	TEST_ASSERT_EQUAL(1, indices[2]);
+}
+
+void test_moving_slots_first() {
+	for (int i = 0; i < 3; i++) scheduler->add(0x10 + i);
+	scheduler->commit(0, T0 - 5000);
+	scheduler->commit(1, T0 - 3000);
+	scheduler->commit(2, T0 - 1000);
+	// 遅れが最も小さくても、動いているスロットを先にする
+	scheduler->report(2, T0, true, true);
+	TEST_ASSERT_EQUAL(3, scheduler->schedule(T0 + INTERVAL, indices, BUS_SCHEDULER_MAX_SLOTS));
+	TEST_ASSERT_EQUAL(2, indices[0]);
+	TEST_ASSERT_EQUAL(0, indices[1]);
+	TEST_ASSERT_EQUAL(1, indices[2]);
+}
+
+void test_max_keeps_highest_priority() {
+	for (int i = 0; i < 4; i++) scheduler->add(0x10 + i);
+	for (int i = 0; i < 4; i++) scheduler->commit(i, T0 - 1000 * i);
+	// 期限の遅れは3, 2, 1, 0の順に大きい
+	TEST_ASSERT_EQUAL(2, scheduler->schedule(T0 + INTERVAL, indices, 2));
+	TEST_ASSERT_EQUAL(3, indices[0]);
+	TEST_ASSERT_EQUAL(2, indices[1]);
+}
+
+void test_idle_and_dormant_intervals() {
+	scheduler->add(0x10);
+	scheduler->report(0, T0, true, true);
+	TEST_ASSERT_EQUAL(INTERVAL, scheduler->get(0)->interval);
+	// 動きが無くても、motion_windowの間は目標レートのまま
+	scheduler->report(0, T0 + BusScheduler::motion_window - 1, true, false);
+	TEST_ASSERT_EQUAL(INTERVAL, scheduler->get(0)->interval);
+
+	scheduler->report(0, T0 + BusScheduler::motion_window, true, false);
+	TEST_ASSERT_EQUAL(INTERVAL * BusScheduler::idle_ratio, scheduler->get(0)->interval);
+	scheduler->report(0, T0 + BusScheduler::motion_window, true, false, true);
+	TEST_ASSERT_EQUAL(INTERVAL * BusScheduler::dormant_ratio, scheduler->get(0)->interval);
+
+	// 動き出せばすぐに戻る
+	scheduler->report(0, T0 + BusScheduler::motion_window * 2, true, true, false);
+	TEST_ASSERT_EQUAL(INTERVAL, scheduler->get(0)->interval);
+}
+
+void test_failures_back_off() {
+	scheduler->add(0x10);
+	for (int n = 1; n <= 7; n++) {
+		scheduler->report(0, T0, false, false);
+		TEST_ASSERT_EQUAL(n, scheduler->get(0)->failures);
+		int64_t backoff = (int64_t)INTERVAL << n;
+		if (backoff > BusScheduler::backoff_limit) backoff = BusScheduler::backoff_limit;
+		TEST_ASSERT_EQUAL(T0 + backoff, scheduler->get(0)->next_due);
+	}
+	// 上限で止まり、その前にはポーリングしない
+	TEST_ASSERT_EQUAL(T0 + BusScheduler::backoff_limit, scheduler->get(0)->next_due);
+	TEST_ASSERT_EQUAL(0, scheduler->schedule(T0 + BusScheduler::backoff_limit - 1, indices, BUS_SCHEDULER_MAX_SLOTS));
+	TEST_ASSERT_EQUAL(1, scheduler->schedule(T0 + BusScheduler::backoff_limit, indices, BUS_SCHEDULER_MAX_SLOTS));
+
+	// 成功すれば数え直す
+	scheduler->report(0, T0 + BusScheduler::backoff_limit, true, false);
+	TEST_ASSERT_EQUAL(0, scheduler->get(0)->failures);
+	scheduler->report(0, T0 + BusScheduler::backoff_limit, false, false);
+	TEST_ASSERT_EQUAL(T0 + BusScheduler::backoff_limit + INTERVAL * 2, scheduler->get(0)->next_due);
+}
+
+void test_backoff_does_not_overflow() {
+	scheduler->add(0x10);
+	for (int n = 0; n < 100; n++) scheduler->report(0, T0, false, false);
+	TEST_ASSERT_EQUAL(31, scheduler->get(0)->failures);
+	TEST_ASSERT_EQUAL(T0 + BusScheduler::backoff_limit, scheduler->get(0)->next_due);
+}
+
+void test_set_target_rate() {
+	scheduler->add(0x10);
+	scheduler->add(0x11);
+	scheduler->set_target_rate(250);
+	TEST_ASSERT_EQUAL(4000, scheduler->get(0)->interval);
+	TEST_ASSERT_EQUAL(4000, scheduler->get(1)->interval);
+	// 0Hzは1Hzとして扱う
+	scheduler->set_target_rate(0);
+	TEST_ASSERT_EQUAL(1000000, scheduler->get(0)->interval);
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_add_is_limited);
+	RUN_TEST(test_commit_sets_next_due);
+	RUN_TEST(test_late_slots_first);
+	RUN_TEST(test_moving_slots_first);
+	RUN_TEST(test_max_keeps_highest_priority);
+	RUN_TEST(test_idle_and_dormant_intervals);
+	RUN_TEST(test_failures_back_off);
+	RUN_TEST(test_backoff_does_not_overflow);
+	RUN_TEST(test_set_target_rate);
+	return UNITY_END();
+}
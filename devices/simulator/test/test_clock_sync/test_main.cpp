@@ -0,0 +1,113 @@
+// ClockSyncに時計のずれとドリフトを持たせたpingの往復を与え、Workerの時刻を戻せるか確かめる
+
+#include <ClockSync.h>
+#include <unity.h>
+
+#define PING_INTERVAL_US 250000
+
+static ClockSync* estimator;
+
+// Workerの時計、Parentの時刻からの起動時刻のずれとクロックの誤差
+static uint32_t worker_offset;
+static int32_t worker_ppm;
+
+static uint32_t worker_time(int64_t parent) { return (uint32_t)(parent + parent * worker_ppm / 1000000) + worker_offset; }
+
+/// 行き・帰りともdelay_us、Worker側の処理にturn_us掛かったpingを与える
+static void ping(int64_t sent_at, uint32_t delay_us = 100, uint32_t turn_us = 50, int32_t error_us = 0) {
+	uint32_t received = worker_time(sent_at + delay_us) + error_us;
+	uint32_t replied  = worker_time(sent_at + delay_us + turn_us) + error_us;
+	estimator->add(sent_at, received, replied, sent_at + 2 * delay_us + turn_us);
+}
+
+void setUp() {
+	estimator	  = new ClockSync();
+	worker_offset = 0x9e3779b9u;
+	worker_ppm	  = 0;
+}
+
+void tearDown() { delete estimator; }
+
+void test_valid_after_min_samples() {
+	int64_t t = 1000000;
+	for (int i = 0; i < ClockSync::min_samples - 1; i++, t += PING_INTERVAL_US) ping(t);
+	TEST_ASSERT_FALSE(estimator->is_valid());
+	ping(t);
+	TEST_ASSERT_TRUE(estimator->is_valid());
+	TEST_ASSERT_EQUAL(200, estimator->get_round_trip());
+}
+
+void test_offset_is_removed() {
+	int64_t t = 1000000;
+	for (int i = 0; i < ClockSync::window; i++, t += PING_INTERVAL_US) ping(t);
+
+	// 直近のpingの前後のサンプル時刻
+	TEST_ASSERT_INT64_WITHIN(2, t, estimator->to_parent(worker_time(t)));
+	TEST_ASSERT_INT64_WITHIN(2, t - 10000, estimator->to_parent(worker_time(t - 10000)));
+}
+
+void test_drift_is_estimated() {
+	worker_ppm = 40;
+	int64_t t  = 1000000;
+	for (int i = 0; i < ClockSync::window; i++, t += PING_INTERVAL_US) ping(t);
+
+	TEST_ASSERT_FLOAT_WITHIN(1.0f, 40.0f, estimator->get_drift());
+	// 次のpingまでの間もドリフト分を補正する
+	TEST_ASSERT_INT64_WITHIN(3, t + PING_INTERVAL_US, estimator->to_parent(worker_time(t + PING_INTERVAL_US)));
+}
+
+void test_worker_clock_wraps() {
+	// Workerの時刻が32bitを1周しても、直近の差で戻す
+	worker_offset = 0xffffffffu - 1000000u;
+	int64_t t	  = 1000000;
+	for (int i = 0; i < ClockSync::window; i++, t += PING_INTERVAL_US) ping(t);
+	TEST_ASSERT_INT64_WITHIN(2, t, estimator->to_parent(worker_time(t)));
+}
+
+void test_slow_round_trips_are_ignored() {
+	// 帰りだけ遅れた往復は、行きと帰りの差の半分だけずれる
+	int64_t t = 1000000;
+	for (int i = 0; i < ClockSync::window; i++, t += PING_INTERVAL_US) {
+		if (i % 2) {
+			ping(t);
+		} else {
+			uint32_t received = worker_time(t + 100);
+			estimator->add(t, received, received + 50, t + 100 + 50 + 3000);
+		}
+	}
+	TEST_ASSERT_INT64_WITHIN(2, t, estimator->to_parent(worker_time(t)));
+}
+
+void test_single_outlier_is_dropped() {
+	int64_t t = 1000000;
+	for (int i = 0; i < ClockSync::window; i++, t += PING_INTERVAL_US) ping(t);
+	ping(t, 100, 50, ClockSync::reset_threshold * 2);
+	t += PING_INTERVAL_US;
+	TEST_ASSERT_TRUE(estimator->is_valid());
+	TEST_ASSERT_INT64_WITHIN(2, t, estimator->to_parent(worker_time(t)));
+}
+
+void test_clock_change_resets() {
+	// Workerが再起動した場合、外れたずれが続けば推定をやり直す
+	int64_t t = 1000000;
+	for (int i = 0; i < ClockSync::window; i++, t += PING_INTERVAL_US) ping(t);
+	worker_offset += 12345678;
+	for (int i = 0; i < 3; i++, t += PING_INTERVAL_US) ping(t);
+	TEST_ASSERT_FALSE(estimator->is_valid());
+
+	for (int i = 0; i < ClockSync::min_samples; i++, t += PING_INTERVAL_US) ping(t);
+	TEST_ASSERT_TRUE(estimator->is_valid());
+	TEST_ASSERT_INT64_WITHIN(2, t, estimator->to_parent(worker_time(t)));
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_valid_after_min_samples);
+	RUN_TEST(test_offset_is_removed);
+	RUN_TEST(test_drift_is_estimated);
+	RUN_TEST(test_worker_clock_wraps);
+	RUN_TEST(test_slow_round_trips_are_ignored);
+	RUN_TEST(test_single_outlier_is_dropped);
+	RUN_TEST(test_clock_change_resets);
+	return UNITY_END();
+}
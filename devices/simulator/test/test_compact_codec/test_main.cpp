@@ -0,0 +1,121 @@
+// CompactEncoderで組み立てたデータグラムをCompactDecoderで復元し、量子化の範囲で一致するか確かめる
+
+#include <CompactCodec.h>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+static uint8_t buffer[1460];
+static compact_header_t header;
+static compact_pose_t poses[COMPACT_MAX_JOINTS];
+static CompactEncoder* encoder;
+
+static float difference(Quaternion a, Quaternion b) {
+	float dot = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+	return 2.0f * acosf(fminf(dot, 1.0f));
+}
+
+// wを0から離した姿勢、wはx, y, zから求め直すので0付近では誤差が大きい
+static Quaternion rotation(int k) {
+	Quaternion q = Quaternion::xyzw(sinf(0.3f * k), -0.4f, cosf(0.2f * k), 0.9f - 0.1f * k);
+	q.normalize();
+	return q;
+}
+
+void setUp() { encoder = new CompactEncoder(); }
+
+void tearDown() { delete encoder; }
+
+void test_round_trip() {
+	encoder->begin(buffer, sizeof(buffer), 513, 0x89abcdef);
+	for (int k = 0; k < 6; k++) {
+		uint8_t flags = k % 2 ? COMPACT_FLAG_POSITION : COMPACT_FLAG_FIXED;
+		TEST_ASSERT_TRUE(encoder->add(k + 1, flags, 1000 * k, rotation(k), Vector3<float>::xyz(0.1f * k, -1.25f, 2.0f)));
+	}
+	TEST_ASSERT_EQUAL(6, encoder->get_count());
+	size_t length = encoder->end();
+	// 位置付き3関節と、位置無し3関節
+	TEST_ASSERT_EQUAL(CompactEncoder::header_length + 3 * 16 + 3 * 10, length);
+
+	TEST_ASSERT_TRUE(CompactDecoder::decode(buffer, length, &header, poses));
+	TEST_ASSERT_EQUAL(COMPACT_MAGIC, header.magic);
+	TEST_ASSERT_EQUAL(COMPACT_VERSION, header.version);
+	TEST_ASSERT_EQUAL(6, header.count);
+	TEST_ASSERT_EQUAL(513, header.sequence);
+	TEST_ASSERT_EQUAL(0x89abcdef, header.timestamp);
+
+	for (int k = 0; k < 6; k++) {
+		compact_pose_t* p = poses + k;
+		TEST_ASSERT_EQUAL(k + 1, p->index);
+		TEST_ASSERT_EQUAL(k % 2 ? COMPACT_FLAG_POSITION : COMPACT_FLAG_FIXED, p->flags);
+		// 遅れはBATCH_AGE_UNIT_US単位に切り捨てる
+		TEST_ASSERT_LESS_OR_EQUAL(1000 * k, p->age);
+		TEST_ASSERT_GREATER_THAN(1000 * k - BATCH_AGE_UNIT_US, (int)p->age);
+		TEST_ASSERT_LESS_THAN(0.002f, difference(rotation(k), p->rotation));
+		if (k % 2) {
+			TEST_ASSERT_FLOAT_WITHIN(0.0005f, 0.1f * k, p->position.x);
+			TEST_ASSERT_FLOAT_WITHIN(0.0005f, -1.25f, p->position.y);
+			TEST_ASSERT_FLOAT_WITHIN(0.0005f, 2.0f, p->position.z);
+		} else {
+			TEST_ASSERT_EQUAL_FLOAT(0.0f, p->position.x);
+		}
+	}
+}
+
+void test_position_and_age_saturate() {
+	encoder->begin(buffer, sizeof(buffer), 0, 0);
+	encoder->add(1, COMPACT_FLAG_POSITION, 0xffffffff, Quaternion::identify(), Vector3<float>::xyz(100.0f, -100.0f, 0.0f));
+	size_t length = encoder->end();
+
+	TEST_ASSERT_TRUE(CompactDecoder::decode(buffer, length, &header, poses));
+	TEST_ASSERT_EQUAL(0xffff * BATCH_AGE_UNIT_US, poses[0].age);
+	TEST_ASSERT_FLOAT_WITHIN(0.001f, 32.767f, poses[0].position.x);
+	TEST_ASSERT_FLOAT_WITHIN(0.001f, -32.768f, poses[0].position.y);
+}
+
+void test_full_buffer() {
+	// 収まらない関節は追加せず、それまでの分は復元できる
+	const size_t capacity = CompactEncoder::header_length + 2 * 16 + 8;
+	encoder->begin(buffer, capacity, 0, 0);
+	TEST_ASSERT_TRUE(encoder->add(1, COMPACT_FLAG_POSITION, 0, Quaternion::identify(), Vector3<float>::xyz(0.0f, 0.0f, 0.0f)));
+	TEST_ASSERT_TRUE(encoder->add(2, COMPACT_FLAG_POSITION, 0, Quaternion::identify(), Vector3<float>::xyz(0.0f, 0.0f, 0.0f)));
+	TEST_ASSERT_FALSE(encoder->add(3, COMPACT_FLAG_POSITION, 0, Quaternion::identify(), Vector3<float>::xyz(0.0f, 0.0f, 0.0f)));
+	size_t length = encoder->end();
+	TEST_ASSERT_LESS_OR_EQUAL(capacity, length);
+	TEST_ASSERT_TRUE(CompactDecoder::decode(buffer, length, &header, poses));
+	TEST_ASSERT_EQUAL(2, header.count);
+}
+
+void test_invalid_datagrams_are_rejected() {
+	encoder->begin(buffer, sizeof(buffer), 0, 0);
+	encoder->add(1, COMPACT_FLAG_POSITION, 0, Quaternion::identify(), Vector3<float>::xyz(0.0f, 0.0f, 0.0f));
+	size_t length = encoder->end();
+
+	// 途中で切れている、余分なバイトがある
+	TEST_ASSERT_FALSE(CompactDecoder::decode(buffer, length - 1, &header, poses));
+	TEST_ASSERT_FALSE(CompactDecoder::decode(buffer, length + 1, &header, poses));
+	TEST_ASSERT_FALSE(CompactDecoder::decode(buffer, CompactEncoder::header_length - 1, &header, poses));
+
+	buffer[0] ^= 0xff;
+	TEST_ASSERT_FALSE(CompactDecoder::decode(buffer, length, &header, poses));
+	buffer[0] ^= 0xff;
+	buffer[offsetof(compact_header_t, version)] = COMPACT_VERSION + 1;
+	TEST_ASSERT_FALSE(CompactDecoder::decode(buffer, length, &header, poses));
+}
+
+void test_reset_starts_next_datagram() {
+	encoder->begin(buffer, sizeof(buffer), 0, 0);
+	encoder->add(1, 0, 0, Quaternion::identify(), Vector3<float>::xyz(0.0f, 0.0f, 0.0f));
+	encoder->reset();
+	TEST_ASSERT_EQUAL(0, encoder->get_count());
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_round_trip);
+	RUN_TEST(test_position_and_age_saturate);
+	RUN_TEST(test_full_buffer);
+	RUN_TEST(test_invalid_datagrams_are_rejected);
+	RUN_TEST(test_reset_starts_next_datagram);
+	return UNITY_END();
+}
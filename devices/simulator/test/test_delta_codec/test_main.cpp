@@ -0,0 +1,154 @@
+// DeltaEncoderで作ったCOMMAND_GET_DELTAの応答をDeltaDecoder・WorkerLinkで復元し、キーフレームの受け渡しを確かめる
+
+#include <DeltaCodec.h>
+#include <WorkerLink.h>
+#include <math.h>
+#include <unity.h>
+
+using namespace ESPIDF;
+
+#define ADDRESS 0x10
+
+static DeltaEncoder* encoder;
+static DeltaDecoder* decoder;
+static data_delta_u frame;
+static uint32_t timestamps[DELTA_SAMPLES];
+static Quaternion samples[DELTA_SAMPLES];
+
+static Quaternion rotate_z(float angle) { return Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f)); }
+
+static float difference(Quaternion a, Quaternion b) {
+	float dot = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+	return 2.0f * acosf(fminf(dot, 1.0f));
+}
+
+/// 1.5msおきに0.01radずつ回したk番目のサンプル
+static void push(int k) { encoder->push(1000000 + 1500 * k, rotate_z(0.2f + 0.01f * k)); }
+
+static void on_complete(i2c_request_t* request) {}
+
+void setUp() {
+	encoder = new DeltaEncoder();
+	decoder = new DeltaDecoder();
+}
+
+void tearDown() {
+	delete encoder;
+	delete decoder;
+}
+
+void test_keyed_round_trip() {
+	for (int k = 0; k < 4; k++) push(k);
+	encoder->fill(&frame, 0);
+	TEST_ASSERT_TRUE(data_verify(&frame));
+	TEST_ASSERT_TRUE(frame.flags & DATA_FLAG_KEYFRAME);
+	TEST_ASSERT_EQUAL(4, frame.sequence);
+
+	uint8_t n;
+	TEST_ASSERT_TRUE(decoder->decode(&frame, timestamps, samples, &n));
+	TEST_ASSERT_EQUAL(frame.keyframe, decoder->get_keyframe());
+	// 新しい順に並ぶ、時刻はDELTA_AGE_UNIT_US単位に切り捨てる
+	TEST_ASSERT_EQUAL(4, n);
+	for (int i = 0; i < n; i++) {
+		int k = 3 - i;
+		TEST_ASSERT_UINT32_WITHIN(DELTA_AGE_UNIT_US, 1000000 + 1500 * k, timestamps[i]);
+		TEST_ASSERT_LESS_THAN(0.002f, difference(rotate_z(0.2f + 0.01f * k), samples[i]));
+	}
+}
+
+void test_acknowledged_keyframe_is_not_resent() {
+	uint8_t n;
+	for (int k = 0; k < DELTA_SAMPLES; k++) push(k);
+	encoder->fill(&frame, 0);
+	decoder->decode(&frame, timestamps, samples, &n);
+	TEST_ASSERT_EQUAL(DELTA_KEYED_SAMPLES, n);
+
+	// 受け取り済みなら差分だけで全サンプル分を載せる
+	encoder->acknowledge(decoder->get_keyframe());
+	push(DELTA_SAMPLES);
+	encoder->fill(&frame, 0);
+	TEST_ASSERT_FALSE(frame.flags & DATA_FLAG_KEYFRAME);
+	TEST_ASSERT_TRUE(decoder->decode(&frame, timestamps, samples, &n));
+	TEST_ASSERT_EQUAL(DELTA_SAMPLES, n);
+	TEST_ASSERT_LESS_THAN(0.002f, difference(rotate_z(0.2f + 0.01f * DELTA_SAMPLES), samples[0]));
+}
+
+void test_unknown_keyframe_is_rejected() {
+	// Parentが再起動して、Workerに通知したキーフレームを失った
+	uint8_t n;
+	push(0);
+	encoder->fill(&frame, 0);
+	encoder->acknowledge(frame.keyframe);
+	push(1);
+	encoder->fill(&frame, 0);
+	TEST_ASSERT_FALSE(frame.flags & DATA_FLAG_KEYFRAME);
+	TEST_ASSERT_FALSE(decoder->decode(&frame, timestamps, samples, &n));
+	TEST_ASSERT_EQUAL(0, n);
+	TEST_ASSERT_EQUAL(DELTA_NO_KEYFRAME, decoder->get_keyframe());
+}
+
+void test_large_rotation_starts_keyframe() {
+	uint8_t n;
+	push(0);
+	encoder->fill(&frame, 0);
+	decoder->decode(&frame, timestamps, samples, &n);
+	uint8_t first = decoder->get_keyframe();
+	encoder->acknowledge(first);
+
+	// 差分がint8に収まらない、キーフレームより前のサンプルは載せない
+	encoder->push(1001500, rotate_z(1.5f));
+	encoder->fill(&frame, 0);
+	TEST_ASSERT_TRUE(frame.flags & DATA_FLAG_KEYFRAME);
+	TEST_ASSERT_NOT_EQUAL(first, frame.keyframe);
+	TEST_ASSERT_TRUE(decoder->decode(&frame, timestamps, samples, &n));
+	TEST_ASSERT_EQUAL(1, n);
+	TEST_ASSERT_LESS_THAN(0.002f, difference(rotate_z(1.5f), samples[0]));
+}
+
+void test_reset_requests_keyframe() {
+	uint8_t n;
+	push(0);
+	encoder->fill(&frame, 0);
+	decoder->decode(&frame, timestamps, samples, &n);
+	decoder->reset();
+	TEST_ASSERT_EQUAL(DELTA_NO_KEYFRAME, decoder->get_keyframe());
+
+	// 通知したキーフレームと異なるので、Workerは再び載せる
+	encoder->acknowledge(decoder->get_keyframe());
+	encoder->fill(&frame, 0);
+	TEST_ASSERT_TRUE(frame.flags & DATA_FLAG_KEYFRAME);
+}
+
+void test_worker_link_acknowledges_keyframe() {
+	WorkerLink worker;
+	size_t count;
+	worker.begin(ADDRESS, on_complete, nullptr, COMMAND_GET_DELTA, false);
+	TEST_ASSERT_EQUAL(DELTA_NO_KEYFRAME, worker.get_request()->command[1]);
+
+	for (int k = 0; k < 3; k++) push(k);
+	encoder->fill((data_delta_u*)worker.get_request()->buffer, 0);
+	TEST_ASSERT_EQUAL(ESP_OK, worker.decode(&count));
+	TEST_ASSERT_EQUAL(1, count);
+	// 受け取ったキーフレームを次の要求で通知する
+	uint8_t keyframe = worker.get_request()->command[1];
+	TEST_ASSERT_NOT_EQUAL(DELTA_NO_KEYFRAME, keyframe);
+
+	encoder->acknowledge(keyframe);
+	for (int k = 3; k < 6; k++) push(k);
+	encoder->fill((data_delta_u*)worker.get_request()->buffer, 0);
+	TEST_ASSERT_EQUAL(ESP_OK, worker.decode(&count));
+	TEST_ASSERT_EQUAL(3, count);
+	TEST_ASSERT_EQUAL(0, worker.get_lost());
+	for (int i = 0; i < 3; i++) TEST_ASSERT_LESS_THAN(0.002f, difference(rotate_z(0.2f + 0.01f * (3 + i)), worker.get_samples()[i].q));
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_keyed_round_trip);
+	RUN_TEST(test_acknowledged_keyframe_is_not_resent);
+	RUN_TEST(test_unknown_keyframe_is_rejected);
+	RUN_TEST(test_large_rotation_starts_keyframe);
+	RUN_TEST(test_reset_requests_keyframe);
+	RUN_TEST(test_worker_link_acknowledges_keyframe);
+	return UNITY_END();
+}
@@ -0,0 +1,245 @@
+// 仮想I2Cバス上でI2CMaster / I2CQueueを動かし、I2CStatisticsの集計を確かめる
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <i2c.h>
+#include <i2cqueue.h>
+#include <rom/ets_sys.h>
+#include <unity.h>
+
+#include "VirtualBus.h"
+
+using namespace ESPIDF;
+
+#define TEST_SCL 80
+#define TEST_SDA 81
+#define ADDRESS_ECHO 0x30
+#define ADDRESS_SLOW 0x31
+#define ADDRESS_BLOCK 0x32
+#define ADDRESS_MISSING 0x33
+
+/// 書き込まれた値を覚えて、読み出しでは連番を返す
+class EchoDevice : public VirtualDevice {
+    public:
+	uint8_t last;
+	uint32_t delay_us;
+
+	void write(const uint8_t* data, size_t length) {
+		if (length > 0) last = data[length - 1];
+	}
+
+	void read(uint8_t* data, size_t length) {
+		if (delay_us) ets_delay_us(delay_us);
+		for (int i = 0; i < length; i++) data[i] = last + i;
+	}
+};
+
+/// releaseされるまで書き込みでバスを掴んだままにする
+class BlockingDevice : public VirtualDevice {
+    public:
+	volatile bool holding;
+	volatile bool release;
+
+	void write(const uint8_t* data, size_t length) {
+		holding = true;
+		while (!release) vTaskDelay(1);
+		holding = false;
+	}
+	void read(uint8_t* data, size_t length) {}
+};
+
+static EchoDevice echo;
+static EchoDevice slow;
+static BlockingDevice blocking;
+static I2CStatistics statistics;
+static I2CMaster* master;
+static I2CMaster* other;  // 同じバスに繋がる別ポート
+static I2CQueue* queue;
+static QueueHandle_t done;
+
+static void on_done(i2c_request_t* request) { xQueueSend(done, &request, 0); }
+
+void setUp() {
+	statistics.reset();
+	echo.delay_us	    = 0;
+	slow.delay_us	    = 3000;
+	blocking.release = false;
+}
+
+void tearDown() {}
+
+static void test_success_is_counted() {
+	uint8_t command = 0x10;
+	uint8_t buffer[4];
+	TEST_ASSERT_EQUAL(ESP_OK, master->send_bytes(ADDRESS_ECHO, &command, 1));
+	TEST_ASSERT_EQUAL(ESP_OK, master->receive_bytes(ADDRESS_ECHO, buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL_UINT8(0x10, buffer[0]);
+	TEST_ASSERT_EQUAL_UINT8(0x13, buffer[3]);
+
+	const i2c_device_stat_t* s = statistics.find(ADDRESS_ECHO);
+	TEST_ASSERT_NOT_NULL(s);
+	TEST_ASSERT_EQUAL_UINT32(2, s->transactions);
+	TEST_ASSERT_EQUAL_UINT32(0, s->nacks + s->timeouts + s->errors + s->retries);
+}
+
+static void test_missing_device_is_nack() {
+	uint8_t buffer[4];
+	TEST_ASSERT_EQUAL(ESP_FAIL, master->receive_bytes(ADDRESS_MISSING, buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL(ESP_FAIL, master->get_last_error());
+
+	const i2c_device_stat_t* s = statistics.find(ADDRESS_MISSING);
+	TEST_ASSERT_NOT_NULL(s);
+	TEST_ASSERT_EQUAL_UINT32(1, s->transactions);
+	TEST_ASSERT_EQUAL_UINT32(1, s->nacks);
+	TEST_ASSERT_EQUAL_UINT32(0, s->timeouts);
+}
+
+static void hold_bus(void* arg) {
+	uint8_t command = 0;
+	other->send_bytes(ADDRESS_BLOCK, &command, 1);
+	vTaskDelete(nullptr);
+}
+
+static void test_busy_bus_is_timeout() {
+	xTaskCreate(hold_bus, "hold", 2048, nullptr, 1, nullptr);
+	while (!blocking.holding) vTaskDelay(1);
+
+	uint8_t buffer[2];
+	TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, master->receive_bytes(ADDRESS_ECHO, buffer, sizeof(buffer), 2));
+	blocking.release = true;
+	while (blocking.holding) vTaskDelay(1);
+
+	const i2c_device_stat_t* s = statistics.find(ADDRESS_ECHO);
+	TEST_ASSERT_EQUAL_UINT32(1, s->transactions);
+	TEST_ASSERT_EQUAL_UINT32(1, s->timeouts);
+	TEST_ASSERT_EQUAL_UINT32(0, s->nacks);
+	// 待った時間もレイテンシに含まれる
+	TEST_ASSERT_GREATER_OR_EQUAL(1000, s->latency_max);
+}
+
+static void test_queue_retries_until_exhausted() {
+	uint8_t command = 0x20;
+	uint8_t buffer[4];
+	i2c_request_t request = {};
+	request.address	  = ADDRESS_MISSING;
+	request.command	  = &command;
+	request.command_length = 1;
+	request.buffer	  = buffer;
+	request.length	  = sizeof(buffer);
+	request.retries	  = 2;
+	request.callback	  = on_done;
+
+	TEST_ASSERT_TRUE(queue->submit(&request, 100));
+	i2c_request_t* completed;
+	TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(done, &completed, 1000));
+	TEST_ASSERT_TRUE(completed == &request);
+	TEST_ASSERT_EQUAL(ESP_FAIL, request.result);
+
+	// 書き込みでNACKになるので読み出しは行われない、最初の1回 + 再試行2回
+	const i2c_device_stat_t* s = statistics.find(ADDRESS_MISSING);
+	TEST_ASSERT_EQUAL_UINT32(3, s->transactions);
+	TEST_ASSERT_EQUAL_UINT32(3, s->nacks);
+	TEST_ASSERT_EQUAL_UINT32(2, s->retries);
+}
+
+static void test_queue_retry_recovers() {
+	uint8_t command = 0x40;
+	uint8_t buffer[2];
+	i2c_request_t request = {};
+	request.address	  = ADDRESS_ECHO;
+	request.command	  = &command;
+	request.command_length = 1;
+	request.buffer	  = buffer;
+	request.length	  = sizeof(buffer);
+	request.retries	  = 2;
+	request.callback	  = on_done;
+
+	TEST_ASSERT_TRUE(queue->submit(&request, 100));
+	i2c_request_t* completed;
+	TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(done, &completed, 1000));
+	TEST_ASSERT_EQUAL(ESP_OK, request.result);
+	TEST_ASSERT_EQUAL_UINT8(0x41, buffer[1]);
+
+	// 成功した要求は再試行しない
+	const i2c_device_stat_t* s = statistics.find(ADDRESS_ECHO);
+	TEST_ASSERT_EQUAL_UINT32(2, s->transactions);
+	TEST_ASSERT_EQUAL_UINT32(0, s->retries);
+}
+
+static void test_expired_request_is_not_sent() {
+	uint8_t buffer[2];
+	i2c_request_t request = {};
+	request.address	  = ADDRESS_ECHO;
+	request.buffer	  = buffer;
+	request.length	  = sizeof(buffer);
+	request.retries	  = 2;
+	request.callback	  = on_done;
+
+	TEST_ASSERT_TRUE(queue->submit(&request, 0));
+	i2c_request_t* completed;
+	TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(done, &completed, 1000));
+	TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, request.result);
+	TEST_ASSERT_NULL(statistics.find(ADDRESS_ECHO));
+}
+
+static void test_histogram_buckets() {
+	TEST_ASSERT_EQUAL(0, I2CStatistics::bucket(0));
+	TEST_ASSERT_EQUAL(0, I2CStatistics::bucket(127));
+	TEST_ASSERT_EQUAL(1, I2CStatistics::bucket(128));
+	TEST_ASSERT_EQUAL(1, I2CStatistics::bucket(255));
+	TEST_ASSERT_EQUAL(2, I2CStatistics::bucket(256));
+	TEST_ASSERT_EQUAL(I2C_LATENCY_BUCKETS - 1, I2CStatistics::bucket(0xffffffff));
+
+	uint8_t buffer[2];
+	for (int i = 0; i < 3; i++) TEST_ASSERT_EQUAL(ESP_OK, master->receive_bytes(ADDRESS_SLOW, buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL(ESP_OK, master->receive_bytes(ADDRESS_ECHO, buffer, sizeof(buffer)));
+
+	// 3ms待つデバイスは 2048us以上4096us未満 のバケットに入る
+	const i2c_device_stat_t* s = statistics.find(ADDRESS_SLOW);
+	TEST_ASSERT_EQUAL_UINT32(3, s->transactions);
+	TEST_ASSERT_GREATER_OR_EQUAL(3000, s->latency_max);
+	TEST_ASSERT_GREATER_OR_EQUAL(3 * 3000, (uint32_t)s->latency_sum);
+	uint32_t total = 0;
+	for (int b = 0; b < I2C_LATENCY_BUCKETS; b++) total += s->histogram[b];
+	TEST_ASSERT_EQUAL_UINT32(3, total);
+	TEST_ASSERT_GREATER_OR_EQUAL(2, s->histogram[I2CStatistics::bucket(3000)]);
+
+	// 4byteの読み出しは400kHzで100us程度
+	s = statistics.find(ADDRESS_ECHO);
+	TEST_ASSERT_EQUAL_UINT32(1, s->histogram[0] + s->histogram[1]);
+}
+
+static void test_format() {
+	uint8_t buffer[2];
+	master->receive_bytes(ADDRESS_MISSING, buffer, sizeof(buffer));
+
+	char text[128];
+	size_t n = statistics.format(text, sizeof(text));
+	TEST_ASSERT_EQUAL(strlen(text), n);
+	TEST_ASSERT_TRUE(strstr(text, " 51: n=1 nack=1 to=0 err=0 retry=0") == text);
+}
+
+int main(int argc, char** argv) {
+	virtual_bus_attach(TEST_SCL, ADDRESS_ECHO, &echo);
+	virtual_bus_attach(TEST_SCL, ADDRESS_SLOW, &slow);
+	virtual_bus_attach(TEST_SCL, ADDRESS_BLOCK, &blocking);
+
+	master = new I2CMaster(0, TEST_SCL, TEST_SDA, 400000);
+	other  = new I2CMaster(1, TEST_SCL, TEST_SDA, 400000);
+	master->set_statistics(&statistics);
+	queue = new I2CQueue(master, 4);
+	done	 = xQueueCreate(4, sizeof(i2c_request_t*));
+
+	UNITY_BEGIN();
+	RUN_TEST(test_success_is_counted);
+	RUN_TEST(test_missing_device_is_nack);
+	RUN_TEST(test_busy_bus_is_timeout);
+	RUN_TEST(test_queue_retries_until_exhausted);
+	RUN_TEST(test_queue_retry_recovers);
+	RUN_TEST(test_expired_request_is_not_sent);
+	RUN_TEST(test_histogram_buckets);
+	RUN_TEST(test_format);
+	return UNITY_END();
+}
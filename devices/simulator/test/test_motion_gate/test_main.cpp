@@ -0,0 +1,119 @@
+// MotionGateの静止の判定と、静止中の短い応答をWorkerLinkが1サンプルとして受け取るか確かめる
+
+#include <MotionGate.h>
+#include <WorkerLink.h>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+using namespace ESPIDF;
+
+#define ADDRESS 0x10
+#define DEGREE (3.1415926535897932384626433832795f / 180.0f)
+
+static MotionGate* gate;
+
+static Quaternion rotate_z(float angle) { return Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f)); }
+
+/// 初期の基準（単位クォータニオン）から離れた姿勢、最初のサンプルで基準が決まる
+static Quaternion pose(float degrees) { return rotate_z(30.0f * DEGREE + degrees * DEGREE); }
+
+static void on_complete(i2c_request_t* request) {}
+
+void setUp() {
+	gate = new MotionGate();
+	gate->set_threshold(10);
+}
+
+void tearDown() { delete gate; }
+
+void test_disabled_is_never_idle() {
+	gate->set_threshold(0);
+	for (uint16_t s = 1; s <= MotionGate::settle * 2; s++) TEST_ASSERT_FALSE(gate->update(s, Quaternion::identify()));
+}
+
+void test_settles_after_still_samples() {
+	// 0.5度の揺れは1度のしきい値未満
+	uint16_t s = 1;
+	gate->update(s, pose(0.0f));
+	for (s++; s <= MotionGate::settle; s++) TEST_ASSERT_FALSE(gate->update(s, pose(s % 2 ? 0.5f : 0.0f)));
+	TEST_ASSERT_TRUE(gate->update(s, pose(0.0f)));
+}
+
+void test_motion_resets_anchor() {
+	uint16_t s = 1;
+	for (; s <= MotionGate::settle + 1; s++) gate->update(s, pose(0.0f));
+	TEST_ASSERT_TRUE(gate->update(s++, pose(0.0f)));
+	TEST_ASSERT_FALSE(gate->update(s++, pose(2.0f)));
+	// 新しい姿勢からsettle回数え直す
+	TEST_ASSERT_FALSE(gate->update(s++, pose(2.0f)));
+}
+
+void test_slow_drift_is_motion() {
+	// 1回毎はしきい値未満でも、基準からの変化が積み重なれば動いたとみなす
+	uint16_t s = 1;
+	for (; s <= MotionGate::settle + 1; s++) gate->update(s, pose(0.0f));
+	TEST_ASSERT_TRUE(gate->update(s++, pose(0.4f)));
+	TEST_ASSERT_TRUE(gate->update(s++, pose(0.8f)));
+	TEST_ASSERT_FALSE(gate->update(s++, pose(1.2f)));
+}
+
+void test_fill_status() {
+	uint16_t s = 1;
+	for (; s <= MotionGate::settle + 1; s++) gate->update(s, pose(0.0f));
+	data_status_u status;
+	gate->fill(&status, DATA_FLAG_CALIBRATING, s, 123456, pose(0.0f));
+	TEST_ASSERT_TRUE(data_verify(&status));
+	TEST_ASSERT_EQUAL(DATA_FLAG_UNCHANGED | DATA_FLAG_CALIBRATING, status.flags);
+	TEST_ASSERT_EQUAL(s, status.sequence);
+	TEST_ASSERT_EQUAL(1, status.since);
+	TEST_ASSERT_EQUAL(123456, status.timestamp);
+}
+
+void test_worker_link_reads_status() {
+	WorkerLink worker;
+	size_t count;
+	worker.set_adaptive(10);
+	worker.begin(ADDRESS, on_complete, nullptr, COMMAND_GET_QUATERNION_V2, true);
+
+	// 最初の応答でstagedを要求し、次から読み出すだけになる
+	data_v2_u* v2 = (data_v2_u*)worker.get_request()->buffer;
+	memset(v2, 0, sizeof(data_v2_u));
+	v2->sequence = 1;
+	v2->ahrs	 = Quaternion::identify();
+	data_seal(v2);
+	TEST_ASSERT_EQUAL(ESP_OK, worker.decode(&count));
+	TEST_ASSERT_EQUAL(COMMAND_SET_ADAPTIVE, worker.get_request()->command[2]);
+	worker.decode(&count);
+	TEST_ASSERT_TRUE(worker.is_staged());
+
+	// 静止中は連番が飛んでも最新の1サンプルだけで、失ったとみなさない
+	data_status_u* status = (data_status_u*)worker.get_request()->buffer;
+	gate->fill(status, 0, 40, 40000, rotate_z(0.1f));
+	TEST_ASSERT_EQUAL(ESP_OK, worker.decode(&count));
+	TEST_ASSERT_EQUAL(1, count);
+	TEST_ASSERT_TRUE(worker.is_unchanged());
+	TEST_ASSERT_EQUAL(sizeof(data_status_u), worker.get_request()->length);
+	TEST_ASSERT_EQUAL(40000, worker.get_samples()[0].time);
+	TEST_ASSERT_EQUAL(0, worker.get_lost());
+
+	// 動き出した、先頭だけ読んだ応答は捨てて次から全体を読み出す
+	memset(v2, 0, sizeof(data_v2_u));
+	v2->sequence = 41;
+	data_seal(v2);
+	TEST_ASSERT_EQUAL(ESP_OK, worker.decode(&count));
+	TEST_ASSERT_EQUAL(0, count);
+	TEST_ASSERT_FALSE(worker.is_unchanged());
+	TEST_ASSERT_EQUAL(sizeof(data_v2_u), worker.get_request()->length);
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_disabled_is_never_idle);
+	RUN_TEST(test_settles_after_still_samples);
+	RUN_TEST(test_motion_resets_anchor);
+	RUN_TEST(test_slow_drift_is_motion);
+	RUN_TEST(test_fill_status);
+	RUN_TEST(test_worker_link_reads_status);
+	return UNITY_END();
+}
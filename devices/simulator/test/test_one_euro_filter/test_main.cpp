@@ -0,0 +1,146 @@
+// OneEuroFilterが静止中の揺れを抑え、速い回転には遅れずに追従するか確かめる
+
+#include <OneEuroFilter.h>
+#include <math.h>
+#include <unity.h>
+
+#define SAMPLE_INTERVAL_US 10000
+
+static OneEuroFilter* smoothing;
+
+/// z軸回りにangle [rad] 回転した姿勢
+static Quaternion rotate_z(float angle) { return Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f)); }
+
+/// 2つの姿勢の間の角度 [rad]
+static float difference(Quaternion a, Quaternion b) {
+	float dot = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+	return 2.0f * acosf(fminf(dot, 1.0f));
+}
+
+void setUp() { smoothing = new OneEuroFilter(); }
+
+void tearDown() { delete smoothing; }
+
+void test_disabled_passes_through() {
+	Quaternion q = rotate_z(0.3f);
+	for (uint32_t t = 0; t < 10; t++) {
+		Quaternion out = smoothing->filter(t * SAMPLE_INTERVAL_US, q);
+		TEST_ASSERT_EQUAL_FLOAT(q.z, out.z);
+		TEST_ASSERT_EQUAL_FLOAT(q.w, out.w);
+	}
+}
+
+void test_parameters_are_clamped() {
+	smoothing->set_parameters(-1.0f, -0.5f);
+	TEST_ASSERT_EQUAL_FLOAT(0.0f, smoothing->get_min_cutoff());
+	TEST_ASSERT_EQUAL_FLOAT(0.0f, smoothing->get_beta());
+}
+
+void test_first_sample_passes_through() {
+	smoothing->set_parameters(1.0f, 0.0f);
+	Quaternion q   = rotate_z(1.0f);
+	Quaternion out = smoothing->filter(1000, q);
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, difference(q, out));
+}
+
+void test_jitter_is_reduced() {
+	// 静止中に±0.5度で揺れる入力
+	smoothing->set_parameters(1.0f, 0.0f);
+	const float jitter = 0.5f * 3.14159265f / 180.0f;
+	float input_max = 0.0f, output_max = 0.0f;
+	for (int i = 0; i < 200; i++) {
+		Quaternion q   = rotate_z(i % 2 ? jitter : -jitter);
+		Quaternion out = smoothing->filter(i * SAMPLE_INTERVAL_US, q);
+		if (i < 100) continue;
+		input_max  = fmaxf(input_max, difference(q, Quaternion::identify()));
+		output_max = fmaxf(output_max, difference(out, Quaternion::identify()));
+	}
+	TEST_ASSERT_LESS_THAN(input_max * 0.2f, output_max);
+}
+
+void test_beta_reduces_lag() {
+	// 3 rad/sで回転し続ける入力に対する遅れを、betaの有無で比べる
+	OneEuroFilter fast;
+	smoothing->set_parameters(1.0f, 0.0f);
+	fast.set_parameters(1.0f, 5.0f);
+	float slow_lag = 0.0f, fast_lag = 0.0f;
+	for (int i = 0; i < 100; i++) {
+		Quaternion q = rotate_z(3.0f * i * SAMPLE_INTERVAL_US * 1e-6f);
+		slow_lag	 = difference(q, smoothing->filter(i * SAMPLE_INTERVAL_US, q));
+		fast_lag	 = difference(q, fast.filter(i * SAMPLE_INTERVAL_US, q));
+	}
+	TEST_ASSERT_LESS_THAN(slow_lag * 0.5f, fast_lag);
+}
+
+void test_sign_flip_is_not_a_rotation() {
+	// qと-qは同じ姿勢、出力が反対側に引かれない
+	smoothing->set_parameters(1.0f, 0.0f);
+	Quaternion q = rotate_z(0.2f);
+	smoothing->filter(0, q);
+	Quaternion out = smoothing->filter(SAMPLE_INTERVAL_US, q * -1.0f);
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.0f, difference(q, out));
+}
+
+void test_gap_restarts() {
+	smoothing->set_parameters(1.0f, 0.0f);
+	smoothing->filter(0, Quaternion::identify());
+	Quaternion q   = rotate_z(1.0f);
+	Quaternion out = smoothing->filter(OneEuroFilter::max_gap_us + 1, q);
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, difference(q, out));
+}
+
+void test_small_rewind_holds() {
+	// 同じか少し前の時刻のサンプルは前回の出力のまま
+	smoothing->set_parameters(1.0f, 0.0f);
+	smoothing->filter(1000000, Quaternion::identify());
+	Quaternion out = smoothing->filter(1000000 - OneEuroFilter::max_rewind_us, rotate_z(1.0f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, difference(Quaternion::identify(), out));
+}
+
+void test_clock_change_restarts() {
+	// Workerの時刻からParentの時刻に変わり大きく戻った場合、出力を止めずにやり直す
+	smoothing->set_parameters(1.0f, 0.0f);
+	smoothing->filter(600000000, Quaternion::identify());
+	Quaternion q   = rotate_z(1.0f);
+	Quaternion out = smoothing->filter(5000000, q);
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, difference(q, out));
+	// 以降は新しい時刻で平滑化する
+	out = smoothing->filter(5000000 + SAMPLE_INTERVAL_US, Quaternion::identify());
+	TEST_ASSERT_GREATER_THAN(0.1f, difference(out, Quaternion::identify()));
+}
+
+void test_reset_restarts() {
+	smoothing->set_parameters(1.0f, 0.0f);
+	smoothing->filter(1000000, Quaternion::identify());
+	smoothing->reset();
+	Quaternion q   = rotate_z(1.0f);
+	Quaternion out = smoothing->filter(1000000 + SAMPLE_INTERVAL_US, q);
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, difference(q, out));
+}
+
+void test_time_wraps() {
+	// Workerの時刻が32bitを1周しても間隔は正しく求める
+	smoothing->set_parameters(1.0f, 0.0f);
+	uint32_t start = 0xffffffffu - SAMPLE_INTERVAL_US / 2;
+	smoothing->filter(start, Quaternion::identify());
+	Quaternion q   = rotate_z(0.1f);
+	Quaternion out = smoothing->filter(start + SAMPLE_INTERVAL_US, q);
+	TEST_ASSERT_GREATER_THAN(0.0f, difference(out, Quaternion::identify()));
+	TEST_ASSERT_LESS_THAN(0.1f, difference(out, Quaternion::identify()));
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_disabled_passes_through);
+	RUN_TEST(test_parameters_are_clamped);
+	RUN_TEST(test_first_sample_passes_through);
+	RUN_TEST(test_jitter_is_reduced);
+	RUN_TEST(test_beta_reduces_lag);
+	RUN_TEST(test_sign_flip_is_not_a_rotation);
+	RUN_TEST(test_gap_restarts);
+	RUN_TEST(test_small_rewind_holds);
+	RUN_TEST(test_clock_change_restarts);
+	RUN_TEST(test_reset_restarts);
+	RUN_TEST(test_time_wraps);
+	return UNITY_END();
+}
@@ -0,0 +1,377 @@
+// OscClientが書き込んだOSCメッセージと#bundleを復元し、送った値と一致するか確かめる
+
+#include <OscSender.h>
+#include <arpa/inet.h>
+#include <math.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unity.h>
+
+#define OSC_MAX_ARGUMENTS 16
+
+/// 復元したメッセージ、引数はタグ文字列の順
+struct osc_message_t {
+	char address[64];
+	char tags[OSC_MAX_ARGUMENTS + 2];
+	int32_t i[OSC_MAX_ARGUMENTS];
+	float f[OSC_MAX_ARGUMENTS];
+	char s[OSC_STRING_CAPACITY];
+};
+
+static uint32_t get_uint32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return ntohl(v);
+}
+
+/// \0で終わり4byte境界まで\0で埋めた文字列を読み、次の位置を返す、不正ならnullptr
+static const uint8_t* get_string(const uint8_t* p, const uint8_t* end, char* text, size_t capacity) {
+	size_t n = strnlen((const char*)p, end - p);
+	if (n >= capacity || p + n >= end) return nullptr;
+	memcpy(text, p, n + 1);
+	size_t padded = (n & ~(size_t)0b11) + 4;
+	if (p + padded > end) return nullptr;
+	for (size_t k = n; k < padded; k++) {
+		if (p[k] != 0) return nullptr;
+	}
+	return p + padded;
+}
+
+/// 1つのメッセージを復元し、長さがちょうどならtrue
+static bool decode_message(const uint8_t* data, size_t length, osc_message_t* m) {
+	const uint8_t* end = data + length;
+	memset(m, 0, sizeof(*m));
+	const uint8_t* p = get_string(data, end, m->address, sizeof(m->address));
+	if (p) p = get_string(p, end, m->tags, sizeof(m->tags));
+	if (!p || m->tags[0] != ',') return false;
+
+	for (int k = 1; m->tags[k]; k++) {
+		switch (m->tags[k]) {
+			case 'i':
+				if (p + 4 > end) return false;
+				m->i[k - 1] = (int32_t)get_uint32(p);
+				p += 4;
+				break;
+			case 'f': {
+				if (p + 4 > end) return false;
+				uint32_t v = get_uint32(p);
+				memcpy(m->f + k - 1, &v, 4);
+				p += 4;
+				break;
+			}
+			case 's':
+				p = get_string(p, end, m->s, sizeof(m->s));
+				if (!p) return false;
+				break;
+			default:
+				return false;
+		}
+	}
+	return p == end;
+}
+
+/// #bundleの要素を順に復元し、要素数を返す、不正なら-1
+static int decode_bundle(const uint8_t* data, size_t length, osc_message_t* messages, int capacity) {
+	static const uint8_t header[16] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1};
+	if (length < sizeof(header) || memcmp(data, header, sizeof(header)) != 0) return -1;
+
+	int count = 0;
+	for (size_t offset = sizeof(header); offset < length; count++) {
+		if (offset + 4 > length || count >= capacity) return -1;
+		uint32_t size = get_uint32(data + offset);
+		offset += 4;
+		if (size % 4 != 0 || offset + size > length) return -1;
+		if (!decode_message(data + offset, size, messages + count)) return -1;
+		offset += size;
+	}
+	return count;
+}
+
+static osc_string_t serial;
+static VMTJointArgument_t joint;
+static OscTelemetryArgument_t telemetry;
+static uint8_t buffer[OscClient::bundle_limit];
+
+static int rx;
+static uint16_t rx_port;
+static const uint8_t host[4] = {127, 0, 0, 1};
+
+static ssize_t receive() {
+	timeval timeout = {1, 0};
+	setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	return recv(rx, buffer, sizeof(buffer), 0);
+}
+
+void setUp() {
+	serial.set("VMT_3");
+	joint = {&serial, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -0.004f, 1, 7};
+	joint.set(Quaternion::xyzw(0.1f, -0.2f, 0.3f, 0.927362f), Vector3<float>::xyz(0.25f, -1.5f, 3.0f));
+	telemetry = {12, 0x02, 650, 1200, 3150, -1};
+
+	// 前のテストの残りを捨てる
+	while (recv(rx, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+}
+
+void tearDown() {}
+
+static void assert_joint(const osc_message_t* m, const char* address, const char* serial_text) {
+	TEST_ASSERT_EQUAL_STRING(address, m->address);
+	TEST_ASSERT_EQUAL_STRING(",iiffffffffs", m->tags);
+	TEST_ASSERT_EQUAL(joint.index, m->i[0]);
+	TEST_ASSERT_EQUAL(joint.enable, m->i[1]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.time, m->f[2]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.x, m->f[3]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.y, m->f[4]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.z, m->f[5]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.qx, m->f[6]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.qy, m->f[7]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.qz, m->f[8]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.qw, m->f[9]);
+	TEST_ASSERT_EQUAL_STRING(serial_text, m->s);
+}
+
+void test_joint_round_trip() {
+	osc_message_t m;
+	size_t length = OscClient::encode(OSC_MESSAGE_JOINT, &joint, buffer);
+	TEST_ASSERT_EQUAL(0, length % 4);
+	TEST_ASSERT_LESS_OR_EQUAL(OscClient::message_limit, length);
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	assert_joint(&m, "/VMT/Joint/Driver", "VMT_3");
+}
+
+void test_follow_round_trip() {
+	osc_message_t m;
+	size_t length = OscClient::encode(OSC_MESSAGE_FOLLOW, &joint, buffer);
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	assert_joint(&m, "/VMT/Follow/Driver", "VMT_3");
+}
+
+void test_serial_padding() {
+	// 4の倍数の長さでも\0を1つ以上付ける、nullptrは空文字列
+	osc_message_t m;
+	const char* texts[] = {"", "VMT", "VMT_", "VMT_12345678", "0123456789012345678901234567890123"};
+	for (size_t k = 0; k < sizeof(texts) / sizeof(texts[0]); k++) {
+		serial.set(texts[k]);
+		size_t length = OscClient::encode(OSC_MESSAGE_FOLLOW, &joint, buffer);
+		TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+		TEST_ASSERT_EQUAL(0, strncmp(texts[k], m.s, OSC_STRING_CAPACITY - 1));
+		TEST_ASSERT_LESS_OR_EQUAL(OSC_STRING_CAPACITY, strlen(m.s) + 1);
+	}
+
+	joint.serial  = nullptr;
+	size_t length = OscClient::encode(OSC_MESSAGE_FOLLOW, &joint, buffer);
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	TEST_ASSERT_EQUAL_STRING("", m.s);
+}
+
+void test_room_round_trip() {
+	osc_message_t m;
+	size_t length = OscClient::encode(OSC_MESSAGE_ROOM, &joint, buffer);
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	TEST_ASSERT_EQUAL_STRING("/VMT/Room/Driver", m.address);
+	TEST_ASSERT_EQUAL_STRING(",iiffffffff", m.tags);
+	TEST_ASSERT_EQUAL(joint.index, m.i[0]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.x, m.f[3]);
+	TEST_ASSERT_EQUAL_FLOAT(joint.qw, m.f[9]);
+}
+
+void test_telemetry_round_trip() {
+	osc_message_t m;
+	size_t length = OscClient::encode(OSC_MESSAGE_TELEMETRY, &telemetry, buffer);
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	TEST_ASSERT_EQUAL_STRING("/JointTracker/Telemetry", m.address);
+	TEST_ASSERT_EQUAL_STRING(",iiiiii", m.tags);
+	TEST_ASSERT_EQUAL(12, m.i[0]);
+	TEST_ASSERT_EQUAL(0x02, m.i[1]);
+	TEST_ASSERT_EQUAL(650, m.i[2]);
+	TEST_ASSERT_EQUAL(1200, m.i[3]);
+	TEST_ASSERT_EQUAL(3150, m.i[4]);
+	TEST_ASSERT_EQUAL(-1, m.i[5]);
+}
+
+void test_single_message_datagram() {
+	// バンドルしなければメッセージ毎に1データグラム
+	OscClient client(host, rx_port);
+	osc_message_t m;
+	TEST_ASSERT_GREATER_THAN(0, client.send_follow(&joint));
+	ssize_t length = receive();
+	TEST_ASSERT_GREATER_THAN(0, length);
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	assert_joint(&m, "/VMT/Follow/Driver", "VMT_3");
+}
+
+void test_default_destination_skips_telemetry() {
+	// VMT（送信先0）には既定でテレメトリを送らない
+	OscClient client(host, rx_port);
+	TEST_ASSERT_EQUAL(0, client.send_telemetry(&telemetry));
+	TEST_ASSERT_GREATER_THAN(0, client.send_room(&joint));
+	osc_message_t m;
+	ssize_t length = receive();
+	TEST_ASSERT_TRUE(decode_message(buffer, length, &m));
+	TEST_ASSERT_EQUAL_STRING("/VMT/Room/Driver", m.address);
+}
+
+void test_bundle_round_trip() {
+	OscClient client(host, rx_port);
+	client.set_destination(0, host, rx_port, OSC_MESSAGE_ALL);
+	client.begin_bundle();
+	for (int k = 0; k < 3; k++) {
+		joint.index = k + 1;
+		client.send_follow(&joint);
+	}
+	client.send_room(&joint);
+	client.send_telemetry(&telemetry);
+	TEST_ASSERT_EQUAL(1, client.end_bundle());
+
+	static osc_message_t messages[8];
+	ssize_t length = receive();
+	TEST_ASSERT_GREATER_THAN(0, length);
+	TEST_ASSERT_EQUAL(5, decode_bundle(buffer, length, messages, 8));
+	for (int k = 0; k < 3; k++) {
+		joint.index = k + 1;
+		assert_joint(messages + k, "/VMT/Follow/Driver", "VMT_3");
+	}
+	TEST_ASSERT_EQUAL_STRING("/VMT/Room/Driver", messages[3].address);
+	TEST_ASSERT_EQUAL_STRING("/JointTracker/Telemetry", messages[4].address);
+}
+
+void test_bundle_is_split_at_limit() {
+	// bundle_limitを超える分は別の#bundleで送る、要素は途中で切れない
+	const int count = 40;
+	OscClient client(host, rx_port);
+	client.begin_bundle();
+	for (int k = 0; k < count; k++) {
+		joint.index = k;
+		client.send_follow(&joint);
+	}
+	size_t datagrams = client.end_bundle();
+	TEST_ASSERT_GREATER_THAN(1, datagrams);
+
+	static osc_message_t messages[count];
+	int received = 0;
+	for (size_t d = 0; d < datagrams; d++) {
+		ssize_t length = receive();
+		TEST_ASSERT_GREATER_THAN(0, length);
+		TEST_ASSERT_LESS_OR_EQUAL(OscClient::bundle_limit, length);
+		int n = decode_bundle(buffer, length, messages + received, count - received);
+		TEST_ASSERT_GREATER_THAN(0, n);
+		received += n;
+	}
+	TEST_ASSERT_EQUAL(count, received);
+	for (int k = 0; k < count; k++) TEST_ASSERT_EQUAL(k, messages[k].i[0]);
+}
+
+void test_frame_holds_all_joints_and_telemetry() {
+	// 固定関節8 + 可動関節8 + テレメトリが1フレームに収まり、収まらない分は数える
+	// 送信タスクは止められないので、OscClientとOscSenderは解放しない
+	OscClient* client = new OscClient(host, rx_port);
+	client->set_destination(0, host, rx_port, OSC_MESSAGE_ALL);
+	OscSender* sender = new OscSender(client);
+	sender->begin(0);
+
+	const int joints = OSC_FRAME_ENTRIES - 1;
+	for (int k = 0; k < joints; k++) {
+		joint.index = k;
+		k < 8 ? sender->add_joint(&joint) : sender->add_follow(&joint);
+	}
+	sender->add_telemetry(&telemetry);
+	joint.index = joints;
+	sender->add_follow(&joint);
+	TEST_ASSERT_TRUE(sender->end_frame());
+	TEST_ASSERT_EQUAL(1, sender->get_dropped());
+
+	static osc_message_t messages[OSC_FRAME_ENTRIES];
+	int received = 0;
+	while (received < OSC_FRAME_ENTRIES) {
+		ssize_t length = receive();
+		TEST_ASSERT_GREATER_THAN(0, length);
+		received += decode_bundle(buffer, length, messages + received, OSC_FRAME_ENTRIES - received);
+	}
+	TEST_ASSERT_EQUAL_STRING("/JointTracker/Telemetry", messages[joints].address);
+	TEST_ASSERT_EQUAL(0, sender->get_coalesced());
+}
+
+void test_extrapolation_keeps_parent_position() {
+	// 固定レートでは、親の位置はそのままで、子のボーンだけを角速度で回す
+	OscClient* client = new OscClient(host, rx_port);
+	OscSender* sender = new OscSender(client);
+	sender->set_rate(100);
+	sender->begin(0);
+
+	// 10msで0.02rad（2rad/s）回っている子、サンプル時刻が古いので常にmax_extrapolation_us分進める
+	const Vector3<float> base = {0.0f, 1.0f, 0.5f};
+	const Vector3<float> bone = {0.3f, 0.0f, 0.0f};
+	int64_t sampled_at		  = esp_timer_get_time() - 1000000;
+	for (int k = 0; k < 2; k++) {
+		Quaternion q = Quaternion::xyzw(0.0f, 0.0f, sinf(0.01f * k), cosf(0.01f * k));
+		Vector3<float> offset = q * bone;
+		joint.set(q, Vector3<float>::xyz(base.x + offset.x, base.y + offset.y, base.z + offset.z));
+		sender->add_follow(&joint, sampled_at + 10000 * k, base);
+		TEST_ASSERT_TRUE(sender->end_frame());
+		usleep(30000);
+	}
+	while (recv(rx, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+
+	float angle	  = 0.02f + 2.0f * OutputScheduler::max_extrapolation_us * 1e-6f;
+	Quaternion q	  = Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f));
+	Vector3<float> offset = q * bone;
+	VMTJointArgument_t expected = joint;
+	expected.set(q, Vector3<float>::xyz(base.x + offset.x, base.y + offset.y, base.z + offset.z));
+
+	static osc_message_t messages[4];
+	ssize_t length = receive();
+	TEST_ASSERT_EQUAL(1, decode_bundle(buffer, length, messages, 4));
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected.x, messages[0].f[3]);
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected.y, messages[0].f[4]);
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected.z, messages[0].f[5]);
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected.qy, messages[0].f[7]);
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected.qw, messages[0].f[9]);
+}
+
+void test_statistics_roll_without_sends() {
+	// 送信が止まっても、tickで集計を区切り、0件の集計にする
+	OscClient client(host, rx_port);
+	osc_send_stat_t stat;
+	client.send_follow(&joint);
+	usleep(OscClient::stat_window_us + 10000);
+	client.tick();
+	TEST_ASSERT_EQUAL(1, client.read_statistics(&stat));
+	TEST_ASSERT_EQUAL(1, stat.datagrams);
+	TEST_ASSERT_GREATER_OR_EQUAL(OscClient::stat_window_us, stat.window_us);
+
+	client.tick();
+	TEST_ASSERT_EQUAL(1, client.read_statistics(&stat));
+	usleep(OscClient::stat_window_us + 10000);
+	client.tick();
+	TEST_ASSERT_EQUAL(2, client.read_statistics(&stat));
+	TEST_ASSERT_EQUAL(0, stat.datagrams);
+	TEST_ASSERT_EQUAL(0, stat.per_second(stat.bytes));
+}
+
+int main(int argc, char** argv) {
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family	   = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t local_length = sizeof(local);
+	bind(rx, (sockaddr*)&local, sizeof(local));
+	getsockname(rx, (sockaddr*)&local, &local_length);
+	rx_port = ntohs(local.sin_port);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_joint_round_trip);
+	RUN_TEST(test_follow_round_trip);
+	RUN_TEST(test_serial_padding);
+	RUN_TEST(test_room_round_trip);
+	RUN_TEST(test_telemetry_round_trip);
+	RUN_TEST(test_single_message_datagram);
+	RUN_TEST(test_default_destination_skips_telemetry);
+	RUN_TEST(test_bundle_round_trip);
+	RUN_TEST(test_bundle_is_split_at_limit);
+	RUN_TEST(test_statistics_roll_without_sends);
+	RUN_TEST(test_frame_holds_all_joints_and_telemetry);
+	RUN_TEST(test_extrapolation_keeps_parent_position);
+	return UNITY_END();
+}
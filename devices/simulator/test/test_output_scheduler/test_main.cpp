@@ -0,0 +1,138 @@
+// OutputSchedulerの出力時刻の決め方と、角速度での外挿を確かめる
+
+#include <OutputScheduler.h>
+#include <math.h>
+#include <unity.h>
+
+static OutputScheduler* scheduler;
+
+static Quaternion rotate_z(float angle) { return Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f)); }
+
+/// z軸回りの回転角 [rad]
+static float angle_z(Quaternion q) { return 2.0f * atan2f(q.z, q.w); }
+
+void setUp() { scheduler = new OutputScheduler(); }
+
+void tearDown() { delete scheduler; }
+
+void test_no_rate_is_never_due() {
+	int64_t scheduled;
+	TEST_ASSERT_FALSE(scheduler->due(1000, &scheduled));
+	TEST_ASSERT_EQUAL(0, scheduler->get_rate());
+}
+
+void test_fixed_period() {
+	int64_t scheduled;
+	scheduler->set_rate(100);
+	TEST_ASSERT_EQUAL(100, scheduler->get_rate());
+
+	TEST_ASSERT_TRUE(scheduler->due(50000, &scheduled));
+	TEST_ASSERT_EQUAL(50000, scheduled);
+	TEST_ASSERT_FALSE(scheduler->due(59999, &scheduled));
+	// 遅れて呼ばれても予定時刻は周期通り
+	TEST_ASSERT_TRUE(scheduler->due(60300, &scheduled));
+	TEST_ASSERT_EQUAL(60000, scheduled);
+	TEST_ASSERT_TRUE(scheduler->due(70000, &scheduled));
+	TEST_ASSERT_EQUAL(70000, scheduled);
+}
+
+void test_late_periods_are_skipped() {
+	int64_t scheduled;
+	scheduler->set_rate(100);
+	scheduler->due(1, &scheduled);
+	// 2周期半遅れた、間に合わなかった2周期を飛ばす
+	TEST_ASSERT_TRUE(scheduler->due(35001, &scheduled));
+	TEST_ASSERT_EQUAL(10001, scheduled);
+	TEST_ASSERT_FALSE(scheduler->due(40000, &scheduled));
+	TEST_ASSERT_TRUE(scheduler->due(40001, &scheduled));
+	TEST_ASSERT_EQUAL(40001, scheduled);
+}
+
+void test_statistics_window() {
+	int64_t scheduled;
+	scheduler->set_rate(100);
+	// 最初の出力で周期の起点が決まり、以降は毎回200us遅れる
+	scheduler->due(1, &scheduled);
+	int64_t t = 10001;
+	for (; t < 1 + OutputScheduler::stat_window_us; t += 10000) {
+		TEST_ASSERT_TRUE(scheduler->due(t + 200, &scheduled));
+	}
+	// 集計は1秒経ってから入れ替わる
+	TEST_ASSERT_EQUAL(0, scheduler->get_statistics()->frames);
+	scheduler->due(t + 200, &scheduled);
+
+	const output_stat_t* stat = scheduler->get_statistics();
+	TEST_ASSERT_EQUAL(100, stat->frames);
+	TEST_ASSERT_EQUAL(0, stat->skipped);
+	TEST_ASSERT_EQUAL(200, stat->jitter_max);
+	TEST_ASSERT_EQUAL(99 * 200, stat->jitter_sum);
+}
+
+void test_extrapolates_rotation() {
+	// 10msで0.02rad、2rad/sで回っている
+	scheduler->update(0, 100000, rotate_z(0.0f));
+	scheduler->update(0, 110000, rotate_z(0.02f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.02f, angle_z(scheduler->advance(0, 120000)));
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.0f, angle_z(scheduler->advance(0, 110000)));
+	// サンプルより前の時刻には戻さない
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.0f, angle_z(scheduler->advance(0, 100000)));
+}
+
+void test_extrapolation_is_capped() {
+	scheduler->update(0, 100000, rotate_z(0.0f));
+	scheduler->update(0, 110000, rotate_z(0.02f));
+	float limit = 2.0f * OutputScheduler::max_extrapolation_us * 1e-6f;
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, limit, angle_z(scheduler->advance(0, 110000 + 10 * OutputScheduler::max_extrapolation_us)));
+}
+
+void test_gap_has_no_rate() {
+	scheduler->update(0, 100000, rotate_z(0.0f));
+	scheduler->update(0, 100000 + OutputScheduler::max_gap_us + 1, rotate_z(0.5f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, angle_z(scheduler->advance(0, 300000)));
+}
+
+void test_resend_keeps_rate() {
+	// 同じサンプル時刻の送り直しは姿勢だけ更新する
+	scheduler->update(0, 100000, rotate_z(0.0f));
+	scheduler->update(0, 110000, rotate_z(0.02f));
+	scheduler->update(0, 110000, rotate_z(0.5f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.02f, angle_z(scheduler->advance(0, 120000)));
+	// 古いサンプルは無視する
+	scheduler->update(0, 105000, rotate_z(1.0f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.02f, angle_z(scheduler->advance(0, 120000)));
+}
+
+void test_large_rewind_restarts() {
+	// v1に切り替わりサンプル時刻が大きく戻った場合、前の角速度で回し続けない
+	scheduler->update(0, 5000000, rotate_z(0.0f));
+	scheduler->update(0, 5010000, rotate_z(0.02f));
+	scheduler->update(0, 1000000, rotate_z(0.5f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, angle_z(scheduler->advance(0, 6000000)));
+	// 以降は新しい時刻で角速度を求める
+	scheduler->update(0, 1010000, rotate_z(0.51f));
+	TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.01f, angle_z(scheduler->advance(0, 1020000)));
+}
+
+void test_reset_slot() {
+	scheduler->update(3, 100000, rotate_z(0.0f));
+	scheduler->update(3, 110000, rotate_z(0.02f));
+	scheduler->reset(3);
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, angle_z(scheduler->advance(3, 120000)));
+	// 他のslotは影響を受けない
+	TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.0f, angle_z(scheduler->advance(4, 120000)));
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_no_rate_is_never_due);
+	RUN_TEST(test_fixed_period);
+	RUN_TEST(test_late_periods_are_skipped);
+	RUN_TEST(test_statistics_window);
+	RUN_TEST(test_extrapolates_rotation);
+	RUN_TEST(test_extrapolation_is_capped);
+	RUN_TEST(test_gap_has_no_rate);
+	RUN_TEST(test_resend_keeps_rate);
+	RUN_TEST(test_large_rewind_restarts);
+	RUN_TEST(test_reset_slot);
+	return UNITY_END();
+}
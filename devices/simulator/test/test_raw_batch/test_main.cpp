@@ -0,0 +1,100 @@
+// RawBatchで作ったCOMMAND_GET_RAWの応答と、WorkerLinkがそれを積分して姿勢に戻すかを確かめる
+
+#include <RawBatch.h>
+#include <WorkerLink.h>
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+using namespace ESPIDF;
+
+#define ADDRESS 0x10
+
+static RawBatch* batch;
+static data_raw_u frame;
+
+static void on_complete(i2c_request_t* request) {}
+
+/// z軸回りの回転角 [rad]
+static float angle_z(Quaternion q) { return 2.0f * atan2f(q.z, q.w); }
+
+/// 静止して重力だけがかかったIMUの値に、z軸回りの角速度を加える
+static void push(uint32_t timestamp, float rate) {
+	int32_t gz = lroundf(rate / RAW_GYRO_SCALE);
+	batch->push(timestamp, Vector3<int32_t>::xyz(0, 0, gz), Vector3<int32_t>::xyz(0, 0, lroundf(1.0f / RAW_ACCEL_SCALE)));
+}
+
+void setUp() { batch = new RawBatch(); }
+
+void tearDown() { delete batch; }
+
+void test_fill_newest_first() {
+	push(1000, 0.0f);
+	batch->push(2000, Vector3<int32_t>::xyz(1, 2, 3), Vector3<int32_t>::xyz(4, 5, 6));
+	batch->push(3600, Vector3<int32_t>::xyz(-1, -2, -3), Vector3<int32_t>::xyz(-4, -5, -6));
+	batch->fill(&frame, DATA_FLAG_CALIBRATING, 42);
+
+	TEST_ASSERT_TRUE(data_verify(&frame));
+	TEST_ASSERT_EQUAL(DATA_FLAG_CALIBRATING, frame.flags);
+	TEST_ASSERT_EQUAL(42, frame.sequence);
+	TEST_ASSERT_EQUAL(3600, frame.timestamp);
+	TEST_ASSERT_EQUAL(3, frame.count);
+	TEST_ASSERT_EQUAL(-1, frame.samples[0].gx);
+	TEST_ASSERT_EQUAL(-6, frame.samples[0].az);
+	TEST_ASSERT_EQUAL(0, frame.samples[0].age);
+	TEST_ASSERT_EQUAL(3, frame.samples[1].gz);
+	TEST_ASSERT_EQUAL(1600 / BATCH_AGE_UNIT_US, frame.samples[1].age);
+	TEST_ASSERT_EQUAL(2600 / BATCH_AGE_UNIT_US, frame.samples[2].age);
+	// 無効な分は0で埋める
+	TEST_ASSERT_EQUAL(0, frame.samples[3].gx);
+	TEST_ASSERT_EQUAL(0, frame.samples[3].age);
+}
+
+void test_ring_keeps_latest() {
+	for (int i = 0; i < RAW_SAMPLES + 3; i++) batch->push(1000 * i, Vector3<int32_t>::xyz(i, 0, 0), Vector3<int32_t>::xyz(0, 0, 0));
+	batch->fill(&frame, 0, 0);
+	TEST_ASSERT_EQUAL(RAW_SAMPLES, frame.count);
+	TEST_ASSERT_EQUAL(RAW_SAMPLES + 2, frame.samples[0].gx);
+	TEST_ASSERT_EQUAL(3, frame.samples[RAW_SAMPLES - 1].gx);
+}
+
+void test_values_saturate() {
+	batch->push(0, Vector3<int32_t>::xyz(40000, -40000, 0), Vector3<int32_t>::xyz(0, 0, 0));
+	batch->push(0x100000, Vector3<int32_t>::xyz(0, 0, 0), Vector3<int32_t>::xyz(0, 0, 0));
+	batch->fill(&frame, 0, 0);
+	TEST_ASSERT_EQUAL(32767, frame.samples[1].gx);
+	TEST_ASSERT_EQUAL(-32768, frame.samples[1].gy);
+	// 遅れも16bitに収める
+	TEST_ASSERT_EQUAL(0xffff, frame.samples[1].age);
+}
+
+void test_worker_link_fuses_rotation() {
+	WorkerLink worker;
+	size_t count;
+	worker.begin(ADDRESS, on_complete, nullptr, COMMAND_GET_RAW, false);
+
+	// 1msおきに1rad/sで回り、4サンプル毎に読み出す
+	uint16_t sequence = 0;
+	uint32_t first	  = 0;
+	for (int k = 0; k < 50; k++) {
+		for (int i = 0; i < 4; i++) push(1000 * ++sequence, 1.0f);
+		batch->fill((data_raw_u*)worker.get_request()->buffer, 0, sequence);
+		TEST_ASSERT_EQUAL(ESP_OK, worker.decode(&count));
+		// 最初の応答は最新の1サンプルだけ、その時刻から積分する
+		TEST_ASSERT_EQUAL(k ? 4 : 1, count);
+		if (k == 0) first = worker.get_samples()[0].time;
+	}
+	TEST_ASSERT_EQUAL(0, worker.get_lost());
+	TEST_ASSERT_EQUAL(1000 * sequence, worker.get_samples()[3].time);
+	float expected = (1000 * sequence - first) * 1e-6f;
+	TEST_ASSERT_FLOAT_WITHIN(0.005f, expected, angle_z(worker.get_rotation()));
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_fill_newest_first);
+	RUN_TEST(test_ring_keeps_latest);
+	RUN_TEST(test_values_saturate);
+	RUN_TEST(test_worker_link_fuses_rotation);
+	return UNITY_END();
+}
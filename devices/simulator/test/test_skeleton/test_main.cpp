@@ -0,0 +1,136 @@
+// Skeletonの位置の計算と、姿勢を変えた関節だけがdirtyになるかを確かめる
+
+#include <Skeleton.h>
+#include <math.h>
+#include <unity.h>
+
+static Skeleton* skeleton;
+
+static Quaternion rotate_z(float angle) { return Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f)); }
+
+static void assert_position(Vector3<float> expected, Vector3<float> actual) {
+	TEST_ASSERT_FLOAT_WITHIN(1e-5f, expected.x, actual.x);
+	TEST_ASSERT_FLOAT_WITHIN(1e-5f, expected.y, actual.y);
+	TEST_ASSERT_FLOAT_WITHIN(1e-5f, expected.z, actual.z);
+}
+
+void setUp() { skeleton = new Skeleton(); }
+
+void tearDown() { delete skeleton; }
+
+void test_chain_positions() {
+	// 子は親の位置 + 姿勢 * ボーン
+	Vector3<float> bone = {0.0f, 0.3f, 0.0f};
+	int root			= skeleton->add(bone, Quaternion::identify());
+	int child			= skeleton->add(bone, rotate_z(1.5707963f));
+	int grandchild		= skeleton->add(bone, Quaternion::identify());
+	skeleton->set_parent(child, root);
+	skeleton->set_parent(grandchild, child);
+	TEST_ASSERT_TRUE(skeleton->build());
+
+	assert_position({0.0f, 0.3f, 0.0f}, skeleton->get_position(root));
+	assert_position({-0.3f, 0.3f, 0.0f}, skeleton->get_position(child));
+	assert_position({-0.3f, 0.6f, 0.0f}, skeleton->get_position(grandchild));
+	TEST_ASSERT_EQUAL(root, skeleton->get_origin(grandchild));
+
+	// 親から引き継いだ位置は、自分の姿勢を変えても動かない
+	assert_position({0.0f, 0.0f, 0.0f}, skeleton->get_base(root));
+	assert_position({-0.3f, 0.3f, 0.0f}, skeleton->get_base(grandchild));
+	skeleton->set_rotation(grandchild, rotate_z(1.0f));
+	skeleton->update();
+	assert_position({-0.3f, 0.3f, 0.0f}, skeleton->get_base(grandchild));
+}
+
+void test_children_may_come_first() {
+	// 追加順と親子の順が違っても、親から先に求める
+	Vector3<float> bone = {0.1f, 0.0f, 0.0f};
+	int child			= skeleton->add(bone, Quaternion::identify());
+	int root			= skeleton->add(bone, Quaternion::identify());
+	skeleton->set_parent(child, root);
+	TEST_ASSERT_TRUE(skeleton->build());
+	assert_position({0.2f, 0.0f, 0.0f}, skeleton->get_position(child));
+}
+
+void test_only_moved_subtree_is_dirty() {
+	Vector3<float> bone = {0.0f, 0.3f, 0.0f};
+	int root			= skeleton->add(bone, Quaternion::identify());
+	int left			= skeleton->add(bone, Quaternion::identify());
+	int right			= skeleton->add(bone, Quaternion::identify());
+	int leaf			= skeleton->add(bone, Quaternion::identify());
+	skeleton->set_parent(left, root);
+	skeleton->set_parent(right, root);
+	skeleton->set_parent(leaf, left);
+	skeleton->build();
+	skeleton->clean();
+
+	skeleton->set_rotation(left, rotate_z(1.5707963f));
+	skeleton->update();
+	TEST_ASSERT_FALSE(skeleton->is_dirty(root));
+	TEST_ASSERT_TRUE(skeleton->is_dirty(left));
+	TEST_ASSERT_FALSE(skeleton->is_dirty(right));
+	TEST_ASSERT_TRUE(skeleton->is_dirty(leaf));
+	assert_position({-0.3f, 0.6f, 0.0f}, skeleton->get_position(leaf));
+
+	skeleton->clean();
+	skeleton->update();
+	TEST_ASSERT_FALSE(skeleton->is_dirty(left));
+	TEST_ASSERT_FALSE(skeleton->is_dirty(leaf));
+}
+
+void test_anchor_children_are_relative() {
+	// anchorの子はanchorのトラッカーが原点、anchorが動いても送り直さない
+	Vector3<float> bone = {0.0f, 0.3f, 0.0f};
+	int anchor		= skeleton->add(bone, Quaternion::identify(), true);
+	int child		= skeleton->add(bone, Quaternion::identify());
+	skeleton->set_parent(child, anchor);
+	skeleton->build();
+	skeleton->clean();
+
+	TEST_ASSERT_TRUE(skeleton->is_anchor(anchor));
+	TEST_ASSERT_EQUAL(anchor, skeleton->get_origin(child));
+	assert_position(bone, skeleton->get_position(child));
+	assert_position({0.0f, 0.0f, 0.0f}, skeleton->get_base(child));
+
+	skeleton->set_rotation(anchor, rotate_z(1.0f));
+	skeleton->update();
+	TEST_ASSERT_FALSE(skeleton->is_dirty(child));
+	assert_position(bone, skeleton->get_position(child));
+}
+
+void test_cycle_is_broken() {
+	Vector3<float> bone = {0.0f, 0.3f, 0.0f};
+	int a			= skeleton->add(bone, Quaternion::identify());
+	int b			= skeleton->add(bone, Quaternion::identify());
+	skeleton->set_parent(a, b);
+	skeleton->set_parent(b, a);
+	TEST_ASSERT_FALSE(skeleton->build());
+	// どちらか一方がルートになり、もう一方はその子
+	TEST_ASSERT_TRUE(skeleton->get_parent(a) < 0 || skeleton->get_parent(b) < 0);
+	TEST_ASSERT_FALSE(skeleton->get_parent(a) < 0 && skeleton->get_parent(b) < 0);
+}
+
+void test_invalid_parent_is_root() {
+	int a = skeleton->add({0.0f, 0.3f, 0.0f}, Quaternion::identify());
+	skeleton->set_parent(a, a);
+	TEST_ASSERT_EQUAL(-1, skeleton->get_parent(a));
+	skeleton->set_parent(a, 5);
+	TEST_ASSERT_EQUAL(-1, skeleton->get_parent(a));
+}
+
+void test_capacity() {
+	for (int i = 0; i < SKELETON_MAX_JOINTS; i++) TEST_ASSERT_EQUAL(i, skeleton->add({0.0f, 0.1f, 0.0f}, Quaternion::identify()));
+	TEST_ASSERT_EQUAL(-1, skeleton->add({0.0f, 0.1f, 0.0f}, Quaternion::identify()));
+	TEST_ASSERT_EQUAL(SKELETON_MAX_JOINTS, skeleton->size());
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_chain_positions);
+	RUN_TEST(test_children_may_come_first);
+	RUN_TEST(test_only_moved_subtree_is_dirty);
+	RUN_TEST(test_anchor_children_are_relative);
+	RUN_TEST(test_cycle_is_broken);
+	RUN_TEST(test_invalid_parent_is_root);
+	RUN_TEST(test_capacity);
+	return UNITY_END();
+}
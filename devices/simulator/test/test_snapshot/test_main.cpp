@@ -0,0 +1,155 @@
+// Snapshot / SpscQueueの受け渡しを、単独の操作と書き込み・読み出しを別スレッドで回した場合で確かめる
+
+#include <Snapshot.h>
+#include <SpscQueue.h>
+#include <unity.h>
+
+#include <atomic>
+#include <thread>
+
+#define ROUNDS 20000
+
+/// 全体が同じ回のpublishから来ていれば、各要素はaから求まる
+struct frame_t {
+	uint32_t a;
+	uint32_t b[7];
+};
+
+static frame_t make_frame(uint32_t a) {
+	frame_t f;
+	f.a = a;
+	for (int i = 0; i < 7; i++) f.b[i] = a * (i + 3);
+	return f;
+}
+
+static bool consistent(const frame_t& f) {
+	for (int i = 0; i < 7; i++) {
+		if (f.b[i] != f.a * (i + 3)) return false;
+	}
+	return true;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_snapshot_initial() {
+	Snapshot<frame_t> snapshot;
+	frame_t f;
+	TEST_ASSERT_EQUAL(0, snapshot.read(&f));
+	TEST_ASSERT_EQUAL(0, f.a);
+	TEST_ASSERT_EQUAL(0, snapshot.version());
+}
+
+void test_snapshot_reads_latest() {
+	Snapshot<frame_t> snapshot;
+	frame_t f;
+	for (uint32_t i = 1; i <= 5; i++) {
+		snapshot.publish(make_frame(i * 10));
+		TEST_ASSERT_EQUAL(i, snapshot.version());
+		TEST_ASSERT_EQUAL(i, snapshot.read(&f));
+		TEST_ASSERT_EQUAL(i * 10, f.a);
+	}
+}
+
+void test_snapshot_concurrent_reads_are_consistent() {
+	// 書き込み中の面を読んでも、やり直して整合した値だけを返す
+	Snapshot<frame_t> snapshot;
+	std::atomic<bool> done(false);
+	std::atomic<uint32_t> torn(0), backward(0);
+
+	auto reader = [&]() {
+		uint32_t last = 0;
+		frame_t f;
+		while (!done.load()) {
+			uint32_t n = snapshot.read(&f);
+			if (!consistent(f) || f.a != n) torn++;
+			if (n < last) backward++;
+			last = n;
+			// 1コアでも書き込み側が進むように譲る
+			std::this_thread::yield();
+		}
+	};
+	std::thread r1(reader), r2(reader);
+	for (uint32_t i = 1; i <= ROUNDS; i++) snapshot.publish(make_frame(i));
+	done = true;
+	r1.join();
+	r2.join();
+
+	TEST_ASSERT_EQUAL(0, torn.load());
+	TEST_ASSERT_EQUAL(0, backward.load());
+	TEST_ASSERT_EQUAL(ROUNDS, snapshot.version());
+}
+
+void test_queue_order_and_capacity() {
+	SpscQueue<uint32_t, 4> queue;
+	TEST_ASSERT_NULL(queue.front());
+
+	// 何周かして、位置の折り返しでも順番が保たれる
+	uint32_t written = 0, read = 0;
+	for (int round = 0; round < 3; round++) {
+		uint32_t* slot;
+		while ((slot = queue.reserve()) != nullptr) {
+			*slot = written++;
+			queue.commit();
+		}
+		TEST_ASSERT_EQUAL(4 * (round + 1), written);
+
+		for (int i = 0; i < 4; i++) {
+			TEST_ASSERT_NOT_NULL(queue.front());
+			TEST_ASSERT_EQUAL(read++, *queue.front());
+			queue.pop();
+		}
+		TEST_ASSERT_NULL(queue.front());
+	}
+}
+
+void test_queue_uncommitted_is_invisible() {
+	SpscQueue<uint32_t, 2> queue;
+	*queue.reserve() = 7;
+	TEST_ASSERT_NULL(queue.front());
+	queue.commit();
+	TEST_ASSERT_EQUAL(7, *queue.front());
+}
+
+void test_queue_concurrent_order() {
+	SpscQueue<frame_t, 8> queue;
+	std::atomic<uint32_t> errors(0);
+
+	std::thread consumer([&]() {
+		for (uint32_t expected = 0; expected < ROUNDS;) {
+			frame_t* f = queue.front();
+			if (f == nullptr) {
+				std::this_thread::yield();
+				continue;
+			}
+			if (f->a != expected || !consistent(*f)) errors++;
+			queue.pop();
+			expected++;
+		}
+	});
+	for (uint32_t i = 0; i < ROUNDS;) {
+		frame_t* f = queue.reserve();
+		if (f == nullptr) {
+			std::this_thread::yield();
+			continue;
+		}
+		*f = make_frame(i++);
+		queue.commit();
+	}
+	consumer.join();
+
+	TEST_ASSERT_EQUAL(0, errors.load());
+	TEST_ASSERT_NULL(queue.front());
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_snapshot_initial);
+	RUN_TEST(test_snapshot_reads_latest);
+	RUN_TEST(test_snapshot_concurrent_reads_are_consistent);
+	RUN_TEST(test_queue_order_and_capacity);
+	RUN_TEST(test_queue_uncommitted_is_invisible);
+	RUN_TEST(test_queue_concurrent_order);
+	return UNITY_END();
+}
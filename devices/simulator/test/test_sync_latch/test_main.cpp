@@ -0,0 +1,91 @@
+// SyncLatchが指定時刻の姿勢を前後のサンプルから補間し、間に合わなかった場合は遅れを通知するか確かめる
+
+#include <SyncLatch.h>
+#include <math.h>
+#include <unity.h>
+
+static SyncLatch* latch;
+static data_sync_u frame;
+
+static Quaternion rotate_z(float angle) { return Quaternion::xyzw(0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f)); }
+
+/// z軸回りの回転角 [rad]
+static float angle_z(Quaternion q) { return 2.0f * atan2f(q.z, q.w); }
+
+/// COMMAND_SYNCを受け取った時刻から、delay_us後の姿勢を保持させる
+static void arm(uint8_t id, uint32_t received_at, uint16_t delay_us) {
+	uint8_t command[4] = {COMMAND_SYNC, id, (uint8_t)delay_us, (uint8_t)(delay_us >> 8)};
+	latch->arm(command, received_at);
+}
+
+void setUp() { latch = new SyncLatch(); }
+
+void tearDown() { delete latch; }
+
+void test_interpolates_between_samples() {
+	latch->update(1000, rotate_z(0.0f), 0, &frame);
+	arm(7, 1200, 1000);
+	// 指定時刻の2200usより前
+	TEST_ASSERT_FALSE(latch->update(2000, rotate_z(0.1f), 0, &frame));
+	TEST_ASSERT_TRUE(latch->update(3000, rotate_z(0.2f), 0, &frame));
+
+	TEST_ASSERT_TRUE(data_verify(&frame));
+	TEST_ASSERT_EQUAL(DATA_FLAG_SYNC, frame.flags);
+	TEST_ASSERT_EQUAL(7, frame.id);
+	TEST_ASSERT_EQUAL(2200, frame.timestamp);
+	TEST_ASSERT_EQUAL(0, frame.offset);
+	TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.12f, angle_z(data_unpack(frame.ahrs)));
+}
+
+void test_latches_once() {
+	latch->update(1000, rotate_z(0.0f), 0, &frame);
+	arm(1, 1000, 500);
+	TEST_ASSERT_TRUE(latch->update(2000, rotate_z(0.1f), DATA_FLAG_CALIBRATING, &frame));
+	TEST_ASSERT_EQUAL(DATA_FLAG_SYNC | DATA_FLAG_CALIBRATING, frame.flags);
+	TEST_ASSERT_FALSE(latch->update(3000, rotate_z(0.2f), 0, &frame));
+}
+
+void test_late_command_reports_offset() {
+	// 指定時刻の900usが直前のサンプルより前、そのサンプルを遅れと共に返す
+	latch->update(1000, rotate_z(0.0f), 0, &frame);
+	latch->update(2000, rotate_z(0.1f), 0, &frame);
+	arm(3, 900, 0);
+	TEST_ASSERT_TRUE(latch->update(3000, rotate_z(0.2f), 0, &frame));
+	TEST_ASSERT_EQUAL(2000, frame.timestamp);
+	TEST_ASSERT_EQUAL(1100, frame.offset);
+	TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.1f, angle_z(data_unpack(frame.ahrs)));
+}
+
+void test_offset_saturates() {
+	latch->update(100000, rotate_z(0.0f), 0, &frame);
+	arm(3, 0, 0);
+	TEST_ASSERT_TRUE(latch->update(200000, rotate_z(0.2f), 0, &frame));
+	TEST_ASSERT_EQUAL(0x7fff, frame.offset);
+}
+
+void test_zero_id_is_ignored() {
+	latch->update(1000, rotate_z(0.0f), 0, &frame);
+	arm(0, 1000, 0);
+	TEST_ASSERT_FALSE(latch->update(2000, rotate_z(0.1f), 0, &frame));
+}
+
+void test_timestamp_wraps() {
+	// Workerの32bitの時刻が周回しても補間する
+	latch->update(0xfffffc18, rotate_z(0.0f), 0, &frame);
+	arm(9, 0xfffffc18, 1500);
+	TEST_ASSERT_FALSE(latch->update(0xfffffe0c, rotate_z(0.05f), 0, &frame));
+	TEST_ASSERT_TRUE(latch->update(0x000003e8, rotate_z(0.2f), 0, &frame));
+	TEST_ASSERT_EQUAL(0x000001f4, frame.timestamp);
+	TEST_ASSERT_EQUAL(0, frame.offset);
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_interpolates_between_samples);
+	RUN_TEST(test_latches_once);
+	RUN_TEST(test_late_command_reports_offset);
+	RUN_TEST(test_offset_saturates);
+	RUN_TEST(test_zero_id_is_ignored);
+	RUN_TEST(test_timestamp_wraps);
+	return UNITY_END();
+}
@@ -0,0 +1,193 @@
+// WorkerLinkのv2 / v1の切り替えと連番の扱いを、I2Cを通さずに応答を書き込んで確かめる
+
+#include <WorkerLink.h>
+#include <string.h>
+#include <unity.h>
+
+using namespace ESPIDF;
+
+#define ADDRESS 0x10
+
+static WorkerLink* worker;
+
+static void on_complete(i2c_request_t* request) {}
+
+/// 読み出した応答の代わりに、要求のバッファへ直接書き込む
+static void reply_empty() { memset(worker->get_request()->buffer, DATA_EMPTY, worker->get_request()->length); }
+
+static void reply_v1() {
+	data_u* data = (data_u*)worker->get_request()->buffer;
+	data->header = SYNC_HEADER;
+	data->ahrs	 = Quaternion::identify();
+	data->footer = SYNC_FOOTER;
+}
+
+static void reply_v2(uint16_t sequence) {
+	data_v2_u* data = (data_v2_u*)worker->get_request()->buffer;
+	data->version	= PROTOCOL_VERSION_2;
+	data->flags	= 0;
+	data->sequence	= sequence;
+	data->timestamp = sequence * 1000;
+	data->ahrs	= Quaternion::identify();
+	data->reserved	= 0;
+	data_seal(data);
+}
+
+/// samples[0]がsequence、古い方にcount個並べる
+static void reply_batch(uint16_t sequence, uint8_t count) {
+	data_batch_u* data = (data_batch_u*)worker->get_request()->buffer;
+	memset(data, 0, sizeof(data_batch_u));
+	data->sequence  = sequence;
+	data->timestamp = sequence * 1000;
+	data->count	= count;
+	for (int i = 0; i < count; i++) data->samples[i] = data_pack(Quaternion::identify(), i * 1000 / BATCH_AGE_UNIT_US);
+	data_seal(data);
+}
+
+static void begin_batch() {
+	delete worker;
+	worker = new WorkerLink();
+	worker->begin(ADDRESS, on_complete, nullptr, COMMAND_GET_BATCH, false);
+}
+
+void setUp() {
+	worker = new WorkerLink();
+	worker->begin(ADDRESS, on_complete, nullptr, COMMAND_GET_QUATERNION_V2, false);
+}
+
+void tearDown() { delete worker; }
+
+void test_v2_reply_is_decoded() {
+	size_t count;
+	reply_v2(1);
+	TEST_ASSERT_EQUAL(ESP_OK, worker->decode(&count));
+	TEST_ASSERT_EQUAL(1, count);
+	TEST_ASSERT_EQUAL(PROTOCOL_VERSION_2, worker->get_protocol());
+}
+
+void test_empty_reads_are_not_misses() {
+	// スレーブタスクが書き込む前の読み出しは、v2非対応とはみなさない
+	size_t count;
+	for (int i = 0; i < WorkerLink::fallback_misses * 2; i++) {
+		reply_empty();
+		TEST_ASSERT_EQUAL(ESP_OK, worker->decode(&count));
+		TEST_ASSERT_EQUAL(0, count);
+	}
+	TEST_ASSERT_EQUAL(PROTOCOL_VERSION_2, worker->get_protocol());
+
+	reply_v2(1);
+	TEST_ASSERT_EQUAL(ESP_OK, worker->decode(&count));
+	TEST_ASSERT_EQUAL(PROTOCOL_VERSION_2, worker->get_protocol());
+}
+
+void test_empty_reads_fall_back_to_v1() {
+	// v1のWorkerは未知のコマンドに応答しないので、空の読み出しが続く
+	size_t count;
+	for (int i = 0; i < WorkerLink::stale_limit - 1; i++) {
+		reply_empty();
+		worker->decode(&count);
+	}
+	TEST_ASSERT_EQUAL(PROTOCOL_VERSION_2, worker->get_protocol());
+	reply_empty();
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(PROTOCOL_VERSION_1, worker->get_protocol());
+	TEST_ASSERT_EQUAL(COMMAND_GET_QUATERNION, worker->get_request()->command[0]);
+
+	reply_v1();
+	TEST_ASSERT_EQUAL(ESP_OK, worker->decode(&count));
+	TEST_ASSERT_EQUAL(1, count);
+}
+
+void test_invalid_replies_fall_back_to_v1() {
+	size_t count;
+	for (int i = 0; i < WorkerLink::fallback_misses; i++) {
+		reply_v1();
+		TEST_ASSERT_EQUAL(ESP_ERR_INVALID_RESPONSE, worker->decode(&count));
+	}
+	TEST_ASSERT_EQUAL(PROTOCOL_VERSION_1, worker->get_protocol());
+}
+
+void test_batch_counts_lost_samples() {
+	size_t count;
+	begin_batch();
+	reply_batch(100, BATCH_SAMPLES);
+	TEST_ASSERT_EQUAL(ESP_OK, worker->decode(&count));
+	TEST_ASSERT_EQUAL(1, count);
+
+	reply_batch(103, BATCH_SAMPLES);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(3, count);
+	TEST_ASSERT_EQUAL(0, worker->get_lost());
+	// 古い順に並び、最後が最新
+	TEST_ASSERT_EQUAL(101000, worker->get_samples()[0].time);
+	TEST_ASSERT_EQUAL(103000, worker->get_samples()[2].time);
+
+	// 5つ進んだが応答には2つしか無い
+	reply_batch(108, 2);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(2, count);
+	TEST_ASSERT_EQUAL(3, worker->get_lost());
+}
+
+void test_rebooted_worker_is_resynced() {
+	// 再起動したWorkerの連番は戻る、失ったサンプルとして数えない
+	size_t count;
+	begin_batch();
+	reply_batch(5000, BATCH_SAMPLES);
+	worker->decode(&count);
+	reply_batch(3, BATCH_SAMPLES);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(1, count);
+	TEST_ASSERT_EQUAL(0, worker->get_lost());
+
+	// 以降は新しい連番から数える
+	reply_batch(5, BATCH_SAMPLES);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(2, count);
+	TEST_ASSERT_EQUAL(0, worker->get_lost());
+}
+
+void test_large_jump_is_resynced() {
+	size_t count;
+	begin_batch();
+	reply_batch(10, BATCH_SAMPLES);
+	worker->decode(&count);
+	reply_batch(10 + BATCH_SAMPLES + 1, BATCH_SAMPLES);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(1, count);
+	TEST_ASSERT_EQUAL(0, worker->get_lost());
+}
+
+void test_duplicate_batch_has_no_samples() {
+	size_t count;
+	begin_batch();
+	reply_batch(10, BATCH_SAMPLES);
+	worker->decode(&count);
+	reply_batch(10, BATCH_SAMPLES);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(0, count);
+}
+
+void test_v2_sequence_wraps() {
+	size_t count;
+	reply_v2(0xffff);
+	worker->decode(&count);
+	reply_v2(0);
+	worker->decode(&count);
+	TEST_ASSERT_EQUAL(1, count);
+	TEST_ASSERT_EQUAL(0, worker->get_lost());
+}
+
+int main(int argc, char** argv) {
+	UNITY_BEGIN();
+	RUN_TEST(test_v2_reply_is_decoded);
+	RUN_TEST(test_empty_reads_are_not_misses);
+	RUN_TEST(test_empty_reads_fall_back_to_v1);
+	RUN_TEST(test_invalid_replies_fall_back_to_v1);
+	RUN_TEST(test_batch_counts_lost_samples);
+	RUN_TEST(test_rebooted_worker_is_resynced);
+	RUN_TEST(test_large_jump_is_resynced);
+	RUN_TEST(test_duplicate_batch_has_no_samples);
+	RUN_TEST(test_v2_sequence_wraps);
+	return UNITY_END();
+}
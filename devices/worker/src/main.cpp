@@ -14,8 +14,8 @@
 #include <AtoMatrix.h>
 
 #include "Calibration.h"
-#include "MadgwickAHRS.h"
 #include "Vector3.h"
+#include "WorkerSlave.h"
 #include "data.h"
 #include "espidf_MPU6886.h"
 #include "i2c.h"
@@ -35,26 +35,12 @@ left_ankle  18
 
 // #define CHARA_INDEX (1)
 
-#define RX_BUFFER_LENGTH ((size_t)512)
-
 extern "C" {
 void app_main();
 }
 
 uint8_t slave_address = 1;
 
-SemaphoreHandle_t print_mux = NULL;
-
-data_u data;
-IAHRS *ahrs;
-
-// Gyro scale (±2000 degree/seconds Range by int16_t data -> rad / seconds)
-// (1.0f / 32768.0f * 2000.0f / 180.0f * 3.14159265358979323846264338327950288f);
-const float s = 0.00106526443603169529841533860372f;
-
-// Accelemeter scale (± 8G Range by int16_t data -> m/s^2)
-const float t = 8.0 / 32768.0;
-
 // Matrix LED表示
 static uint32_t numbers[20] = {
     //.......1....2....3....4....5....
@@ -97,22 +83,12 @@ using namespace ESPIDF;
 static bool start_gyro_calibration	 = true;
 static bool finish_gyro_calibration = false;
 
+static WorkerSlave *worker;
+// IMUの温度を読み出す間隔
+#define TEMPERATURE_INTERVAL_US 1000000
+
 static void i2c_slave_task(void *arg) {
-	I2CSlave *slave = (I2CSlave *)arg;
-	uint8_t *rx	 = (uint8_t *)malloc(RX_BUFFER_LENGTH);
-	while (1) {
-		xSemaphoreTake(print_mux, portMAX_DELAY);
-		slave->read_bytes(rx, 64, 0);
-
-		switch (rx[0]) {
-			case COMMAND_GET_QUATERNION:
-				slave->write_bytes(data.raw, sizeof(data_u), true, 10 / portTICK_RATE_MS);
-				break;
-		}
-		xSemaphoreGive(print_mux);
-		vTaskDelay(1);
-	}
-	vSemaphoreDelete(print_mux);
+	while (1) worker->serve();
 	vTaskDelete(NULL);
 }
 
@@ -124,19 +100,21 @@ static void data_update(void *arg) {
 	Calibration *calib = new Calibration((IIMU *)arg, Config::characterisitcs[CHARA_INDEX]);
 #endif
 
-	ahrs = new MadgwickAHRS(1.0f);
-	ahrs->reset();
-
 	Vector3<int32_t> g, a;
-	// int32_t max_a = 0, max_g = 0;
+	MPU6886 *imu		= (MPU6886 *)(IIMU *)arg;
+	I2CMaster *master	= (I2CMaster *)imu->getI2CMaster();
+	Telemetry *telemetry	= worker->get_telemetry();
+	uint32_t temperature_at = 0;
 
 	while (true) {
 		vTaskDelay(1);
+		telemetry->set_calibration(calib->getMode());
 		if (!calib->proccess()) {
 			vTaskDelay(15 / portTICK_RATE_MS);
 		} else if (start_gyro_calibration) {
 			start_gyro_calibration  = false;
 			finish_gyro_calibration = true;
+			worker->set_calibrating(true);
 
 			setNumber(slave_address, RED);
 			matrix->update();
@@ -144,39 +122,24 @@ static void data_update(void *arg) {
 			calib->regist(Calibration::Mode::Gyro);
 		} else if (finish_gyro_calibration) {
 			finish_gyro_calibration = false;
+			worker->set_calibrating(false);
+
 			setNumber(slave_address, GREEN);
 			matrix->update();
 		} else {
+			uint32_t timestamp = esp_timer_get_time();
 			calib->getAccelAdc(&a);
+			if (master->get_last_error() != ESP_OK) telemetry->count_imu_error();
 			calib->getGyroAdc(&g);
+			if (master->get_last_error() != ESP_OK) telemetry->count_imu_error();
 
-			/* ジャイロレンジオーバー検出用
-			if (max_g < +g.x) max_g = +g.x;
-			if (max_g < +g.y) max_g = +g.y;
-			if (max_g < +g.z) max_g = +g.z;
-			if (max_g < -g.x) max_g = -g.x;
-			if (max_g < -g.y) max_g = -g.y;
-			if (max_g < -g.z) max_g = -g.z;
-
-			if (max_a < +a.x) max_a = +a.x;
-			if (max_a < +a.y) max_a = +a.y;
-			if (max_a < +a.z) max_a = +a.z;
-			if (max_a < -a.x) max_a = -a.x;
-			if (max_a < -a.y) max_a = -a.y;
-			if (max_a < -a.z) max_a = -a.z;
-			*/
-
-			ahrs->update(g * s, a * t);
-			data.ahrs = ahrs->q;
-
-			/*
-			デバッグ用
-			printf("d: %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f, %f\n",
-				  ahrs->q.x, ahrs->q.y, ahrs->q.z, ahrs->q.w,
-				  q.x, q.y, q.z, q.w,
-				  p.x, p.y, p.z, p.w);
-			fflush(stdout);
-			*/
+			if (timestamp - temperature_at >= TEMPERATURE_INTERVAL_US) {
+				temperature_at = timestamp;
+				telemetry->set_temperature(imu->getTemp());
+				telemetry->set_offset(calib->g);
+			}
+
+			worker->update(timestamp, g, a);
 		}
 	}
 }
@@ -242,12 +205,9 @@ void app_main() {
 	matrix = new AtoMatrix(I2S_NUM_0, pixels);
 	matrix->update();
 
-	data.header = SYNC_HEADER;
-	data.ahrs	  = Quaternion::identify();
-	data.footer = SYNC_FOOTER;
-
 	I2CMaster *master = new I2CMaster(&I2CMaster::Default_M5Atom);
 	I2CSlave *slave   = new I2CSlave(CONFIG_I2C_SLAVE_PORT_NUM, CONFIG_I2C_SLAVE_SCL, CONFIG_I2C_SLAVE_SDA, slave_address);
+	worker		   = new WorkerSlave(slave);
 
 	IIMU *imu = new MPU6886(master);
 
@@ -266,8 +226,7 @@ void app_main() {
 	ESP_ERROR_CHECK(gpio_isr_handler_add(GPIO_NUM_39, on_button_click, nullptr));
 	*/
 
-	print_mux = xSemaphoreCreateMutex();
-	xTaskCreate(i2c_slave_task, "i2c_test_task_0", 1024 * 8, slave, 10, NULL);
+	xTaskCreate(i2c_slave_task, "i2c_test_task_0", 1024 * 8, nullptr, 10, NULL);
 	xTaskCreate(data_update, "update_ahrs", 1024 * 8, imu, 10, NULL);
 	xTaskCreate(uart_task, "uart", 1024 * 2, nullptr, 10, nullptr);
 }
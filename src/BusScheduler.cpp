@@ -0,0 +1,84 @@
+#include "BusScheduler.h"
+
+BusScheduler::BusScheduler(uint32_t target_hz) {
+	count = 0;
+	set_target_rate(target_hz);
+}
+
+void BusScheduler::set_target_rate(uint32_t target_hz) {
+	if (target_hz == 0) target_hz = 1;
+	interval = 1000000 / target_hz;
+
+	for (int i = 0; i < count; i++) slots[i].interval = interval;
+}
+
+int BusScheduler::add(uint8_t address) {
+	if (count >= BUS_SCHEDULER_MAX_SLOTS) return -1;
+
+	bus_slot_t* s	= slots + count;
+	s->address	= address;
+	s->failures	= 0;
+	s->interval	= interval;
+	s->next_due	= 0;
+	s->last_motion = 0;
+
+	return count++;
+}
+
+size_t BusScheduler::schedule(int64_t now, uint8_t* indices, size_t max) {
+	size_t n = 0;
+
+	// 期限を過ぎたスロットを、動いているもの優先・遅れが大きいもの優先で挿入ソート
+	for (int i = 0; i < count; i++) {
+		bus_slot_t* s = slots + i;
+		if (s->next_due > now) continue;
+
+		bool moving	  = now - s->last_motion < motion_window;
+		int64_t late = now - s->next_due;
+
+		int k = n;
+		while (k > 0) {
+			bus_slot_t* p	  = slots + indices[k - 1];
+			bool p_moving	  = now - p->last_motion < motion_window;
+			int64_t p_late = now - p->next_due;
+			if (p_moving && !moving) break;
+			if (p_moving == moving && p_late >= late) break;
+			if (k < max) indices[k] = indices[k - 1];
+			k--;
+		}
+		if (k < max) {
+			indices[k] = i;
+			if (n < max) n++;
+		}
+	}
+
+	return n;
+}
+
+void BusScheduler::commit(int index, int64_t now) {
+	if (index < 0 || index >= count) return;
+	bus_slot_t* s = slots + index;
+	s->next_due	= now + s->interval;
+}
+
+void BusScheduler::report(int index, int64_t now, bool success, bool moved, bool unchanged) {
+	if (index < 0 || index >= count) return;
+	bus_slot_t* s = slots + index;
+
+	if (!success) {
+		// 応答しないWorkerは指数バックオフで間隔を空ける
+		if (s->failures < 31) s->failures++;
+		uint64_t backoff = (uint64_t)interval << s->failures;
+		if (backoff > backoff_limit) backoff = backoff_limit;
+		s->next_due = now + backoff;
+		return;
+	}
+
+	s->failures = 0;
+	if (moved) s->last_motion = now;
+	if (now - s->last_motion < motion_window) {
+		s->interval = interval;
+	} else {
+		s->interval = interval * (unchanged ? dormant_ratio : idle_ratio);
+	}
+}
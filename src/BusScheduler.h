@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUS_SCHEDULER_MAX_SLOTS 16
+
+struct bus_slot_t {
+	uint8_t address;
+	uint8_t failures;	 // 連続失敗回数
+	uint16_t reserved;
+	uint32_t interval;	 // 現在のポーリング間隔 [us]
+	int64_t next_due;	 // 次にポーリングする時刻 [us]
+	int64_t last_motion;  // 最後に動きを検出した時刻 [us]
+};
+
+/// 複数Workerのポーリング順序と間隔を決める
+/// 時刻は全て呼び出し側から与える(esp_timer_get_time基準を想定)
+class BusScheduler {
+    public:
+	BusScheduler(uint32_t target_hz);
+
+	int add(uint8_t address);
+	void set_target_rate(uint32_t target_hz);
+
+	/// nowの時点でポーリングすべきスロットを優先度順にindicesへ格納し、その数を返します
+	/// 返したスロットの期限はcommitするまで進めないので、投入できなかったものは次回も返ります
+	size_t schedule(int64_t now, uint8_t* indices, size_t max);
+	/// 要求を投入したスロットの次の期限を決めます
+	void commit(int index, int64_t now);
+	/// ポーリング結果を反映します、unchangedはWorker自身が静止中と通知した場合
+	void report(int index, int64_t now, bool success, bool moved, bool unchanged = false);
+
+	const bus_slot_t* get(int index);
+	size_t size();
+
+	/// 動きがあったとみなす期間、この間は目標レートでポーリングする
+	static const int64_t motion_window = 500000;
+	/// 静止中のスロットは目標間隔のこの倍率でポーリングする
+	static const uint32_t idle_ratio = 4;
+	/// Workerが静止中と通知したスロットは目標間隔のこの倍率でポーリングする
+	static const uint32_t dormant_ratio = 16;
+	/// 失敗時のバックオフ上限
+	static const uint32_t backoff_limit = 1000000;
+
+    private:
+	bus_slot_t slots[BUS_SCHEDULER_MAX_SLOTS];
+	size_t count;
+	uint32_t interval;
+};
+
+inline const bus_slot_t* BusScheduler::get(int index) { return slots + index; }
+inline size_t BusScheduler::size() { return count; }
@@ -26,6 +26,8 @@ class Calibration {
 	void regist(int mode);
 	bool proccess();
 	void getStatus(char *buffer);
+	/// 実行中の測定、Noneなら完了
+	Mode getMode();
 
 	void getGyroAdc(Vector3<int32_t> *value);
 	void getAccelAdc(Vector3<int32_t> *value);
@@ -52,6 +54,7 @@ class Calibration {
 };
 
 inline void Calibration::regist(int mode) { this->mode = static_cast<Mode>(mode); }
+inline Calibration::Mode Calibration::getMode() { return mode; }
 
 Calibration::Calibration(IIMU *imu, int count, uint32_t gyro_threshould, uint32_t accel_threshould) {
 	this->sensor		   = imu;
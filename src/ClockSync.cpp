@@ -0,0 +1,83 @@
+#include "ClockSync.h"
+
+#include <math.h>
+
+ClockSync::ClockSync() { reset(); }
+
+void ClockSync::reset() {
+	head	    = 0;
+	count    = 0;
+	outliers = 0;
+
+	base_offset = 0;
+	fit_at	    = 0;
+	fit_offset  = 0.0;
+	slope	    = 0.0;
+}
+
+void ClockSync::add(int64_t sent_at, uint32_t received, uint32_t replied, int64_t returned_at) {
+	// NTPと同じく、行きと帰りの時間が等しいとみなす
+	uint32_t forward  = received - (uint32_t)sent_at;
+	uint32_t backward = replied - (uint32_t)returned_at;
+	uint32_t offset   = forward + (int32_t)(backward - forward) / 2;
+	int64_t at	   = sent_at + (returned_at - sent_at) / 2;
+	int32_t turn	   = (int32_t)(replied - received);
+	int32_t rtt	   = (int32_t)(returned_at - sent_at) - turn;
+
+	if (count == 0) base_offset = offset;
+	int32_t relative = (int32_t)(offset - base_offset);
+
+	if (is_valid()) {
+		double predicted = fit_offset + slope * (double)(at - fit_at);
+		if (fabs(relative - predicted) > reset_threshold) {
+			// 1度だけなら読み出し時の割り込みなどとみなして捨てる
+			if (++outliers < 3) return;
+			reset();
+			base_offset = offset;
+			relative	= 0;
+		}
+	}
+	outliers = 0;
+
+	head			   = (head + 1) % window;
+	samples[head] = {at, relative, rtt > 0 ? (uint32_t)rtt : 0};
+	if (count < window) count++;
+
+	fit();
+}
+
+void ClockSync::fit() {
+	// 往復に時間がかかったものは行きと帰りの差も大きいので、最短に近いものだけを使う
+	// headから遡ってcount個が有効
+	uint32_t shortest = UINT32_MAX;
+	for (int i = 0; i < count; i++) {
+		const clock_sample_t* sample = samples + (head + window - i) % window;
+		if (sample->round_trip < shortest) shortest = sample->round_trip;
+	}
+	uint32_t limit = shortest * 2 + 50;
+
+	fit_at = samples[head].at;
+	double n = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+	for (int i = 0; i < count; i++) {
+		const clock_sample_t* sample = samples + (head + window - i) % window;
+		if (sample->round_trip > limit) continue;
+		double x = (double)(sample->at - fit_at);
+		double y = sample->offset;
+		n += 1.0;
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+
+	double d = n * sxx - sx * sx;
+	slope	   = n >= 2.0 && d > 0.0 ? (n * sxy - sx * sy) / d : 0.0;
+	fit_offset = (sy - slope * sx) / n;
+}
+
+int64_t ClockSync::to_parent(uint32_t worker_time) {
+	// fit_atでのWorkerの時刻からの差を、ドリフト分だけ縮めてParentの時間にする
+	uint32_t fit_worker = (uint32_t)fit_at + base_offset + (int32_t)lround(fit_offset);
+	int32_t elapsed	    = (int32_t)(worker_time - fit_worker);
+	return fit_at + llround(elapsed / (1.0 + slope));
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+/// Parent側で1台のWorkerの時計（esp_timer_get_timeの下位32bit）とParentの時計の対応を推定する
+/// COMMAND_PINGの往復からずれを求め、直近windowの結果を線形回帰してずれとドリフトにする
+/// 往復の行きと帰りの時間差（応答の読み出し待ち）の半分は、全Workerに共通の誤差として残る
+class ClockSync {
+    public:
+	ClockSync();
+
+	/// sent_at: 書き込み直前、returned_at: 読み出し完了（Parentの時刻）
+	/// received, replied: data_ping_uのWorkerの時刻
+	void add(int64_t sent_at, uint32_t received, uint32_t replied, int64_t returned_at);
+	/// 推定を破棄します（Workerの再起動など）
+	void reset();
+
+	/// min_samples回以上ずれが求まっていればtrue
+	bool is_valid();
+	/// Workerの時刻をParentの時刻に変換します、直近のpingから約35分以内の時刻のみ
+	int64_t to_parent(uint32_t worker_time);
+	/// Parentに対するWorkerの時計の進み [ppm]
+	float get_drift();
+	/// 直近の往復時間からWorker側の処理時間を除いたもの [us]
+	uint32_t get_round_trip();
+
+	static const uint8_t window = 16;
+	static const uint8_t min_samples = 4;
+	/// 推定からこれ以上離れたずれが続けば、Workerの時計が変わったとみなす [us]
+	static const int32_t reset_threshold = 5000;
+
+    private:
+	void fit();
+
+	struct clock_sample_t {
+		int64_t at;			 // Parentの時刻
+		int32_t offset;		 // Worker - Parent - base_offset
+		uint32_t round_trip;
+	};
+
+	clock_sample_t samples[window];
+	uint8_t head;
+	uint8_t count;
+	uint8_t outliers;
+
+	uint32_t base_offset;  // 最初のずれ、以降はこれとの差をint32で持つ
+	int64_t fit_at;		   // 回帰の基準時刻（直近のサンプル）
+	double fit_offset;	   // fit_atでのずれ - base_offset [us]
+	double slope;		   // ずれの変化率
+};
+
+inline bool ClockSync::is_valid() { return count >= min_samples; }
+inline float ClockSync::get_drift() { return slope * 1e6; }
+inline uint32_t ClockSync::get_round_trip() { return count ? samples[head].round_trip : 0; }
@@ -0,0 +1,82 @@
+#include "CompactCodec.h"
+
+#include <math.h>
+#include <string.h>
+
+static int16_t to_millimeter(float meter) {
+	long v = lroundf(meter * COMPACT_POSITION_SCALE);
+	return v > 32767 ? 32767 : v < -32768 ? -32768 : v;
+}
+
+CompactEncoder::CompactEncoder() {
+	buffer   = nullptr;
+	capacity = 0;
+	length   = 0;
+	count	   = 0;
+}
+
+void CompactEncoder::begin(uint8_t* buffer, size_t capacity, uint16_t sequence, uint32_t timestamp) {
+	this->buffer   = buffer;
+	this->capacity = capacity;
+	length	     = header_length;
+	count		     = 0;
+
+	compact_header_t header = {COMPACT_MAGIC, COMPACT_VERSION, 0, sequence, 0, timestamp};
+	memcpy(buffer, &header, header_length);
+}
+
+bool CompactEncoder::add(uint8_t index, uint8_t flags, uint32_t age_us, Quaternion rotation, Vector3<float> position) {
+	size_t size = sizeof(compact_joint_t) + (flags & COMPACT_FLAG_POSITION ? sizeof(int16_t) * 3 : 0);
+	if (count >= COMPACT_MAX_JOINTS || length + size > capacity) return false;
+
+	uint32_t age		= age_us / BATCH_AGE_UNIT_US;
+	compact_joint_t joint = {index, flags, data_pack(rotation, age > 0xffff ? 0xffff : age)};
+	memcpy(buffer + length, &joint, sizeof(joint));
+
+	if (flags & COMPACT_FLAG_POSITION) {
+		int16_t p[3] = {to_millimeter(position.x), to_millimeter(position.y), to_millimeter(position.z)};
+		memcpy(buffer + length + sizeof(joint), p, sizeof(p));
+	}
+
+	length += size;
+	count++;
+	return true;
+}
+
+size_t CompactEncoder::end() {
+	buffer[offsetof(compact_header_t, count)] = count;
+	return length;
+}
+
+bool CompactDecoder::decode(const uint8_t* data, size_t length, compact_header_t* header, compact_pose_t* poses) {
+	if (length < sizeof(compact_header_t)) return false;
+	memcpy(header, data, sizeof(compact_header_t));
+	if (header->magic != COMPACT_MAGIC || header->version != COMPACT_VERSION || header->count > COMPACT_MAX_JOINTS) return false;
+
+	size_t offset = sizeof(compact_header_t);
+	for (int i = 0; i < header->count; i++) {
+		compact_joint_t joint;
+		if (offset + sizeof(joint) > length) return false;
+		memcpy(&joint, data + offset, sizeof(joint));
+		offset += sizeof(joint);
+
+		compact_pose_t* pose = poses + i;
+		pose->index		 = joint.index;
+		pose->flags		 = joint.flags;
+		pose->age			 = joint.rotation.age * BATCH_AGE_UNIT_US;
+		pose->rotation		 = data_unpack(joint.rotation);
+		pose->position		 = {0.0f, 0.0f, 0.0f};
+
+		if (joint.flags & COMPACT_FLAG_POSITION) {
+			int16_t p[3];
+			if (offset + sizeof(p) > length) return false;
+			memcpy(p, data + offset, sizeof(p));
+			offset += sizeof(p);
+
+			const float k  = 1.0f / COMPACT_POSITION_SCALE;
+			pose->position = {p[0] * k, p[1] * k, p[2] * k};
+		}
+	}
+
+	return offset == length;
+}
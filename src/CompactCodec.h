@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+// OSCの代わりに自前の受信側（Unity、記録用PC）へ送る、関節の姿勢をまとめたUDPデータグラム
+// compact_header_t の後に count 個の関節が続く、関節は compact_joint_t と、
+// COMPACT_FLAG_POSITION なら位置 int16_t[3] [mm] の 10 / 16byte、全てリトルエンディアン
+#define COMPACT_MAGIC 0x544a  // "JT"
+#define COMPACT_VERSION 1
+
+#define COMPACT_FLAG_POSITION 0x01	// 位置が続く
+#define COMPACT_FLAG_FIXED 0x02		// /VMT/Joint/Driver相当、無ければ/VMT/Follow/Driver相当
+#define COMPACT_FLAG_DISABLED 0x04	// トラッカーを無効にする
+#define COMPACT_FLAG_ROOM 0x08		// /VMT/Room/Driver相当、位置・姿勢はルームの座標系
+
+#define COMPACT_POSITION_SCALE 1000.0f	// [m] -> [mm]、±32m
+#define COMPACT_MAX_JOINTS 128
+
+struct compact_header_t {
+	uint16_t magic;	 // COMPACT_MAGIC
+	uint8_t version;	 // COMPACT_VERSION
+	uint8_t count;	 // 関節数
+	uint16_t sequence;	 // 送信先毎にデータグラム毎に加算
+	uint16_t reserved;
+	uint32_t timestamp;  // 送信時刻、Parent側esp_timer_get_time()の下位32bit [us]
+};
+
+struct compact_joint_t {
+	uint8_t index;			   // トラッカー番号
+	uint8_t flags;			   // COMPACT_FLAG_*
+	packed_quaternion_t rotation;  // ageは送信時刻からの遅れ [BATCH_AGE_UNIT_US]
+};
+
+/// 復元した関節
+struct compact_pose_t {
+	uint8_t index;
+	uint8_t flags;
+	uint32_t age;  // 送信時刻からの遅れ [us]
+	Quaternion rotation;
+	Vector3<float> position;  // COMPACT_FLAG_POSITIONが無ければ0
+};
+
+/// 渡したバッファに直接データグラムを組み立てる
+class CompactEncoder {
+    public:
+	CompactEncoder();
+
+	void begin(uint8_t* buffer, size_t capacity, uint16_t sequence, uint32_t timestamp);
+	/// 関節を追加します、バッファに収まらなければfalse
+	bool add(uint8_t index, uint8_t flags, uint32_t age_us, Quaternion rotation, Vector3<float> position);
+	/// 関節数をヘッダに書き込み、データグラムの長さを返します
+	size_t end();
+	/// 送信済みにします、次はbeginから
+	void reset();
+
+	uint8_t get_count();
+
+	static const size_t header_length = sizeof(compact_header_t);
+
+    private:
+	uint8_t* buffer;
+	size_t capacity;
+	size_t length;
+	uint8_t count;
+};
+
+inline uint8_t CompactEncoder::get_count() { return count; }
+inline void CompactEncoder::reset() { count = 0; }
+
+/// 受信側でデータグラムを復元する、ホスト側でもそのまま使える
+class CompactDecoder {
+    public:
+	/// ヘッダとposesに復元します、形式が違うか途中で切れていればfalse
+	/// posesはCOMPACT_MAX_JOINTS個分用意すること
+	static bool decode(const uint8_t* data, size_t length, compact_header_t* header, compact_pose_t* poses);
+};
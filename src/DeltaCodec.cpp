@@ -0,0 +1,92 @@
+#include "DeltaCodec.h"
+
+#include <string.h>
+
+DeltaEncoder::DeltaEncoder() {
+	head	    = 0;
+	count    = 0;
+	sequence = 0;
+
+	for (int i = 0; i < DELTA_SAMPLES; i++) {
+		timestamps[i] = 0;
+		samples[i]	   = Quaternion::identify();
+	}
+
+	keyframe	    = DELTA_NO_KEYFRAME;
+	acknowledged = DELTA_NO_KEYFRAME;
+	set_keyframe(Quaternion::identify());
+}
+
+void DeltaEncoder::set_keyframe(Quaternion q) {
+	// idは1 - 255を巡回する、0は「受け取り済みのキーフレーム無し」
+	keyframe		 = keyframe % 255 + 1;
+	key			 = data_pack(q, 0);
+	key_inverse	 = data_unpack(key).inverse();
+	since_keyframe = 0;
+}
+
+uint16_t DeltaEncoder::push(uint32_t timestamp, Quaternion q) {
+	head			   = (head + 1) % DELTA_SAMPLES;
+	timestamps[head] = timestamp;
+	samples[head]	   = q;
+	if (count < DELTA_SAMPLES) count++;
+
+	delta_sample_t delta;
+	if (++since_keyframe >= keyframe_interval || !delta_pack(key_inverse, q, 0, &delta)) set_keyframe(q);
+	return ++sequence;
+}
+
+void DeltaEncoder::acknowledge(uint8_t keyframe) { acknowledged = keyframe; }
+
+void DeltaEncoder::fill(data_delta_u* frame, uint8_t flags) {
+	bool keyed		= acknowledged != keyframe;
+	delta_sample_t* out = keyed ? frame->keyed_samples : frame->samples;
+	int capacity		= keyed ? DELTA_KEYED_SAMPLES : DELTA_SAMPLES;
+
+	frame->flags	    = keyed ? flags | DATA_FLAG_KEYFRAME : flags;
+	frame->sequence  = sequence;
+	frame->timestamp = timestamps[head];
+	frame->keyframe  = keyframe;
+	memset(frame->samples, 0, sizeof(frame->samples));
+	if (keyed) frame->key = key;
+
+	// キーフレームより前のサンプルは差分が収まらないことがあるので、そこで打ち切る
+	int n = 0;
+	for (; n < count && n < capacity; n++) {
+		int k		  = (head + DELTA_SAMPLES - n) % DELTA_SAMPLES;
+		uint32_t age = (timestamps[head] - timestamps[k]) / DELTA_AGE_UNIT_US;
+		if (age > 0xff || !delta_pack(key_inverse, samples[k], age, out + n)) break;
+	}
+	frame->count = n;
+
+	data_seal(frame);
+}
+
+DeltaDecoder::DeltaDecoder() { reset(); }
+
+void DeltaDecoder::reset() {
+	keyframe = DELTA_NO_KEYFRAME;
+	key		 = Quaternion::identify();
+}
+
+bool DeltaDecoder::decode(const data_delta_u* frame, uint32_t* timestamps, Quaternion* samples, uint8_t* count) {
+	const delta_sample_t* in = frame->samples;
+	int capacity			 = DELTA_SAMPLES;
+	if (frame->flags & DATA_FLAG_KEYFRAME) {
+		keyframe = frame->keyframe;
+		key		 = data_unpack(frame->key);
+		in		 = frame->keyed_samples;
+		capacity = DELTA_KEYED_SAMPLES;
+	} else if (frame->keyframe != keyframe) {
+		// 取りこぼしたキーフレームはget_keyframe()の通知で再送される
+		*count = 0;
+		return false;
+	}
+
+	*count = frame->count < capacity ? frame->count : capacity;
+	for (int i = 0; i < *count; i++) {
+		timestamps[i] = frame->timestamp - (uint32_t)in[i].age * DELTA_AGE_UNIT_US;
+		samples[i]	   = delta_unpack(key, in[i]);
+	}
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+/// Worker側で直近DELTA_SAMPLES個の姿勢を保持し、COMMAND_GET_DELTAの応答を作る
+/// 差分がint8に収まらなくなるか、keyframe_interval回更新する毎に新しいキーフレームにする
+class DeltaEncoder {
+    public:
+	DeltaEncoder();
+
+	/// AHRS更新毎に呼び出します、追加したサンプルの連番を返します
+	uint16_t push(uint32_t timestamp, Quaternion q);
+	/// Parentが受け取り済みのキーフレームid、スレーブタスクから呼び出してよい
+	void acknowledge(uint8_t keyframe);
+	/// 新しい順に詰めて、CRCまで書き込みます
+	void fill(data_delta_u* frame, uint8_t flags);
+
+	static const uint16_t keyframe_interval = 256;
+
+    private:
+	void set_keyframe(Quaternion q);
+
+	uint32_t timestamps[DELTA_SAMPLES];
+	Quaternion samples[DELTA_SAMPLES];
+	uint8_t head;
+	uint8_t count;
+	uint16_t sequence;
+
+	uint8_t keyframe;
+	packed_quaternion_t key;
+	Quaternion key_inverse;	// 量子化後のキーフレームの逆回転、Parentと同じ値を基準にする
+	uint16_t since_keyframe;
+	volatile uint8_t acknowledged;
+};
+
+/// Parent側でdata_delta_uから姿勢を復元する
+class DeltaDecoder {
+    public:
+	DeltaDecoder();
+
+	/// 受け取り済みのキーフレームid、COMMAND_GET_DELTA / COMMAND_ACK_KEYFRAMEの2byte目に使う
+	uint8_t get_keyframe();
+	/// キーフレームを破棄して、Workerに再送させる
+	void reset();
+
+	/// samplesに新しい順で復元します、基準のキーフレームを持っていなければfalse
+	bool decode(const data_delta_u* frame, uint32_t* timestamps, Quaternion* samples, uint8_t* count);
+
+    private:
+	uint8_t keyframe;
+	Quaternion key;
+};
+
+inline uint8_t DeltaDecoder::get_keyframe() { return keyframe; }
+
+/// キーフレームからの差分を量子化します、収まらなければfalse
+inline bool delta_pack(Quaternion key_inverse, Quaternion q, uint8_t age, delta_sample_t* delta) {
+	Quaternion d = key_inverse * q;
+	float k		 = d.w < 0.0f ? -DELTA_SCALE : DELTA_SCALE;
+	long x = lroundf(d.x * k), y = lroundf(d.y * k), z = lroundf(d.z * k);
+	if (x < -127 || x > 127 || y < -127 || y > 127 || z < -127 || z > 127) return false;
+
+	*delta = {(int8_t)x, (int8_t)y, (int8_t)z, age};
+	return true;
+}
+
+inline Quaternion delta_unpack(Quaternion key, delta_sample_t delta) {
+	const float k = 1.0f / DELTA_SCALE;
+	Quaternion d  = {delta.x * k, delta.y * k, delta.z * k, 0.0f};
+	float ww	  = 1.0f - d.x * d.x - d.y * d.y - d.z * d.z;
+	d.w		  = ww > 0.0f ? sqrtf(ww) : 0.0f;
+
+	Quaternion q = key * d;
+	q.normalize();
+	return q;
+}
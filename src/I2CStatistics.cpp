@@ -0,0 +1,84 @@
+#include "I2CStatistics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+I2CStatistics::I2CStatistics() { reset(); }
+
+void I2CStatistics::reset() {
+	memset(stats, 0, sizeof(stats));
+	count = 0;
+}
+
+int I2CStatistics::bucket(uint32_t latency_us) {
+	uint32_t v = latency_us >> 7;
+	int b	   = 0;
+	while (v && b < I2C_LATENCY_BUCKETS - 1) {
+		v >>= 1;
+		b++;
+	}
+	return b;
+}
+
+i2c_device_stat_t* I2CStatistics::slot(uint8_t address) {
+	for (int i = 0; i < count; i++) {
+		if (stats[i].address == address) return stats + i;
+	}
+	if (count >= I2C_STATISTICS_SLOTS) return nullptr;
+
+	i2c_device_stat_t* s = stats + count++;
+	s->address		 = address;
+	return s;
+}
+
+const i2c_device_stat_t* I2CStatistics::find(uint8_t address) {
+	for (int i = 0; i < count; i++) {
+		if (stats[i].address == address) return stats + i;
+	}
+	return nullptr;
+}
+
+void I2CStatistics::record(uint8_t address, esp_err_t result, uint32_t latency_us) {
+	i2c_device_stat_t* s = slot(address);
+	if (s == nullptr) return;
+
+	s->transactions++;
+	switch (result) {
+		case ESP_OK:
+			break;
+		case ESP_FAIL:	// ACKが返らなかった
+			s->nacks++;
+			break;
+		case ESP_ERR_TIMEOUT:
+			s->timeouts++;
+			break;
+		default:
+			s->errors++;
+			break;
+	}
+
+	s->latency_sum += latency_us;
+	if (s->latency_max < latency_us) s->latency_max = latency_us;
+	s->histogram[bucket(latency_us)]++;
+}
+
+void I2CStatistics::retry(uint8_t address) {
+	i2c_device_stat_t* s = slot(address);
+	if (s != nullptr) s->retries++;
+}
+
+size_t I2CStatistics::format(char* buffer, size_t length) {
+	size_t n = 0;
+	for (int i = 0; i < count && n < length; i++) {
+		i2c_device_stat_t* s = stats + i;
+		uint32_t average	 = s->transactions ? s->latency_sum / s->transactions : 0;
+
+		n += snprintf(buffer + n, length - n, "%3d: n=%u nack=%u to=%u err=%u retry=%u avg=%uus max=%uus [",
+				    s->address, s->transactions, s->nacks, s->timeouts, s->errors, s->retries, average, s->latency_max);
+		for (int b = 0; b < I2C_LATENCY_BUCKETS && n < length; b++) {
+			n += snprintf(buffer + n, length - n, b ? " %u" : "%u", s->histogram[b]);
+		}
+		if (n < length) n += snprintf(buffer + n, length - n, "]\n");
+	}
+	return n < length ? n : length;
+}
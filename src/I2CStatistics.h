@@ -0,0 +1,51 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define I2C_STATISTICS_SLOTS 16
+#define I2C_LATENCY_BUCKETS 8
+
+/// スレーブアドレス毎の集計値
+/// histogram[n] は 128us << n 未満（最後のバケットはそれ以上全て）の回数
+struct i2c_device_stat_t {
+	uint8_t address;
+	uint32_t transactions;
+	uint32_t nacks;
+	uint32_t timeouts;
+	uint32_t errors;
+	uint32_t retries;
+	uint32_t latency_max;
+	uint64_t latency_sum;
+	uint32_t histogram[I2C_LATENCY_BUCKETS];
+};
+
+/// I2Cトランザクションの集計、書き込みは1タスクからのみ行うこと
+/// ハードウェアに依存しないので、ホスト側でもそのまま使える
+class I2CStatistics {
+    public:
+	I2CStatistics();
+
+	void record(uint8_t address, esp_err_t result, uint32_t latency_us);
+	void retry(uint8_t address);
+	void reset();
+
+	const i2c_device_stat_t* find(uint8_t address);
+	const i2c_device_stat_t* get(int index);
+	size_t size();
+
+	/// 1アドレス1行のテキストに整形します、書き込んだ文字数を返します
+	size_t format(char* buffer, size_t length);
+
+	static int bucket(uint32_t latency_us);
+
+    private:
+	i2c_device_stat_t* slot(uint8_t address);
+
+	i2c_device_stat_t stats[I2C_STATISTICS_SLOTS];
+	size_t count;
+};
+
+inline const i2c_device_stat_t* I2CStatistics::get(int index) { return stats + index; }
+inline size_t I2CStatistics::size() { return count; }
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "BusScheduler.h"
+#include "I2CStatistics.h"
+#include "OneEuroFilter.h"
+#include "OscSender.h"
+#include "Skeleton.h"
+#include "WorkerLink.h"
+#include "i2cqueue.h"
+
+// 1回のpollで投入する要求の上限、I2CQueueの深さと同じ
+#define JOINT_POLLER_BATCH 8
+
+/// Parentがポーリングする可動関節1つ分
+struct polled_joint_t {
+	WorkerLink link;
+	OneEuroFilter smoothing;
+	ESPIDF::I2CQueue* queue;
+	QueueHandle_t done;  // 要求の完了通知先
+	uint8_t address;
+	uint8_t tracker_index;
+	uint8_t output;			    // OSC_MESSAGE_FOLLOW / ROOM
+	int8_t node;			    // Skeletonの関節番号
+	const osc_string_t* serial;  // 追従するトラッカー
+	Quaternion rotation;		    // 最後に受け取った姿勢
+	Quaternion smoothed;		    // 平滑化した姿勢、calibrate / xy_correctionの前
+	Quaternion calibrate;
+	Quaternion xy_correction;
+	bool busy;
+	int64_t submitted_at;
+	bool sampled;		  // 1度でも姿勢を受け取った
+	uint8_t protocol;	  // smoothingに与えたサンプル時刻のプロトコル、変われば平滑化をやり直す
+	int64_t sampled_at;	  // 最新の姿勢のサンプル時刻、時計のずれが分かるまでは0
+};
+
+/// 要求が完了する毎に、姿勢を反映した後で呼ばれる、表示や計測用
+/// freshはdecodeで増えたサンプル数、resultがESP_OK以外なら0
+typedef void (*poll_observer_t)(void* context, polled_joint_t* joint, esp_err_t result, size_t fresh, int64_t now);
+
+/// Parentのloop()で行うWorkerのポーリング一式、実機のParentとシミュレータで共通
+/// 同期・ping・テレメトリの要求、期限が来たWorkerへの要求の投入、応答の復元と平滑化、
+/// Skeletonへの反映と、位置を求め直した関節のOscSenderへの追加までを1回のpollで行う
+/// addとpollはloop()を回す1タスクからのみ呼び出すこと
+class JointPoller {
+    public:
+	JointPoller(OscSender* sender, Skeleton* skeleton, uint32_t rate_hz);
+
+	/// 関節を追加します、nodeやserialなどSkeleton側の設定は呼び出し側で埋める
+	/// reply / stagedはWorkerLink::begin、adaptiveはWorkerLink::set_adaptiveと同じ
+	polled_joint_t* add(uint8_t address, ESPIDF::I2CQueue* queue, uint8_t reply = COMMAND_GET_BATCH, bool staged = true, uint8_t adaptive = 0);
+	/// 全Workerに同じ時刻の姿勢を保持させる頻度、0なら同期しない
+	void set_sync_rate(uint32_t rate_hz);
+	void set_observer(poll_observer_t observer, void* context);
+	/// falseの間は姿勢を受け取ってもOSCに送らない、再開すると変わった関節をまとめて送る
+	void set_enable(bool enable);
+
+	/// loop()から毎回呼び出します
+	void poll();
+
+	polled_joint_t* get(int index);
+	int index_of(const polled_joint_t* joint);
+	size_t size();
+	/// 投入から完了までのポーリング単位の統計
+	I2CStatistics* get_statistics();
+	/// OscSenderに追加した姿勢の数
+	uint32_t get_poses();
+	/// 直近の同期のidと指定時刻
+	uint8_t get_sync_id();
+	int64_t get_sync_target();
+
+	/// Workerが応答しない場合でもフレーム全体を止めない程度の期限
+	static const TickType_t timeout = 20 / portTICK_PERIOD_MS;
+	/// 前回値との内積がこれを下回れば動いたとみなす（約1度）
+	static constexpr float motion_threshold_dot = 0.99996f;
+	/// 同期の要求から指定時刻までの余裕、全Workerへの書き込みが終わる程度
+	static const int64_t sync_lead_us = 10000;
+	/// 指定時刻からWorkerのAHRS更新を待って読み出すまでの時間
+	static const int64_t sync_collect_us = 2000;
+	/// 1関節あたりの時計のずれを測る頻度
+	static const uint32_t ping_rate_hz = 4;
+	/// 1関節あたりのWorkerの動作状況を読み出す頻度
+	static const uint32_t telemetry_rate_hz = 1;
+
+    private:
+	static void on_complete(ESPIDF::i2c_request_t* request);
+	void request_rounds();
+	int submit();
+	bool complete(polled_joint_t* joint);
+	void send();
+
+	OscSender* sender;
+	Skeleton* skeleton;
+	BusScheduler scheduler;
+	I2CStatistics statistics;
+	QueueHandle_t done;
+	polled_joint_t joints[BUS_SCHEDULER_MAX_SLOTS];
+	size_t count;
+	VMTJointArgument_t arguments;
+	uint32_t poses;
+
+	poll_observer_t observer;
+	void* context;
+
+	uint32_t sync_rate;
+	uint8_t sync_id;
+	int64_t sync_target;
+	int64_t next_sync;
+	int64_t next_ping;
+	int ping_index;
+	int64_t next_telemetry;
+	int telemetry_index;
+};
+
+inline void JointPoller::set_sync_rate(uint32_t rate_hz) { sync_rate = rate_hz; }
+inline void JointPoller::set_enable(bool enable) { arguments.enable = enable; }
+inline polled_joint_t* JointPoller::get(int index) { return joints + index; }
+inline int JointPoller::index_of(const polled_joint_t* joint) { return joint - joints; }
+inline size_t JointPoller::size() { return count; }
+inline I2CStatistics* JointPoller::get_statistics() { return &statistics; }
+inline uint32_t JointPoller::get_poses() { return poses; }
+inline uint8_t JointPoller::get_sync_id() { return sync_id; }
+inline int64_t JointPoller::get_sync_target() { return sync_target; }
+
+inline JointPoller::JointPoller(OscSender* sender, Skeleton* skeleton, uint32_t rate_hz) : scheduler(rate_hz) {
+	this->sender   = sender;
+	this->skeleton = skeleton;
+	done		   = xQueueCreate(JOINT_POLLER_BATCH, sizeof(polled_joint_t*));
+	count		   = 0;
+	arguments	   = {nullptr,			    // Serial
+			  1.0f, 0.0f, 0.0f, 0.0f,  // qw, qz, qy, qx
+			  0.0f, 1.0f, 0.0f,		    // z, y, x
+			  0.0f, 1, 0};			    // time, enable, index
+	poses		   = 0;
+	observer	   = nullptr;
+	context	   = nullptr;
+
+	sync_rate	    = 0;
+	sync_id	    = 0;
+	sync_target	    = 0;
+	next_sync	    = 0;
+	next_ping	    = 0;
+	ping_index	    = 0;
+	next_telemetry  = 0;
+	telemetry_index = 0;
+}
+
+inline void JointPoller::set_observer(poll_observer_t observer, void* context) {
+	this->observer = observer;
+	this->context  = context;
+}
+
+inline polled_joint_t* JointPoller::add(uint8_t address, ESPIDF::I2CQueue* queue, uint8_t reply, bool staged, uint8_t adaptive) {
+	if (scheduler.add(address) < 0) return nullptr;
+
+	polled_joint_t* j = joints + count++;
+	j->queue		   = queue;
+	j->done		   = done;
+	j->address	   = address;
+	j->tracker_index  = 0;
+	j->output		   = OSC_MESSAGE_ROOM;
+	j->node		   = -1;
+	j->serial		   = nullptr;
+	j->rotation	   = Quaternion::identify();
+	j->smoothed	   = Quaternion::identify();
+	j->calibrate	   = Quaternion::identify();
+	j->xy_correction  = Quaternion::identify();
+	j->busy		   = false;
+	j->submitted_at   = 0;
+	j->sampled	   = false;
+	j->protocol	   = 0;
+	j->sampled_at	   = 0;
+
+	j->link.set_adaptive(adaptive);
+	j->link.begin(address, on_complete, j, reply, staged);
+	return j;
+}
+
+inline void JointPoller::on_complete(ESPIDF::i2c_request_t* request) {
+	polled_joint_t* j = (polled_joint_t*)request->context;
+	xQueueSend(j->done, &j, 0);
+}
+
+inline void JointPoller::poll() {
+	request_rounds();
+
+	int submitted = submit();
+	bool moved	  = false;
+	polled_joint_t* j;
+	for (int n = 0; n < submitted; n++) {
+		if (xQueueReceive(done, &j, timeout) != pdTRUE) break;
+		moved |= complete(j);
+	}
+
+	if (moved && arguments.enable) send();
+	// このフレームのOSCメッセージは送信タスクが1つのデータグラムにまとめて送る
+	sender->end_frame();
+}
+
+inline void JointPoller::request_rounds() {
+	if (count == 0) return;
+
+	// 全Workerに同じ時刻の姿勢を保持させる
+	if (sync_rate > 0 && esp_timer_get_time() >= next_sync) {
+		sync_id	  = sync_id % 255 + 1;
+		sync_target = esp_timer_get_time() + sync_lead_us;
+		for (int i = 0; i < count; i++) joints[i].link.sync(joints[i].queue, sync_id, sync_target, timeout);
+		next_sync = esp_timer_get_time() + 1000000 / sync_rate;
+	}
+
+	// 関節を順番に回って、時計のずれを測る
+	if (esp_timer_get_time() >= next_ping) {
+		polled_joint_t* j = joints + ping_index;
+		j->link.ping(j->queue, timeout);
+		ping_index = (ping_index + 1) % count;
+		next_ping	= esp_timer_get_time() + 1000000 / (ping_rate_hz * count);
+	}
+
+	// 同様に、Workerの動作状況を読み出す
+	if (esp_timer_get_time() >= next_telemetry) {
+		polled_joint_t* j = joints + telemetry_index;
+		// 前回読み出した結果を送ってから、次を要求する
+		const data_telemetry_u* t = j->link.get_telemetry();
+		if (t->version == PROTOCOL_VERSION_2) {
+			OscTelemetryArgument_t telemetry = {j->address, j->link.get_health(), t->fusion_rate, t->sample_age, t->temperature,
+										 (int32_t)(t->imu_errors + t->slave_errors + t->command_errors)};
+			sender->add_telemetry(&telemetry);
+		}
+		j->link.request_telemetry(j->queue, timeout);
+		telemetry_index = (telemetry_index + 1) % count;
+		next_telemetry	 = esp_timer_get_time() + 1000000 / (telemetry_rate_hz * count);
+	}
+}
+
+inline int JointPoller::submit() {
+	// 保持した姿勢は指定時刻を過ぎたら順番を待たずに読み出す
+	// 残りは期限が来たWorkerへの要求を優先度順に投入する
+	uint8_t due[JOINT_POLLER_BATCH];
+	size_t due_count = 0;
+	if (esp_timer_get_time() >= sync_target + sync_collect_us) {
+		for (int i = 0; i < count && due_count < JOINT_POLLER_BATCH; i++) {
+			if (joints[i].link.is_sync_pending() && !joints[i].busy) due[due_count++] = i;
+		}
+	}
+	due_count += scheduler.schedule(esp_timer_get_time(), due + due_count, JOINT_POLLER_BATCH - due_count);
+
+	int submitted = 0;
+	for (int i = 0; i < due_count; i++) {
+		polled_joint_t* j = joints + due[i];
+		if (j->busy) continue;
+
+		j->submitted_at = esp_timer_get_time();
+		j->busy		 = j->queue->submit(j->link.get_request(), timeout);
+		if (!j->busy) continue;
+		submitted++;
+		scheduler.commit(due[i], j->submitted_at);
+	}
+	return submitted;
+}
+
+inline bool JointPoller::complete(polled_joint_t* j) {
+	j->busy = false;
+
+	int64_t now   = esp_timer_get_time();
+	int index     = j - joints;
+	esp_err_t err = j->link.get_request()->result;
+	size_t fresh  = 0;
+	if (err == ESP_OK) err = j->link.decode(&fresh);
+	statistics.record(j->address, err, now - j->submitted_at);
+
+	if (err != ESP_OK) {
+		scheduler.report(index, now, false, false);
+	} else if (fresh == 0) {
+		// 前回と同じサンプルは送り直さない
+		scheduler.report(index, now, true, false, j->link.is_unchanged());
+	} else {
+		Quaternion q = j->link.get_rotation();
+		float dot	 = fabsf(q.x * j->rotation.x + q.y * j->rotation.y + q.z * j->rotation.z + q.w * j->rotation.w);
+		scheduler.report(index, now, true, dot < motion_threshold_dot, j->link.is_unchanged());
+		j->rotation = q;
+		j->sampled  = true;
+
+		// 受け取った全てのサンプルを古い順に平滑化する、v1はサンプル時刻が無いので受け取った時刻で
+		// v1とv2ではWorkerとParentの時計で時刻が繋がらないので、切り替わればやり直す
+		if (j->protocol != j->link.get_protocol()) {
+			j->protocol = j->link.get_protocol();
+			j->smoothing.reset();
+		}
+		const worker_sample_t* samples = j->link.get_samples();
+		for (size_t i = 0; i < fresh; i++) j->smoothed = j->smoothing.filter(samples[i].time ? samples[i].time : (uint32_t)now, samples[i].q);
+
+		ClockSync* clock = j->link.get_clock();
+		// v1のサンプルには時刻が無い（0）、to_parentで戻すと任意の時刻になるので受け取った時刻として扱わせる
+		j->sampled_at	 = clock->is_valid() && samples[fresh - 1].time ? clock->to_parent(samples[fresh - 1].time) : 0;
+		skeleton->set_rotation(j->node, j->xy_correction * (j->smoothed * j->calibrate));
+	}
+
+	if (observer) observer(context, j, err, fresh, now);
+	return err == ESP_OK && fresh > 0;
+}
+
+inline void JointPoller::send() {
+	// 新しい姿勢を受け取った関節と、それに繋がる子の関節だけ位置を求め直して送る
+	// 固定関節を1度だけ送るのと同じく、変わらない関節は送り直さない
+	skeleton->update();
+	for (int i = 0; i < count; i++) {
+		polled_joint_t* j = joints + i;
+		if (!j->sampled || !skeleton->is_dirty(j->node)) continue;
+
+		// 時間補正はサンプル時刻からの経過時間（負の値）、時計のずれが分かるまでは0
+		arguments.serial = j->serial;
+		arguments.index	 = j->tracker_index;
+		arguments.time	 = j->sampled_at ? (j->sampled_at - esp_timer_get_time()) * 1e-6f : 0.0f;
+		arguments.set(skeleton->get_rotation(j->node), skeleton->get_position(j->node));
+		if (j->output == OSC_MESSAGE_ROOM) {
+			sender->add_room(&arguments, j->sampled_at, skeleton->get_base(j->node));
+		} else {
+			sender->add_follow(&arguments, j->sampled_at, skeleton->get_base(j->node));
+		}
+		poses++;
+	}
+	skeleton->clean();
+}
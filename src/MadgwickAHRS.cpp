@@ -178,16 +178,22 @@ void MadgwickAHRS::update(Vector3<float> g, Vector3<float> a, Vector3<float> m)
 */
 
 void MadgwickAHRS::update(Vector3<float> g, Vector3<float> a) {
+	if (a.Dot2() <= 0.002f * 0.002f) return;  // 更新しない場合は時刻も進めない
+
+	int64_t t = esp_timer_get_time();
+	float dt	= (t - time) / 1000000.0f;
+	time		= t;
+
+	update(g, a, dt);
+}
+
+void MadgwickAHRS::update(Vector3<float> g, Vector3<float> a, float dt) {
 	// Normalise accelerometer measurement
 	float norm = sqrtf(a.Dot2());
 	if (norm <= 0.002f) return;  // handle NaN
 	norm = 1.0f / norm;		    // use reciprocal for division
 	a *= norm;
 
-	int64_t t = esp_timer_get_time();
-	float dt	= (t - time) / 1000000.0f;
-	time		= t;
-
 	// Auxiliary variables to avoid repeated arithmetic
 	Quaternion qq = q.Dot(q);
 
@@ -200,7 +206,9 @@ void MadgwickAHRS::update(Vector3<float> g, Vector3<float> a) {
 	    q.y * qqwz - 0.5f * (q.z * a.y - q.w * a.x) + q.y * (-1.0f + 2.0f * qq.x + 2.0f * qq.y + a.z),
 	    q.z * qqxy - 0.5f * (q.x * a.x + q.y * a.y),
 	    q.w * qqxy - 0.5f * (q.x * a.y - q.y * a.x)};
-	s.normalize();
+	// 推定と加速度が完全に一致すると勾配が0になる、正規化するとNaNになるので補正しない
+	float snorm = s.x * s.x + s.y * s.y + s.z * s.z + s.w * s.w;
+	if (snorm > 0.0f) s = s * (1.0f / sqrtf(snorm));
 
 	// Compute rate of change of quaternion
 	Quaternion qdot = {+q.w * g.x + q.y * g.z - q.z * g.y,
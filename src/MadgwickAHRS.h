@@ -7,6 +7,8 @@ class MadgwickAHRS : public IAHRS {
 	MadgwickAHRS(float beta);
 	virtual void update(Vector3<float> gyro, Vector3<float> accel, Vector3<float> magnitude);
 	virtual void update(Vector3<float> gyro, Vector3<float> accel);
+	/// サンプル間隔dt [s] を与えて更新します（Parent側でWorkerのIMUの値から計算する場合）
+	void update(Vector3<float> gyro, Vector3<float> accel, float dt);
 
 	virtual void reset();
 
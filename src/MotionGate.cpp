@@ -0,0 +1,39 @@
+#include "MotionGate.h"
+
+#include <math.h>
+
+MotionGate::MotionGate() {
+	threshold_dot = 0.0f;
+	anchor	    = Quaternion::identify();
+	since	    = 0;
+	idle		    = false;
+}
+
+void MotionGate::set_threshold(uint8_t tenth_degrees) {
+	// 回転角θの2つの姿勢の内積は cos(θ/2)
+	const float half_radian = 3.1415926535897932384626433832795f / 180.0f * 0.1f * 0.5f;
+	threshold_dot			= tenth_degrees ? cosf(tenth_degrees * half_radian) : 0.0f;
+}
+
+bool MotionGate::update(uint16_t sequence, Quaternion q) {
+	float threshold = threshold_dot;
+	float dot		= fabsf(anchor.x * q.x + anchor.y * q.y + anchor.z * q.z + anchor.w * q.w);
+	if (threshold <= 0.0f || dot < threshold) {
+		anchor = q;
+		since  = sequence;
+		idle	  = false;
+		return false;
+	}
+
+	if (!idle && (uint16_t)(sequence - since) >= settle) idle = true;
+	return idle;
+}
+
+void MotionGate::fill(data_status_u* status, uint8_t flags, uint16_t sequence, uint32_t timestamp, Quaternion q) {
+	status->flags	  = flags | DATA_FLAG_UNCHANGED;
+	status->sequence  = sequence;
+	status->timestamp = timestamp;
+	status->since	  = since;
+	status->ahrs	  = data_pack(q, 0);
+	data_seal(status);
+}
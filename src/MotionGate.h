@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+/// Worker側で姿勢がしきい値以上変化したかを判定する（COMMAND_SET_ADAPTIVE）
+/// 最後に変化したサンプルを基準にし、settle回続けて変化が無ければ静止とみなす
+class MotionGate {
+    public:
+	MotionGate();
+
+	/// しきい値 [0.1度]、0なら常に変化ありとする、スレーブタスクから呼び出してよい
+	void set_threshold(uint8_t tenth_degrees);
+	/// AHRS更新毎に呼び出します、静止中ならtrue
+	bool update(uint16_t sequence, Quaternion q);
+	/// 静止中の短い応答を作ります
+	void fill(data_status_u* status, uint8_t flags, uint16_t sequence, uint32_t timestamp, Quaternion q);
+
+	static const uint16_t settle = 16;
+
+    private:
+	volatile float threshold_dot;  // 基準との内積がこれを下回れば変化あり、0以下なら無効
+	Quaternion anchor;
+	uint16_t since;	// 基準にしたサンプルの連番
+	bool idle;
+};
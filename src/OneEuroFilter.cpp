@@ -0,0 +1,66 @@
+#include "OneEuroFilter.h"
+
+#include <math.h>
+
+// カットオフ周波数 cutoff [Hz] の1次ローパスの、間隔 dt [s] での係数
+static float smoothing(float cutoff, float dt) {
+	float tau = 1.0f / (2.0f * 3.1415926535897932384626433832795f * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+OneEuroFilter::OneEuroFilter() {
+	min_cutoff = 0.0f;
+	beta	     = 0.0f;
+	reset();
+}
+
+void OneEuroFilter::set_parameters(float min_cutoff, float beta) {
+	this->min_cutoff = min_cutoff > 0.0f ? min_cutoff : 0.0f;
+	this->beta	      = beta > 0.0f ? beta : 0.0f;
+}
+
+void OneEuroFilter::reset() {
+	valid	    = false;
+	last_time = 0;
+	raw	    = Quaternion::identify();
+	value	    = Quaternion::identify();
+	speed	    = 0.0f;
+}
+
+Quaternion OneEuroFilter::filter(uint32_t time, Quaternion q) {
+	float cutoff = min_cutoff;
+	if (cutoff <= 0.0f) {
+		valid = false;
+		return q;
+	}
+
+	// v2からv1に切り替えた場合など、サンプル時刻の時計が変わると大きく戻る
+	// 戻った時刻を過ぎるまで出力が止まらないよう、間が空いた場合と同じくやり直す
+	int32_t dt_us = time - last_time;
+	if (valid && dt_us <= 0 && dt_us >= -(int32_t)max_rewind_us) return value;
+	if (!valid || dt_us <= 0 || (uint32_t)dt_us > max_gap_us) {
+		valid	    = true;
+		last_time = time;
+		raw	    = q;
+		value	    = q;
+		speed	    = 0.0f;
+		return q;
+	}
+	float dt = dt_us * 1e-6f;
+
+	// 前回の入力からの回転角 2acos(|q・raw|) を角速度にし、平滑化する
+	float dot	  = q.x * raw.x + q.y * raw.y + q.z * raw.z + q.w * raw.w;
+	float angle = 2.0f * acosf(fminf(fabsf(dot), 1.0f));
+	speed += (angle / dt - speed) * smoothing(derivative_cutoff, dt);
+
+	// 前回の出力からcutoffに応じた割合だけ近づける、間隔が短く回転も小さいので正規化した線形補間で十分
+	float a = smoothing(cutoff + beta * speed, dt);
+	if (q.x * value.x + q.y * value.y + q.z * value.z + q.w * value.w < 0.0f) q *= -1.0f;
+	value = Quaternion::xyzw(value.x + (q.x - value.x) * a, value.y + (q.y - value.y) * a,
+					     value.z + (q.z - value.z) * a, value.w + (q.w - value.w) * a);
+	value.normalize();
+
+	raw	    = q;
+	last_time = time;
+	return value;
+}
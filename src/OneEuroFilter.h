@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+
+/// One Euro Filterをクォータニオンに適用する、関節毎に1つ持つ
+/// 角速度を平滑化し、静止中は低いカットオフで揺れを抑え、速く動くほどカットオフを上げて遅れを減らす
+class OneEuroFilter {
+    public:
+	OneEuroFilter();
+
+	/// min_cutoff: 静止中のカットオフ周波数 [Hz]、0で平滑化しない
+	/// beta: 角速度 1rad/s 毎に上げるカットオフ周波数 [Hz]
+	/// 設定用のタスクから呼び出してよい
+	void set_parameters(float min_cutoff, float beta);
+	/// time: サンプル時刻 [us]、前回以前の時刻なら前回の出力を返します
+	/// max_rewind_usより前に戻った場合は時計が変わったとみなし、平滑化をやり直します
+	Quaternion filter(uint32_t time, Quaternion q);
+	void reset();
+
+	float get_min_cutoff();
+	float get_beta();
+
+	static constexpr float derivative_cutoff = 1.0f;  // 角速度のカットオフ周波数 [Hz]
+	static const uint32_t max_gap_us		   = 100000;  // これより間が空けば平滑化をやり直す
+	static const uint32_t max_rewind_us	   = 10000;	  // これより前に戻れば平滑化をやり直す
+
+    private:
+	volatile float min_cutoff;
+	volatile float beta;
+
+	bool valid;
+	uint32_t last_time;
+	Quaternion raw;	 // 前回の入力
+	Quaternion value;	 // 前回の出力
+	float speed;		 // 平滑化した角速度 [rad/s]
+};
+
+inline float OneEuroFilter::get_min_cutoff() { return min_cutoff; }
+inline float OneEuroFilter::get_beta() { return beta; }
@@ -1,13 +1,46 @@
 #pragma once
 
 #include <WiFiUdp.h>
+#include <esp_timer.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "CompactCodec.h"
+#include "Snapshot.h"
 #include "Vector3.h"
 
+#define OSC_STRING_CAPACITY 32
+#define OSC_DESTINATIONS 4
+
+// 送信先毎に送るメッセージの種類
+#define OSC_MESSAGE_JOINT 0x01	   // /VMT/Joint/Driver
+#define OSC_MESSAGE_FOLLOW 0x02	   // /VMT/Follow/Driver
+#define OSC_MESSAGE_TELEMETRY 0x04  // /JointTracker/Telemetry
+#define OSC_MESSAGE_ROOM 0x08	   // /VMT/Room/Driver
+#define OSC_MESSAGE_ALL 0x0f
+// 送信先の形式、OSCの代わりにCompactCodecで姿勢のみ送る（テレメトリは送らない）
+#define OSC_FORMAT_COMPACT 0x10
+#define OSC_FORMAT_NO_POSITION 0x20	 // OSC_FORMAT_COMPACTで位置を省く
+
+#define OSC_LATENCY_BUCKETS 8
+
+/// 4byte境界まで\0で埋めたOSCの文字列、設定時に1度だけ作る
+struct osc_string_t {
+	uint8_t length;  // \0を含めた長さ、4の倍数
+	char text[OSC_STRING_CAPACITY];
+
+	void set(const char* value) {
+		size_t n = value ? strnlen(value, OSC_STRING_CAPACITY - 1) : 0;
+		memset(text, 0, sizeof(text));
+		if (n) memcpy(text, value, n);
+		length = (n & ~(size_t)0b11) + 4;
+	}
+};
+
 struct VMTJointArgument_t {
-	const char * serial;
+	const osc_string_t * serial;  // nullptrなら空文字列
 	float qw;
 	float qz;
 	float qy;
@@ -31,84 +64,453 @@ struct VMTJointArgument_t {
 	}
 };
 
-union VMTJointArgument_u {
-	uint8_t raw[sizeof(VMTJointArgument_t)];
-	VMTJointArgument_t data;
+/// Workerの動作状況、data_telemetry_uから必要なものだけ送る
+struct OscTelemetryArgument_t {
+	int32_t address;
+	int32_t health;		// WORKER_HEALTH_*
+	int32_t rate;		// AHRSの更新レート [Hz]
+	int32_t age;		// 最新サンプルの遅れ [us]
+	int32_t temperature;  // 0.01度、TELEMETRY_NO_TEMPERATUREなら不明
+	int32_t errors;		// IMU読み出し・TX FIFOへの書き込み・不明なコマンドのエラー数の合計
+};
+
+/// 直近stat_window_usの送信の集計
+/// histogram[n] は endPacket が 64us << n 未満（最後のバケットはそれ以上全て）で戻った回数
+struct osc_send_stat_t {
+	uint32_t window_us;	  // 集計した期間、送信タスクの起床が遅れればstat_window_usより長い
+	uint32_t datagrams;	  // 送信を試みたデータグラム数
+	uint32_t bytes;	  // 送信できたバイト数
+	uint32_t failures;	  // beginPacket / write / endPacket のいずれかが失敗した数、lwIPのバッファ不足など
+	uint32_t failures_total;  // 起動からの失敗数
+	uint32_t latency_max;	  // endPacketが戻るまでの時間 [us]
+	uint64_t latency_sum;
+	uint32_t histogram[OSC_LATENCY_BUCKETS];
+
+	/// 集計期間の回数・バイト数を1秒あたりに直す
+	uint32_t per_second(uint32_t count) const { return window_us ? (uint64_t)count * 1000000 / window_us : 0; }
 };
 
+/// OSCの引数をビッグエンディアンでバッファに直接書き込む
+inline uint8_t * osc_put_int32(uint8_t * p, int32_t value) {
+	uint32_t v = __builtin_bswap32((uint32_t)value);
+	memcpy(p, &v, 4);
+	return p + 4;
+}
+
+inline uint8_t * osc_put_float(uint8_t * p, float value) {
+	uint32_t v;
+	memcpy(&v, &value, 4);
+	v = __builtin_bswap32(v);
+	memcpy(p, &v, 4);
+	return p + 4;
+}
+
+inline uint8_t * osc_put_string(uint8_t * p, const osc_string_t * value) {
+	if (!value) {
+		memset(p, 0, 4);
+		return p + 4;
+	}
+	memcpy(p, value->text, value->length);
+	return p + value->length;
+}
+
+/// 複数の送信先に、それぞれ指定した種類のメッセージを送る
+/// メッセージは1度だけエンコードし、他の送信先にはバイト列をコピーする
 class OscClient {
     public:
+	/// 送信先0（VMT）に姿勢のメッセージを送る
 	OscClient(const uint8_t* address, uint16_t port);
 	size_t send_joint(VMTJointArgument_t* arguments);
 	size_t send_follow(VMTJointArgument_t* arguments);
+	/// ルートのトラッカーが無い場合に、ルームの座標系で送る、serialは使わない
+	size_t send_room(VMTJointArgument_t* arguments);
+	size_t send_telemetry(OscTelemetryArgument_t* arguments);
 	void reconnect();
 
+	/// 送信先を設定します、messagesはOSC_MESSAGE_*とOSC_FORMAT_*の組み合わせ（0で送信しない）
+	/// dividerフレームに1回だけ送る、フレームはバンドル毎（バンドルしない場合はメッセージ毎）
+	bool set_destination(int index, const uint8_t* address, uint16_t port, uint8_t messages, uint8_t divider = 1);
+
+	/// end_bundleまでのsend_*を送信先毎に1つの#bundleにまとめて、1データグラムで送信する
+	/// bundle_limitに収まらなくなった場合は、それまでの分を先に送信する
+	void begin_bundle();
+	/// まとめたメッセージを送信します、このバンドルで送信したデータグラム数を返す
+	size_t end_bundle();
+
+	/// 集計の区切りを過ぎていれば、直近の集計を確定します
+	/// 送信が止まっても集計が古いまま残らないよう、送信するタスクが送信の有無に関わらず定期的に呼ぶ
+	void tick();
+	/// 直近に完了した送信の集計をコピーし、集計した回数を返します、どのタスクから呼び出してもよい
+	uint32_t read_statistics(osc_send_stat_t* stat);
+	/// 1行のテキストに整形します、書き込んだ文字数を返します
+	static size_t format(const osc_send_stat_t* stat, char* buffer, size_t length);
+	static int bucket(uint32_t latency_us);
+
+	/// 1つのOSCメッセージをbufferに書き込み、長さを返します、bufferはmessage_limit以上
+	/// 送信せずに形式だけ確かめる場合（ベンチマーク、テスト）にも使う
+	static size_t encode(uint8_t kind, const void* arguments, uint8_t * buffer);
+
+	/// WiFiUDPの送信バッファの大きさ、MTU 1500のUDPにも収まる
+	static const size_t bundle_limit = 1460;
+	/// 1つのメッセージの最大長、アドレスパターンとタグ文字列36byte + 引数40byte + シリアル
+	static const size_t message_limit = 36 + 40 + OSC_STRING_CAPACITY;
+	static const uint32_t stat_window_us = 1000000;
+
     private:
-	WiFiUDP udp;
-	IPAddress * address;
-	int port;
-
-	size_t send(VMTJointArgument_u* arguments, uint8_t * base_buffer);
-//	uint8_t buffer[84] = "/VMT/Joint/Driver\0,iiffffffffi\0";
-	uint8_t joint_buffer[36 + sizeof(VMTJointArgument_t) + 32] = { // テキストバッファとして32バイト
-	//	00   01   02   03     04   05   06   07     08   09   0a   0b     0c   0d   0e   0f
-		'/', 'V', 'M', 'T',   '/', 'J', 'o', 'i',   'n', 't', '/', 'D',   'r', 'i', 'v', 'e', // 16 len
-		'r', '\0','\0','\0',  // packet address, padding for 4byte
-		                      ',', 'i', 'i', 'f',   'f', 'f', 'f', 'f',   'f', 'f', 'f', 's', // 32 len
-	     '\0','\0','\0','\0',   // packet tag, padding for 4byte                                 // 36 len
-	};
-	uint8_t follow_buffer[36 + sizeof(VMTJointArgument_t) + 32] = { // テキストバッファとして32バイト
-	//	00   01   02   03     04   05   06   07     08   09   0a   0b     0c   0d   0e   0f
-		'/', 'V', 'M', 'T',   '/', 'F', 'o', 'l',   'l', 'o', 'w', '/', 'D',   'r', 'i', 'v', // 16 len
-		'e', 'r', '\0','\0',  // packet address, padding for 4byte
-		                      ',', 'i', 'i', 'f',   'f', 'f', 'f', 'f',   'f', 'f', 'f', 's', // 32 len
-	     '\0','\0','\0','\0',   // packet tag, padding for 4byte                                 // 36 len
+	struct osc_destination_t {
+		IPAddress address;
+		uint16_t port;
+		uint8_t messages;
+		uint8_t divider;
+		uint8_t phase;  // 0のフレームで送る
+		bool active;	 // このフレームで送る
+		size_t length;
+		uint8_t buffer[bundle_limit];
+		CompactEncoder compact;  // OSC_FORMAT_COMPACTの場合、bufferに直接書く
+		uint16_t sequence;
 	};
 
+	WiFiUDP udp;
+	osc_destination_t destinations[OSC_DESTINATIONS];
+
+	size_t send(uint8_t kind, const void* arguments);
+	static size_t encode_joint(const VMTJointArgument_t* arguments, const uint8_t * prefix, uint8_t * buffer);
+	static size_t encode_room(const VMTJointArgument_t* arguments, uint8_t * buffer);
+	static size_t encode_telemetry(const OscTelemetryArgument_t* arguments, uint8_t * buffer);
+	bool next_frame(osc_destination_t* d);
+	void send_compact(osc_destination_t* d, uint8_t kind, const VMTJointArgument_t* arguments);
+	void write(osc_destination_t* d, const uint8_t * data, size_t length);
+	void flush_bundle(osc_destination_t* d);
+	void record(size_t length, uint32_t latency_us, bool sent);
+
+	// 送信するタスクだけが書き込み、集計の区切り毎にstatisticsへ渡す
+	osc_send_stat_t current;
+	int64_t window_start;
+	Snapshot<osc_send_stat_t> statistics;
+
+	bool bundling;
+	size_t bundle_datagrams;
+	static const uint8_t bundle_header[16];
+	static const size_t bundle_header_length = 16;
+
+	static const size_t prefix_length = 36;
+	uint8_t packet[message_limit];
+
+	static const uint8_t joint_prefix[prefix_length];
+	static const uint8_t follow_prefix[prefix_length];
+	static const size_t room_prefix_length = 32;
+	static const uint8_t room_prefix[room_prefix_length];
+	static const size_t telemetry_prefix_length = 32;
+	static const uint8_t telemetry_prefix[telemetry_prefix_length];
+
 	static const int local_port		= 62333;
-	static const size_t data_start_index = 36;
 };
 
-inline size_t OscClient::send_joint(VMTJointArgument_t* arguments) { return send((VMTJointArgument_u*)arguments, joint_buffer); }
-inline size_t OscClient::send_follow(VMTJointArgument_t* arguments) { return send((VMTJointArgument_u*)arguments, follow_buffer); }
+inline size_t OscClient::send_joint(VMTJointArgument_t* arguments) { return send(OSC_MESSAGE_JOINT, arguments); }
+inline size_t OscClient::send_follow(VMTJointArgument_t* arguments) { return send(OSC_MESSAGE_FOLLOW, arguments); }
+inline size_t OscClient::send_room(VMTJointArgument_t* arguments) { return send(OSC_MESSAGE_ROOM, arguments); }
+inline size_t OscClient::send_telemetry(OscTelemetryArgument_t* arguments) { return send(OSC_MESSAGE_TELEMETRY, arguments); }
+inline uint32_t OscClient::read_statistics(osc_send_stat_t* stat) { return statistics.read(stat); }
+
+const uint8_t OscClient::bundle_header[bundle_header_length] = {
+	'#', 'b', 'u', 'n', 'd', 'l', 'e', '\0',  // 8 len
+	0, 0, 0, 0, 0, 0, 0, 1,				  // timetag: immediately, 16 len
+};
 
+// アドレスパターンとタグ文字列、どちらも4byte境界まで\0で埋める
+const uint8_t OscClient::joint_prefix[prefix_length] = {
+//	00   01   02   03     04   05   06   07     08   09   0a   0b     0c   0d   0e   0f
+	'/', 'V', 'M', 'T',   '/', 'J', 'o', 'i',   'n', 't', '/', 'D',   'r', 'i', 'v', 'e', // 16 len
+	'r', '\0','\0','\0',  // packet address, padding for 4byte
+	                      ',', 'i', 'i', 'f',   'f', 'f', 'f', 'f',   'f', 'f', 'f', 's', // 32 len
+     '\0','\0','\0','\0',   // packet tag, padding for 4byte                                 // 36 len
+};
+const uint8_t OscClient::follow_prefix[prefix_length] = {
+//	00   01   02   03     04   05   06   07     08   09   0a   0b     0c   0d   0e   0f
+	'/', 'V', 'M', 'T',   '/', 'F', 'o', 'l',   'l', 'o', 'w', '/', 'D',   'r', 'i', 'v', // 16 len
+	'e', 'r', '\0','\0',  // packet address, padding for 4byte
+	                      ',', 'i', 'i', 'f',   'f', 'f', 'f', 'f',   'f', 'f', 'f', 's', // 32 len
+     '\0','\0','\0','\0',   // packet tag, padding for 4byte                                 // 36 len
+};
+const uint8_t OscClient::room_prefix[room_prefix_length] = {
+//	00   01   02   03     04   05   06   07     08   09   0a   0b     0c   0d   0e   0f
+	'/', 'V', 'M', 'T',   '/', 'R', 'o', 'o',   'm', '/', 'D', 'r',   'i', 'v', 'e', 'r', // 16 len
+	'\0','\0','\0','\0',  // packet address, padding for 4byte
+	',', 'i', 'i', 'f',   'f', 'f', 'f', 'f',   'f', 'f', 'f', '\0',  // packet tag, 32 len
+};
+const uint8_t OscClient::telemetry_prefix[telemetry_prefix_length] = {
+//	00   01   02   03     04   05   06   07     08   09   0a   0b     0c   0d   0e   0f
+	'/', 'J', 'o', 'i',   'n', 't', 'T', 'r',   'a', 'c', 'k', 'e',   'r', '/', 'T', 'e', // 16 len
+	'l', 'e', 'm', 'e',   't', 'r', 'y', '\0', // packet address, 24 len
+	',', 'i', 'i', 'i',   'i', 'i', 'i', '\0', // packet tag, 32 len
+};
 
 OscClient::OscClient(const uint8_t* address, uint16_t port) {
-	this->address = new IPAddress(address);
-	this->port = port;
+	bundling		 = false;
+	bundle_datagrams = 0;
+	window_start	 = 0;
+	memset(&current, 0, sizeof(current));
+
+	for (int i = 0; i < OSC_DESTINATIONS; i++) {
+		destinations[i].messages = 0;
+		destinations[i].divider	 = 1;
+		destinations[i].phase	 = 0;
+		destinations[i].active	 = false;
+		destinations[i].length	 = bundle_header_length;
+		destinations[i].sequence = 0;
+		memcpy(destinations[i].buffer, bundle_header, bundle_header_length);
+	}
+	// VMTには姿勢のみ、テレメトリは指定した送信先にのみ送る
+	set_destination(0, address, port, OSC_MESSAGE_JOINT | OSC_MESSAGE_FOLLOW | OSC_MESSAGE_ROOM);
 
 	udp.begin(local_port);
 }
 
-size_t OscClient::send(VMTJointArgument_u* arguments, uint8_t * buffer) {
-	// OSCプロトコルのパケット
-	// https://github.com/gpsnmeajp/VirtualMotionTracker/blob/master/docs/note.md
-	// http://veritas-vos-liberabit.com/trans/OSC/OSC-spec-1_0.html#:~:text=OSC%E3%83%91%E3%82%B1%E3%83%83%E3%83%88%E3%81%AF%E3%80%81%E3%83%90%E3%82%A4%E3%83%8A%E3%83%AA%E3%83%87%E3%83%BC%E3%82%BF,%E9%85%8D%E4%BF%A1%E3%81%99%E3%82%8B%E8%B2%AC%E5%8B%99%E3%82%92%E8%B2%A0%E3%81%86%E3%80%82
-	// アドレスパターン: /VMT/Joint/Driver
-	// タグ文字列: ,iiffffffffi
-	// OSC引数: （バイナリ列）トラッカー番号, 有効(1), 時間補正(0f), x, y, z, qx, qy, qz, qw
-	// 各データ間にnull (\0) を1byte挿入
+bool OscClient::set_destination(int index, const uint8_t* address, uint16_t port, uint8_t messages, uint8_t divider) {
+	if (index < 0 || index >= OSC_DESTINATIONS) return false;
+
+	osc_destination_t* d = destinations + index;
+	d->address		 = IPAddress(address);
+	d->port			 = port;
+	d->messages		 = messages;
+	d->divider		 = divider ? divider : 1;
+	d->phase			 = 0;
+	return true;
+}
 
-	size_t count = data_start_index + sizeof(VMTJointArgument_u) - 4;
-	for (int i = 0; i < sizeof(VMTJointArgument_u) - 4; i++) { // 文字列は特殊処理する
-		buffer[data_start_index + i] = arguments->raw[sizeof(VMTJointArgument_u) - 1 - i];
+bool OscClient::next_frame(osc_destination_t* d) {
+	bool due = d->phase == 0;
+	d->phase = (d->phase + 1) % d->divider;
+	return due;
+}
+
+void OscClient::write(osc_destination_t* d, const uint8_t * data, size_t length) {
+	int began	   = udp.beginPacket(d->address, d->port);
+	size_t written = udp.write(data, length);
+	// 送信できなければendPacketは0を返す、WiFiの送信待ちで止まる時間も測る
+	int64_t start = esp_timer_get_time();
+	int ended	  = udp.endPacket();
+	record(length, esp_timer_get_time() - start, began && written == length && ended);
+}
+
+void OscClient::tick() {
+	int64_t now = esp_timer_get_time();
+	if (window_start == 0) window_start = now;
+	if (now - window_start < stat_window_us) return;
+
+	current.window_us = now - window_start;
+	statistics.publish(current);
+	window_start	 = now;
+	uint32_t total = current.failures_total;
+	memset(&current, 0, sizeof(current));
+	current.failures_total = total;
+}
+
+void OscClient::record(size_t length, uint32_t latency_us, bool sent) {
+	tick();
+
+	current.datagrams++;
+	if (sent) {
+		current.bytes += length;
+	} else {
+		current.failures++;
+		current.failures_total++;
+	}
+	current.latency_sum += latency_us;
+	if (current.latency_max < latency_us) current.latency_max = latency_us;
+	current.histogram[bucket(latency_us)]++;
+}
+
+int OscClient::bucket(uint32_t latency_us) {
+	uint32_t v = latency_us >> 6;
+	int b	   = 0;
+	while (v && b < OSC_LATENCY_BUCKETS - 1) {
+		v >>= 1;
+		b++;
+	}
+	return b;
+}
+
+size_t OscClient::format(const osc_send_stat_t* stat, char* buffer, size_t length) {
+	uint32_t average = stat->datagrams ? stat->latency_sum / stat->datagrams : 0;
+	size_t n		  = snprintf(buffer, length, "udp %u/s %uB/s fail %u (total %u) | endPacket avg %uus max %uus [",
+					    stat->per_second(stat->datagrams), stat->per_second(stat->bytes), stat->failures, stat->failures_total, average,
+					    stat->latency_max);
+	for (int b = 0; b < OSC_LATENCY_BUCKETS && n < length; b++) {
+		n += snprintf(buffer + n, length - n, b ? " %u" : "%u", stat->histogram[b]);
 	}
+	if (n < length) n += snprintf(buffer + n, length - n, "]\n");
+	return n < length ? n : length;
+}
 
-	size_t serial_length = arguments->data.serial ? strlen(arguments->data.serial) : 0;
-	size_t padding_length = 4 - (serial_length & 0b11);
+size_t OscClient::send(uint8_t kind, const void* arguments) {
+	size_t count = 0;
 
-	count += serial_length;
-	for (int i=0; i<serial_length; i++) {
-		buffer[data_start_index + i + sizeof(VMTJointArgument_u) - 4] = arguments->data.serial[i];
+	if (!bundling) {
+		for (int i = 0; i < OSC_DESTINATIONS; i++) {
+			osc_destination_t* d = destinations + i;
+			if (!(d->messages & kind) || !next_frame(d)) continue;
+			if (d->messages & OSC_FORMAT_COMPACT) {
+				send_compact(d, kind, (const VMTJointArgument_t*)arguments);
+				continue;
+			}
+			if (count == 0) count = encode(kind, arguments, packet);
+			write(d, packet, count);
+		}
+		return count;
 	}
 
-	for(int i=0; i<padding_length; i++) {
-		buffer[count++] = '\0';
+	// バンドルの要素は、ビッグエンディアンの長さとメッセージ
+	// 最初の送信先のバッファに直接書き込み、以降の送信先には要素ごとコピーする
+	const uint8_t * element = nullptr;
+	for (int i = 0; i < OSC_DESTINATIONS; i++) {
+		osc_destination_t* d = destinations + i;
+		if (!(d->messages & kind) || !d->active) continue;
+		if (d->messages & OSC_FORMAT_COMPACT) {
+			send_compact(d, kind, (const VMTJointArgument_t*)arguments);
+			continue;
+		}
+
+		if (d->length + 4 + message_limit > bundle_limit) flush_bundle(d);
+		uint8_t * p = d->buffer + d->length;
+		if (element) {
+			memcpy(p, element, 4 + count);
+		} else {
+			count = encode(kind, arguments, p + 4);
+			osc_put_int32(p, count);
+			element = p;
+		}
+		d->length += 4 + count;
 	}
-	
-	udp.beginPacket(*address, port);
-	udp.write(buffer, count);
-	udp.endPacket();
 
 	return count;
 }
+
+void OscClient::send_compact(osc_destination_t* d, uint8_t kind, const VMTJointArgument_t* arguments) {
+	if (kind == OSC_MESSAGE_TELEMETRY) return;
+
+	uint8_t flags = kind == OSC_MESSAGE_JOINT ? COMPACT_FLAG_FIXED : kind == OSC_MESSAGE_ROOM ? COMPACT_FLAG_ROOM : 0;
+	if (!(d->messages & OSC_FORMAT_NO_POSITION)) flags |= COMPACT_FLAG_POSITION;
+	if (!arguments->enable) flags |= COMPACT_FLAG_DISABLED;
+	// 時間補正（負の値）を送信時刻からの遅れにする
+	uint32_t age		= arguments->time < 0.0f ? -arguments->time * 1e6f : 0;
+	Quaternion rotation	= Quaternion::xyzw(arguments->qx, arguments->qy, arguments->qz, arguments->qw);
+	Vector3<float> position = Vector3<float>::xyz(arguments->x, arguments->y, arguments->z);
+
+	// バンドル中は1つのデータグラムにまとめ、収まらなくなったら先に送る
+	if (d->compact.get_count() == 0) d->compact.begin(d->buffer, bundle_limit, d->sequence++, esp_timer_get_time());
+	if (!d->compact.add(arguments->index, flags, age, rotation, position)) {
+		flush_bundle(d);
+		d->compact.begin(d->buffer, bundle_limit, d->sequence++, esp_timer_get_time());
+		d->compact.add(arguments->index, flags, age, rotation, position);
+	}
+	if (!bundling) flush_bundle(d);
+}
+
+void OscClient::begin_bundle() {
+	bundling		 = true;
+	bundle_datagrams = 0;
+	for (int i = 0; i < OSC_DESTINATIONS; i++) {
+		osc_destination_t* d = destinations + i;
+		d->length		   = bundle_header_length;
+		d->active		   = d->messages && next_frame(d);
+	}
+}
+
+size_t OscClient::end_bundle() {
+	for (int i = 0; i < OSC_DESTINATIONS; i++) flush_bundle(destinations + i);
+	bundling = false;
+	return bundle_datagrams;
+}
+
+void OscClient::flush_bundle(osc_destination_t* d) {
+	if (d->compact.get_count()) {
+		write(d, d->buffer, d->compact.end());
+		d->compact.reset();
+		bundle_datagrams++;
+		return;
+	}
+	if (d->length <= bundle_header_length) return;
+
+	write(d, d->buffer, d->length);
+
+	d->length = bundle_header_length;
+	bundle_datagrams++;
+}
+
+size_t OscClient::encode(uint8_t kind, const void* arguments, uint8_t * buffer) {
+	switch (kind) {
+		case OSC_MESSAGE_JOINT:
+			return encode_joint((const VMTJointArgument_t*)arguments, joint_prefix, buffer);
+		case OSC_MESSAGE_FOLLOW:
+			return encode_joint((const VMTJointArgument_t*)arguments, follow_prefix, buffer);
+		case OSC_MESSAGE_ROOM:
+			return encode_room((const VMTJointArgument_t*)arguments, buffer);
+		case OSC_MESSAGE_TELEMETRY:
+			return encode_telemetry((const OscTelemetryArgument_t*)arguments, buffer);
+	}
+	return 0;
+}
+
+size_t OscClient::encode_room(const VMTJointArgument_t* arguments, uint8_t * buffer) {
+	// アドレスパターン: /VMT/Room/Driver
+	// タグ文字列: ,iiffffffff
+	// OSC引数: トラッカー番号, 有効, 時間補正, x, y, z, qx, qy, qz, qw
+	memcpy(buffer, room_prefix, room_prefix_length);
+
+	uint8_t * p = buffer + room_prefix_length;
+	p		  = osc_put_int32(p, arguments->index);
+	p		  = osc_put_int32(p, arguments->enable);
+	p		  = osc_put_float(p, arguments->time);
+	p		  = osc_put_float(p, arguments->x);
+	p		  = osc_put_float(p, arguments->y);
+	p		  = osc_put_float(p, arguments->z);
+	p		  = osc_put_float(p, arguments->qx);
+	p		  = osc_put_float(p, arguments->qy);
+	p		  = osc_put_float(p, arguments->qz);
+	p		  = osc_put_float(p, arguments->qw);
+
+	return p - buffer;
+}
+
+size_t OscClient::encode_telemetry(const OscTelemetryArgument_t* arguments, uint8_t * buffer) {
+	// アドレスパターン: /JointTracker/Telemetry
+	// タグ文字列: ,iiiiii
+	// OSC引数: Workerのアドレス, 状態, 更新レート, サンプルの遅れ, 温度, エラー数
+	memcpy(buffer, telemetry_prefix, telemetry_prefix_length);
+
+	uint8_t * p = buffer + telemetry_prefix_length;
+	p		  = osc_put_int32(p, arguments->address);
+	p		  = osc_put_int32(p, arguments->health);
+	p		  = osc_put_int32(p, arguments->rate);
+	p		  = osc_put_int32(p, arguments->age);
+	p		  = osc_put_int32(p, arguments->temperature);
+	p		  = osc_put_int32(p, arguments->errors);
+
+	return p - buffer;
+}
+
+size_t OscClient::encode_joint(const VMTJointArgument_t* arguments, const uint8_t * prefix, uint8_t * buffer) {
+	// OSCプロトコルのパケット
+	// https://github.com/gpsnmeajp/VirtualMotionTracker/blob/master/docs/note.md
+	// http://veritas-vos-liberabit.com/trans/OSC/OSC-spec-1_0.html#:~:text=OSC%E3%83%91%E3%82%B1%E3%83%83%E3%83%88%E3%81%AF%E3%80%81%E3%83%90%E3%82%A4%E3%83%8A%E3%83%AA%E3%83%87%E3%83%BC%E3%82%BF,%E9%85%8D%E4%BF%A1%E3%81%99%E3%82%8B%E8%B2%AC%E5%8B%99%E3%82%92%E8%B2%A0%E3%81%86%E3%80%82
+	// アドレスパターン: /VMT/Joint/Driver
+	// タグ文字列: ,iiffffffffs
+	// OSC引数: （ビッグエンディアン）トラッカー番号, 有効(1), 時間補正(0f), x, y, z, qx, qy, qz, qw, シリアル
+	memcpy(buffer, prefix, prefix_length);
+
+	uint8_t * p = buffer + prefix_length;
+	p		  = osc_put_int32(p, arguments->index);
+	p		  = osc_put_int32(p, arguments->enable);
+	p		  = osc_put_float(p, arguments->time);
+	p		  = osc_put_float(p, arguments->x);
+	p		  = osc_put_float(p, arguments->y);
+	p		  = osc_put_float(p, arguments->z);
+	p		  = osc_put_float(p, arguments->qx);
+	p		  = osc_put_float(p, arguments->qy);
+	p		  = osc_put_float(p, arguments->qz);
+	p		  = osc_put_float(p, arguments->qw);
+	p		  = osc_put_string(p, arguments->serial);
+
+	return p - buffer;
+}
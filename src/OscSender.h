@@ -0,0 +1,298 @@
+#pragma once
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdint.h>
+
+#include "OscClient.h"
+#include "OutputScheduler.h"
+#include "Snapshot.h"
+#include "SpscQueue.h"
+
+// 固定関節8 + 可動関節8 + /JointTracker/Telemetry 1
+#define OSC_FRAME_ENTRIES (8 + 8 + 1)
+#define OSC_FRAME_QUEUE 4
+
+// tracksの位置をそのままOutputSchedulerのslotに使う
+static_assert(OSC_FRAME_ENTRIES <= OUTPUT_SLOTS, "OUTPUT_SLOTS is smaller than OSC_FRAME_ENTRIES");
+
+struct osc_entry_t {
+	uint8_t kind;		  // OSC_MESSAGE_*
+	int64_t sampled_at;  // 姿勢のサンプル時刻（Parentの時刻）
+	Vector3<float> base;  // 位置のうち親から引き継いだ部分、argumentsと同じVMTの座標系
+	union {
+		VMTJointArgument_t arguments;
+		OscTelemetryArgument_t telemetry;
+	};
+};
+
+/// 1回のポーリングループで送るOSCメッセージ一式
+struct osc_frame_t {
+	uint8_t count;
+	osc_entry_t entries[OSC_FRAME_ENTRIES];
+};
+
+/// OSCの送信を専用タスクで行い、ポーリングループがWiFiの送信で止まらないようにする
+/// ポーリング側はフレームを作ってSpscQueueに渡すだけで、送信タスクがまとめて#bundleで送る
+/// キューが一杯の間や、送信タスクが複数のフレームを受け取った場合は、トラッカー毎に最新の値だけを送る
+/// 出力レートを指定した場合は、受け取った時ではなく固定周期で、最新の姿勢を送信時刻まで進めて送る
+/// beginを呼ばなければ送信タスクを使わず、add_*の時点で#bundleにもまとめずに1メッセージずつ送る
+class OscSender {
+    public:
+	OscSender(OscClient* client);
+
+	/// 固定レートで送信します、0なら受け取ったフレームを順に送る、beginより前に呼ぶこと
+	void set_rate(uint32_t rate_hz);
+	/// 送信タスクを開始します、WiFiのタスクと同じコアを指定する
+	void begin(BaseType_t core, UBaseType_t priority = 5);
+
+	/// 以降はポーリング側の1タスクからのみ呼び出すこと
+	void add_joint(VMTJointArgument_t* arguments);
+	/// sampled_atは姿勢のサンプル時刻、0なら追加した時刻とする
+	/// baseは位置のうち親から引き継いだ部分（Skeleton::get_base）、固定レートではこれを除いた分だけ回す
+	void add_follow(VMTJointArgument_t* arguments, int64_t sampled_at = 0, Vector3<float> base = {0.0f, 0.0f, 0.0f});
+	void add_room(VMTJointArgument_t* arguments, int64_t sampled_at = 0, Vector3<float> base = {0.0f, 0.0f, 0.0f});
+	void add_telemetry(OscTelemetryArgument_t* arguments);
+	/// 追加したメッセージを送信タスクに渡します、キューが一杯なら次のフレームにまとめてfalse
+	bool end_frame();
+
+	/// 新しい値で置き換えて送らなかったメッセージ数
+	uint32_t get_coalesced();
+	/// フレームに入りきらず送らなかったメッセージ数
+	uint32_t get_dropped();
+	/// 送信したデータグラム数
+	uint32_t get_datagrams();
+	/// 固定レートで送信した直近1秒の出力の間隔・遅延、どのタスクからでも読み出せる
+	void read_output_statistics(output_stat_t* stat);
+
+    private:
+	static void sender_task(void* arg);
+	static osc_entry_t* merge(osc_frame_t* frame, const osc_entry_t* entry, bool* replaced);
+	static int32_t key(const osc_entry_t* entry);
+	void send(osc_entry_t* entry);
+	void add(osc_entry_t* entry);
+	void add_pose(uint8_t kind, VMTJointArgument_t* arguments, int64_t sampled_at, Vector3<float> base);
+	void receive();
+	void send_tracks(int64_t at);
+
+	OscClient* client;
+	bool running;  // 送信タスクを開始した
+	SpscQueue<osc_frame_t, OSC_FRAME_QUEUE> queue;
+	osc_frame_t pending;  // ポーリング側で作成中、キューに入るまで持ち越す
+	osc_frame_t merged;	  // 送信タスク側でまとめたもの
+	osc_frame_t tracks;	  // 固定レート時の有効な/VMT/Follow/Driver・/VMT/Room/Driver、位置がschedulerのslot
+	uint32_t unsent;	  // まだ1度も送信していないtracksのビット
+
+	OutputScheduler scheduler;
+	Snapshot<output_stat_t> output_statistics;
+
+	std::atomic<uint32_t> coalesced;
+	std::atomic<uint32_t> dropped;
+	std::atomic<uint32_t> datagrams;
+};
+
+inline void OscSender::set_rate(uint32_t rate_hz) { scheduler.set_rate(rate_hz); }
+inline int32_t OscSender::key(const osc_entry_t* entry) { return entry->kind == OSC_MESSAGE_TELEMETRY ? entry->telemetry.address : entry->arguments.index; }
+inline void OscSender::read_output_statistics(output_stat_t* stat) { output_statistics.read(stat); }
+inline uint32_t OscSender::get_coalesced() { return coalesced.load(std::memory_order_relaxed); }
+inline uint32_t OscSender::get_dropped() { return dropped.load(std::memory_order_relaxed); }
+inline uint32_t OscSender::get_datagrams() { return datagrams.load(std::memory_order_relaxed); }
+
+OscSender::OscSender(OscClient* client) : coalesced(0), dropped(0), datagrams(0) {
+	this->client  = client;
+	running	    = false;
+	pending.count = 0;
+	merged.count  = 0;
+	tracks.count  = 0;
+	unsent	    = 0;
+}
+
+void OscSender::begin(BaseType_t core, UBaseType_t priority) {
+	running = true;
+	xTaskCreatePinnedToCore(sender_task, "osc_sender", 1024 * 4, this, priority, nullptr, core);
+}
+
+osc_entry_t* OscSender::merge(osc_frame_t* frame, const osc_entry_t* entry, bool* replaced) {
+	// 同じトラッカーへのメッセージは後のもので置き換える
+	*replaced = false;
+	for (int i = 0; i < frame->count; i++) {
+		osc_entry_t* e = frame->entries + i;
+		if (e->kind == entry->kind && key(e) == key(entry)) {
+			*e	    = *entry;
+			*replaced = true;
+			return e;
+		}
+	}
+	if (frame->count >= OSC_FRAME_ENTRIES) return nullptr;
+	frame->entries[frame->count] = *entry;
+	return frame->entries + frame->count++;
+}
+
+void OscSender::add_joint(VMTJointArgument_t* arguments) {
+	osc_entry_t entry;
+	entry.kind	    = OSC_MESSAGE_JOINT;
+	entry.sampled_at = 0;
+	entry.base	    = {0.0f, 0.0f, 0.0f};
+	entry.arguments  = *arguments;
+	add(&entry);
+}
+
+void OscSender::add_follow(VMTJointArgument_t* arguments, int64_t sampled_at, Vector3<float> base) { add_pose(OSC_MESSAGE_FOLLOW, arguments, sampled_at, base); }
+void OscSender::add_room(VMTJointArgument_t* arguments, int64_t sampled_at, Vector3<float> base) { add_pose(OSC_MESSAGE_ROOM, arguments, sampled_at, base); }
+
+void OscSender::add_pose(uint8_t kind, VMTJointArgument_t* arguments, int64_t sampled_at, Vector3<float> base) {
+	osc_entry_t entry;
+	entry.kind	    = kind;
+	entry.sampled_at = sampled_at ? sampled_at : esp_timer_get_time();
+	// VMTJointArgument_t::setと同じくVMTの座標系に直す
+	entry.base	    = {base.x, base.z, -base.y};
+	entry.arguments  = *arguments;
+	add(&entry);
+}
+
+void OscSender::add_telemetry(OscTelemetryArgument_t* arguments) {
+	osc_entry_t entry;
+	entry.kind	    = OSC_MESSAGE_TELEMETRY;
+	entry.sampled_at = 0;
+	entry.base	    = {0.0f, 0.0f, 0.0f};
+	entry.telemetry  = *arguments;
+	add(&entry);
+}
+
+void OscSender::send(osc_entry_t* entry) {
+	switch (entry->kind) {
+		case OSC_MESSAGE_JOINT:
+			client->send_joint(&entry->arguments);
+			break;
+		case OSC_MESSAGE_FOLLOW:
+			client->send_follow(&entry->arguments);
+			break;
+		case OSC_MESSAGE_ROOM:
+			client->send_room(&entry->arguments);
+			break;
+		case OSC_MESSAGE_TELEMETRY:
+			client->send_telemetry(&entry->telemetry);
+			break;
+	}
+}
+
+void OscSender::add(osc_entry_t* entry) {
+	if (!running) {
+		send(entry);
+		datagrams.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	bool replaced;
+	if (merge(&pending, entry, &replaced) == nullptr) dropped.fetch_add(1, std::memory_order_relaxed);
+	if (replaced) coalesced.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool OscSender::end_frame() {
+	// 送信タスクを使わない場合は、ポーリング側が送信するタスク
+	if (!running) client->tick();
+	if (pending.count == 0) return true;
+
+	osc_frame_t* frame = queue.reserve();
+	if (frame == nullptr) return false;
+
+	*frame	    = pending;
+	pending.count = 0;
+	queue.commit();
+	return true;
+}
+
+void OscSender::receive() {
+	// 溜まっているフレームは1つにまとめる
+	// 固定レート時は有効な/VMT/Follow/Driver・/VMT/Room/Driverを保持し、他は次の送信で1度だけ送る
+	bool fixed	   = scheduler.get_rate() > 0;
+	uint32_t replaced = 0, lost = 0;
+	for (osc_frame_t* frame = queue.front(); frame; frame = queue.front()) {
+		for (int i = 0; i < frame->count; i++) {
+			osc_entry_t* e = frame->entries + i;
+			bool r;
+			if (fixed && (e->kind & (OSC_MESSAGE_FOLLOW | OSC_MESSAGE_ROOM))) {
+				osc_entry_t* track = merge(&tracks, e, &r);
+				if (track) {
+					int slot = track - tracks.entries;
+					// 保持している姿勢の置き換えは、送信前のもののみ数える
+					r	    = r && (unsent & (1 << slot));
+					unsent |= 1 << slot;
+					if (e->arguments.enable) {
+						Quaternion q = Quaternion::xyzw(e->arguments.qx, e->arguments.qy, e->arguments.qz, e->arguments.qw);
+						scheduler.update(slot, e->sampled_at, q);
+					} else {
+						scheduler.reset(slot);
+					}
+				}
+				// 無効にするメッセージと、保持しきれないものはそのまま送る
+				if (track && e->arguments.enable) {
+					replaced += r;
+					continue;
+				}
+			}
+			if (merge(&merged, e, &r) == nullptr) lost++;
+			replaced += r;
+		}
+		queue.pop();
+	}
+	coalesced.fetch_add(replaced, std::memory_order_relaxed);
+	dropped.fetch_add(lost, std::memory_order_relaxed);
+}
+
+void OscSender::send_tracks(int64_t at) {
+	// 最後の姿勢を角速度で送信時刻まで進める、位置はこの関節のボーン（親の位置からの差）だけを同じ回転で動かす
+	// 親の位置は親の関節の回転で動くので、ここでは進めない
+	VMTJointArgument_t arguments;
+	for (int i = 0; i < tracks.count; i++) {
+		osc_entry_t* e = tracks.entries + i;
+		if (!e->arguments.enable) continue;
+
+		Quaternion d = scheduler.advance(i, at);
+		Quaternion q = d * Quaternion::xyzw(e->arguments.qx, e->arguments.qy, e->arguments.qz, e->arguments.qw);
+		Vector3<float> b = e->base;
+		Vector3<float> p = d * Vector3<float>::xyz(e->arguments.x - b.x, e->arguments.y - b.y, e->arguments.z - b.z);
+
+		arguments	    = e->arguments;
+		arguments.qx   = q.x;
+		arguments.qy   = q.y;
+		arguments.qz   = q.z;
+		arguments.qw   = q.w;
+		arguments.x    = b.x + p.x;
+		arguments.y    = b.y + p.y;
+		arguments.z    = b.z + p.z;
+		arguments.time = 0.0f;
+		if (e->kind == OSC_MESSAGE_ROOM) {
+			client->send_room(&arguments);
+		} else {
+			client->send_follow(&arguments);
+		}
+	}
+	unsent = 0;
+}
+
+void OscSender::sender_task(void* arg) {
+	OscSender* self = (OscSender*)arg;
+
+	while (true) {
+		// 何も送らない間も、送信の集計を1秒毎に区切る
+		self->client->tick();
+		self->receive();
+
+		int64_t at = 0;
+		bool fixed = self->scheduler.get_rate() > 0;
+		if (fixed ? !self->scheduler.due(esp_timer_get_time(), &at) : self->merged.count == 0) {
+			vTaskDelay(1);
+			continue;
+		}
+
+		self->client->begin_bundle();
+		for (int i = 0; i < self->merged.count; i++) self->send(self->merged.entries + i);
+		self->merged.count = 0;
+		if (fixed) self->send_tracks(at);
+		self->datagrams.fetch_add(self->client->end_bundle(), std::memory_order_relaxed);
+
+		if (fixed) self->output_statistics.publish(*self->scheduler.get_statistics());
+	}
+}
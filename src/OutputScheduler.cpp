@@ -0,0 +1,100 @@
+#include "OutputScheduler.h"
+
+#include <math.h>
+#include <string.h>
+
+OutputScheduler::OutputScheduler() {
+	period	   = 0;
+	next		   = 0;
+	window_start = 0;
+	memset(&current, 0, sizeof(current));
+	memset(&last, 0, sizeof(last));
+
+	for (int i = 0; i < OUTPUT_SLOTS; i++) reset(i);
+}
+
+void OutputScheduler::set_rate(uint32_t rate_hz) {
+	period = rate_hz ? 1000000 / rate_hz : 0;
+	next	  = 0;
+}
+
+bool OutputScheduler::due(int64_t now, int64_t* scheduled) {
+	if (period == 0) return false;
+	if (next == 0) next = window_start = now;
+	if (now < next) return false;
+
+	if (now - window_start >= stat_window_us) {
+		last		   = current;
+		window_start = now;
+		memset(&current, 0, sizeof(current));
+	}
+
+	uint32_t jitter = now - next;
+	current.frames++;
+	current.jitter_sum += jitter;
+	if (current.jitter_max < jitter) current.jitter_max = jitter;
+
+	*scheduled = next;
+	next += period;
+	while (next <= now) {
+		next += period;
+		current.skipped++;
+	}
+	return true;
+}
+
+void OutputScheduler::update(int slot, int64_t sampled_at, Quaternion rotation) {
+	output_slot_t* s = slots + slot;
+	int64_t dt	  = sampled_at - s->sampled_at;
+	// 少し前のサンプルは無視する、大きく戻った場合はv1への切り替えなどで時刻の基準が変わったので、
+	// 前の角速度で回し続けないよう、新しい姿勢からやり直す
+	if (s->valid && dt < 0 && dt >= -(int64_t)max_rewind_us) return;
+	// 同じサンプルの送り直し（親の関節が動いた場合など）は角速度を変えない
+	if (s->valid && dt == 0) {
+		s->rotation = rotation;
+		return;
+	}
+
+	s->rate = {0.0f, 0.0f, 0.0f};
+	if (s->valid && dt > 0 && dt <= max_gap_us) {
+		// 前回からの回転 d = q * prev^-1 を回転軸 * 角度に直す
+		Quaternion d = rotation * s->rotation.inverse();
+		if (d.w < 0.0f) d *= -1.0f;
+		float sin_half = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+		if (sin_half > 1e-6f) {
+			float k = 2.0f * atan2f(sin_half, d.w) / sin_half / (dt * 1e-6f);
+			s->rate = {d.x * k, d.y * k, d.z * k};
+		}
+	}
+
+	s->valid	    = true;
+	s->sampled_at = sampled_at;
+	s->rotation   = rotation;
+}
+
+void OutputScheduler::reset(int slot) {
+	slots[slot].valid	     = false;
+	slots[slot].sampled_at = 0;
+	slots[slot].rotation   = Quaternion::identify();
+	slots[slot].rate	     = {0.0f, 0.0f, 0.0f};
+}
+
+Quaternion OutputScheduler::advance(int slot, int64_t at) {
+	output_slot_t* s = slots + slot;
+	if (!s->valid) return Quaternion::identify();
+
+	int64_t age = at - s->sampled_at;
+	if (age < 0) age = 0;
+	current.poses++;
+	current.age_sum += age;
+	if (current.age_max < age) current.age_max = age;
+
+	if (age > max_extrapolation_us) age = max_extrapolation_us;
+	float t = age * 1e-6f;
+	Vector3<float> v = {s->rate.x * t, s->rate.y * t, s->rate.z * t};
+	float angle		 = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	if (angle < 1e-6f) return Quaternion::identify();
+
+	float k = sinf(angle * 0.5f) / angle;
+	return Quaternion::xyzw(v.x * k, v.y * k, v.z * k, cosf(angle * 0.5f));
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+
+#define OUTPUT_SLOTS 32
+
+/// 直近stat_window_usの出力の集計
+struct output_stat_t {
+	uint32_t frames;	   // 出力したフレーム数
+	uint32_t skipped;	   // 間に合わず飛ばした周期
+	uint32_t jitter_max;  // 予定時刻からの遅れ [us]
+	uint64_t jitter_sum;
+	uint32_t poses;	   // 出力した姿勢の数
+	uint32_t age_max;	   // 出力時刻とサンプル時刻の差、角速度で先に進めた時間 [us]
+	uint64_t age_sum;
+};
+
+/// 固定レートでの出力時刻を決め、関節毎の姿勢を出力時刻まで角速度で進める
+/// 書き込み・読み出しとも1タスクからのみ行うこと
+class OutputScheduler {
+    public:
+	OutputScheduler();
+
+	/// 出力レート、0で固定レートにしない
+	void set_rate(uint32_t rate_hz);
+	uint32_t get_rate();
+
+	/// 次の出力時刻を過ぎていればtrue、scheduledに予定時刻を書き込む
+	/// 1周期以上遅れた場合は、間に合わなかった周期を飛ばす
+	bool due(int64_t now, int64_t* scheduled);
+
+	/// slotの新しい姿勢、sampled_atはParentの時刻
+	/// 前回の姿勢との差から角速度を求める、max_rewind_usより前に戻った場合は角速度を求め直す
+	void update(int slot, int64_t sampled_at, Quaternion rotation);
+	/// slotを使わなくなった時に呼ぶ
+	void reset(int slot);
+	/// slotの最後の姿勢をatまで進める回転、左から掛ける
+	/// 進める時間はmax_extrapolation_usまで
+	Quaternion advance(int slot, int64_t at);
+
+	/// 直近に完了した集計
+	const output_stat_t* get_statistics();
+
+	static const uint32_t max_extrapolation_us = 50000;
+	/// これより間隔の空いた2つの姿勢からは角速度を求めない
+	static const uint32_t max_gap_us	   = 100000;
+	/// これより前に戻った姿勢は、古いサンプルではなく時刻の基準が変わったとみなす
+	static const uint32_t max_rewind_us  = 10000;
+	static const uint32_t stat_window_us = 1000000;
+
+    private:
+	struct output_slot_t {
+		bool valid;
+		int64_t sampled_at;
+		Quaternion rotation;
+		Vector3<float> rate;  // 角速度 [rad/s]、Parentの座標系
+	};
+
+	output_slot_t slots[OUTPUT_SLOTS];
+
+	uint32_t period;
+	int64_t next;
+
+	int64_t window_start;
+	output_stat_t current;
+	output_stat_t last;
+};
+
+inline uint32_t OutputScheduler::get_rate() { return period ? 1000000 / period : 0; }
+inline const output_stat_t* OutputScheduler::get_statistics() { return &last; }
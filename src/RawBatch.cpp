@@ -0,0 +1,42 @@
+#include "RawBatch.h"
+
+static int16_t saturate(int32_t value) { return value > 32767 ? 32767 : value < -32768 ? -32768 : value; }
+
+RawBatch::RawBatch() {
+	head  = 0;
+	count = 0;
+
+	for (int i = 0; i < RAW_SAMPLES; i++) {
+		timestamps[i] = 0;
+		samples[i]	   = {0, 0, 0, 0, 0, 0, 0};
+	}
+}
+
+void RawBatch::push(uint32_t timestamp, Vector3<int32_t> gyro, Vector3<int32_t> accel) {
+	head			   = (head + 1) % RAW_SAMPLES;
+	timestamps[head] = timestamp;
+	samples[head]	   = {saturate(gyro.x), saturate(gyro.y), saturate(gyro.z), saturate(accel.x), saturate(accel.y), saturate(accel.z), 0};
+	if (count < RAW_SAMPLES) count++;
+}
+
+void RawBatch::fill(data_raw_u* frame, uint8_t flags, uint16_t sequence) {
+	frame->flags	    = flags;
+	frame->sequence  = sequence;
+	frame->timestamp = timestamps[head];
+	frame->count	    = count;
+	frame->reserved  = 0;
+
+	for (int i = 0; i < RAW_SAMPLES; i++) {
+		if (i >= count) {
+			frame->samples[i] = {0, 0, 0, 0, 0, 0, 0};
+			continue;
+		}
+
+		int n			   = (head + RAW_SAMPLES - i) % RAW_SAMPLES;
+		uint32_t age	   = (timestamps[head] - timestamps[n]) / BATCH_AGE_UNIT_US;
+		frame->samples[i]	   = samples[n];
+		frame->samples[i].age = age > 0xffff ? 0xffff : age;
+	}
+
+	data_seal(frame);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+/// Worker側で直近RAW_SAMPLES個のIMUの値を保持し、COMMAND_GET_RAWの応答を作る
+class RawBatch {
+    public:
+	RawBatch();
+
+	/// IMU読み出し毎に呼び出します、ゼロバイアスを除いたADCの値を渡す
+	void push(uint32_t timestamp, Vector3<int32_t> gyro, Vector3<int32_t> accel);
+	/// 新しい順に詰めて、CRCまで書き込みます、sequenceはSampleBatchと揃える
+	void fill(data_raw_u* frame, uint8_t flags, uint16_t sequence);
+
+    private:
+	uint32_t timestamps[RAW_SAMPLES];
+	raw_sample_t samples[RAW_SAMPLES];
+	uint8_t head;
+	uint8_t count;
+};
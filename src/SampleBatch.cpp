@@ -0,0 +1,41 @@
+#include "SampleBatch.h"
+
+SampleBatch::SampleBatch() {
+	head	    = 0;
+	count    = 0;
+	sequence = 0;
+
+	for (int i = 0; i < BATCH_SAMPLES; i++) {
+		timestamps[i] = 0;
+		samples[i]	   = Quaternion::identify();
+	}
+}
+
+uint16_t SampleBatch::push(uint32_t timestamp, Quaternion q) {
+	head			   = (head + 1) % BATCH_SAMPLES;
+	timestamps[head] = timestamp;
+	samples[head]	   = q;
+	if (count < BATCH_SAMPLES) count++;
+	return ++sequence;
+}
+
+void SampleBatch::fill(data_batch_u* batch, uint8_t flags) {
+	batch->flags	    = flags;
+	batch->sequence  = sequence;
+	batch->timestamp = timestamps[head];
+	batch->count	    = count;
+	batch->reserved  = 0;
+
+	for (int i = 0; i < BATCH_SAMPLES; i++) {
+		if (i >= count) {
+			batch->samples[i] = {0, 0, 0, 0};
+			continue;
+		}
+
+		int n		   = (head + BATCH_SAMPLES - i) % BATCH_SAMPLES;
+		uint32_t age   = (timestamps[head] - timestamps[n]) / BATCH_AGE_UNIT_US;
+		batch->samples[i] = data_pack(samples[n], age > 0xffff ? 0xffff : age);
+	}
+
+	data_seal(batch);
+}
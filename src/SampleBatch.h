@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+/// Worker側で直近BATCH_SAMPLES個の姿勢を保持し、COMMAND_GET_BATCHの応答を作る
+class SampleBatch {
+    public:
+	SampleBatch();
+
+	/// AHRS更新毎に呼び出します、追加したサンプルの連番を返します
+	uint16_t push(uint32_t timestamp, Quaternion q);
+	/// 新しい順に詰めて、CRCまで書き込みます
+	void fill(data_batch_u* batch, uint8_t flags);
+
+    private:
+	uint32_t timestamps[BATCH_SAMPLES];
+	Quaternion samples[BATCH_SAMPLES];
+	uint8_t head;
+	uint8_t count;
+	uint16_t sequence;
+};
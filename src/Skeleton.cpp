@@ -0,0 +1,91 @@
+#include "Skeleton.h"
+
+Skeleton::Skeleton() { clear(); }
+
+void Skeleton::clear() { count = 0; }
+
+int Skeleton::add(Vector3<float> bone, Quaternion rotation, bool anchor) {
+	if (count >= SKELETON_MAX_JOINTS) return -1;
+
+	skeleton_node_t* n = nodes + count;
+	n->parent		   = -1;
+	n->origin		   = count;
+	n->anchor		   = anchor;
+	n->dirty		   = true;
+	n->bone		   = bone;
+	n->rotation	   = rotation;
+	n->base		   = {0.0f, 0.0f, 0.0f};
+	n->position	   = rotation * bone;
+	order[count]	   = count;
+	return count++;
+}
+
+void Skeleton::set_parent(int joint, int parent) {
+	nodes[joint].parent = parent >= 0 && parent < (int)count && parent != joint ? parent : -1;
+}
+
+bool Skeleton::build() {
+	// 親が並び終わった関節から順に並べる、並べられない関節は循環している
+	bool placed[SKELETON_MAX_JOINTS] = {};
+	size_t n	  = 0;
+	bool acyclic = true;
+	while (n < count) {
+		size_t before = n;
+		for (size_t i = 0; i < count; i++) {
+			int parent = nodes[i].parent;
+			if (placed[i] || (parent >= 0 && !placed[parent])) continue;
+			placed[i]	 = true;
+			order[n++] = i;
+		}
+		if (n > before) continue;
+
+		for (size_t i = 0; i < count; i++) {
+			if (placed[i]) continue;
+			nodes[i].parent = -1;
+			acyclic		 = false;
+			break;
+		}
+	}
+
+	for (size_t k = 0; k < count; k++) {
+		skeleton_node_t* node = nodes + order[k];
+		int parent		  = node->parent;
+		if (parent < 0) {
+			node->origin = order[k];
+		} else {
+			node->origin = nodes[parent].anchor ? parent : nodes[parent].origin;
+		}
+		node->dirty = true;
+	}
+
+	update();
+	return acyclic;
+}
+
+void Skeleton::set_rotation(int joint, Quaternion rotation) {
+	nodes[joint].rotation = rotation;
+	nodes[joint].dirty	   = true;
+}
+
+void Skeleton::update() {
+	// 親の位置は計算済みなので、そのまま使う
+	// anchorの子はanchorのトラッカーが原点なので、anchorが変わっても位置は変わらない
+	for (size_t k = 0; k < count; k++) {
+		skeleton_node_t* node = nodes + order[k];
+		int parent		  = node->parent;
+		if (!node->dirty && (parent < 0 || nodes[parent].anchor || !nodes[parent].dirty)) continue;
+		node->dirty = true;
+
+		Vector3<float> offset = node->rotation * node->bone;
+		if (parent < 0 || nodes[parent].anchor) {
+			node->base = {0.0f, 0.0f, 0.0f};
+		} else {
+			node->base = nodes[parent].position;
+		}
+		node->position = {node->base.x + offset.x, node->base.y + offset.y, node->base.z + offset.z};
+	}
+}
+
+void Skeleton::clean() {
+	for (size_t i = 0; i < count; i++) nodes[i].dirty = false;
+}
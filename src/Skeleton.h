@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Vector3.h"
+
+#define SKELETON_MAX_JOINTS 16
+
+/// 関節の親子関係から、全関節の位置を親から順に1回のパスで求める
+/// 姿勢は関節毎にIMUなどの絶対姿勢を与え、位置は 親の位置 + 姿勢 * ボーン
+/// anchorの関節はVMTのトラッカーとして別に送る関節で、子の位置はanchorのトラッカーを原点とする
+/// 姿勢を与えた関節と、その位置を原点に含む子孫だけを求め直し、送り直す関節としてdirtyにする
+class Skeleton {
+    public:
+	Skeleton();
+
+	void clear();
+	/// 関節を追加し番号を返します、一杯なら-1
+	int add(Vector3<float> bone, Quaternion rotation, bool anchor = false);
+	/// parentは追加済みの関節の番号、-1でルート
+	void set_parent(int joint, int parent);
+	/// 親が先に来る計算順を作ります、循環していればその関節をルートにしてfalse
+	bool build();
+
+	/// 関節をdirtyにします、子孫はupdateでdirtyになります
+	void set_rotation(int joint, Quaternion rotation);
+	/// 計算順に、dirtyな関節と親がdirtyな関節の位置を求めます
+	void update();
+	/// 送り終わったら全関節のdirtyを消します
+	void clean();
+
+	Quaternion get_rotation(int joint);
+	/// get_originの関節（anchorならそのトラッカー、ルートならルートの基準）からの位置
+	Vector3<float> get_position(int joint);
+	/// get_positionのうち親から引き継いだ位置、この関節の姿勢では動かない
+	Vector3<float> get_base(int joint);
+	int get_parent(int joint);
+	/// 位置の原点になる関節、親を辿って最初のanchorか、anchorが無ければルート
+	int get_origin(int joint);
+	bool is_anchor(int joint);
+	/// 前回のcleanから位置か姿勢が変わった
+	bool is_dirty(int joint);
+	size_t size();
+
+    private:
+	struct skeleton_node_t {
+		int8_t parent;
+		int8_t origin;
+		bool anchor;
+		bool dirty;
+		Vector3<float> bone;
+		Quaternion rotation;
+		Vector3<float> base;  // 親の位置、ルートとanchorの子は0
+		Vector3<float> position;
+	};
+
+	skeleton_node_t nodes[SKELETON_MAX_JOINTS];
+	uint8_t order[SKELETON_MAX_JOINTS];  // 親が先に来る順
+	size_t count;
+};
+
+inline Quaternion Skeleton::get_rotation(int joint) { return nodes[joint].rotation; }
+inline Vector3<float> Skeleton::get_position(int joint) { return nodes[joint].position; }
+inline Vector3<float> Skeleton::get_base(int joint) { return nodes[joint].base; }
+inline int Skeleton::get_parent(int joint) { return nodes[joint].parent; }
+inline int Skeleton::get_origin(int joint) { return nodes[joint].origin; }
+inline bool Skeleton::is_anchor(int joint) { return nodes[joint].anchor; }
+inline bool Skeleton::is_dirty(int joint) { return nodes[joint].dirty; }
+inline size_t Skeleton::size() { return count; }
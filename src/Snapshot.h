@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+/// 1つの書き込みタスクから複数の読み出しタスクへ、値を整合性を保ったまま受け渡す
+/// 2面のバッファを交互に書き込むシーケンスロックで、書き込み側・読み出し側ともに待たない
+/// 読み出しがやり直しになるのは、1回のコピー中に2回以上publishされた場合のみ
+template <typename T>
+class Snapshot {
+    public:
+	Snapshot();
+
+	/// 書き込みは1タスクからのみ行うこと
+	void publish(const T& value);
+	/// 最新の値をコピーし、publish済みの回数を返します
+	uint32_t read(T* value);
+	uint32_t version();
+
+    private:
+	T slots[2];
+	// 偶数: publish済み回数 * 2、奇数: 書き込み中
+	std::atomic<uint32_t> sequence;
+};
+
+template <typename T>
+Snapshot<T>::Snapshot() : sequence(0) {
+	slots[0] = slots[1] = T();
+}
+
+template <typename T>
+void Snapshot<T>::publish(const T& value) {
+	uint32_t s = sequence.load(std::memory_order_relaxed);
+	uint32_t n = (s >> 1) + 1;
+
+	sequence.store(s + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// 読み出し側が参照している最新の面とは別の面に書く
+	slots[n & 1] = value;
+
+	sequence.store(n << 1, std::memory_order_release);
+}
+
+template <typename T>
+uint32_t Snapshot<T>::read(T* value) {
+	while (true) {
+		uint32_t s = sequence.load(std::memory_order_acquire);
+		uint32_t n = s >> 1;
+
+		*value = slots[n & 1];
+
+		// この面が次に書き換えられるのは n + 2 回目のpublish開始時
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(std::memory_order_relaxed) - (n << 1) < 3) return n;
+	}
+}
+
+template <typename T>
+inline uint32_t Snapshot<T>::version() {
+	return sequence.load(std::memory_order_acquire) >> 1;
+}
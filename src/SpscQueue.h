@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/// 1つの書き込みタスクから1つの読み出しタスクへ、ロック無しで順に受け渡すリングバッファ
+/// 要素はバッファ上で直接作り・読み出すので、コピーは呼び出し側に任せる
+/// Nは2のべき乗にすること
+template <typename T, size_t N>
+class SpscQueue {
+    public:
+	SpscQueue();
+
+	/// 書き込む要素、一杯ならnullptr、書き込み側のみ呼び出すこと
+	T* reserve();
+	/// reserveした要素を読み出し側に渡します
+	void commit();
+
+	/// 最も古い要素、空ならnullptr、読み出し側のみ呼び出すこと
+	T* front();
+	/// frontの要素を読み終えて解放します
+	void pop();
+
+    private:
+	T slots[N];
+	std::atomic<uint32_t> head;	 // 次に書き込む位置（書き込み側のみ更新）
+	std::atomic<uint32_t> tail;	 // 次に読み出す位置（読み出し側のみ更新）
+};
+
+template <typename T, size_t N>
+SpscQueue<T, N>::SpscQueue() : head(0), tail(0) {
+	static_assert((N & (N - 1)) == 0, "N must be a power of 2");
+}
+
+template <typename T, size_t N>
+T* SpscQueue<T, N>::reserve() {
+	uint32_t h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) >= N) return nullptr;
+	return slots + (h & (N - 1));
+}
+
+template <typename T, size_t N>
+void SpscQueue<T, N>::commit() {
+	head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <typename T, size_t N>
+T* SpscQueue<T, N>::front() {
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	if (t == head.load(std::memory_order_acquire)) return nullptr;
+	return slots + (t & (N - 1));
+}
+
+template <typename T, size_t N>
+void SpscQueue<T, N>::pop() {
+	tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
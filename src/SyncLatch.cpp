@@ -0,0 +1,59 @@
+#include "SyncLatch.h"
+
+SyncLatch::SyncLatch() {
+	target	= 0;
+	armed	= 0;
+	last_time = 0;
+	last		= Quaternion::identify();
+}
+
+void SyncLatch::arm(const uint8_t* command, uint32_t received_at) {
+	// AHRSタスクはarmedを見てからtargetを読むので、targetを先に書く
+	target = received_at + (command[2] | (uint16_t)command[3] << 8);
+	armed  = command[1];
+}
+
+bool SyncLatch::update(uint32_t timestamp, Quaternion q, uint8_t flags, data_sync_u* frame) {
+	uint32_t previous = last_time;
+	Quaternion p	   = last;
+	last_time		   = timestamp;
+	last			   = q;
+
+	uint8_t id = armed;
+	if (id == 0) return false;
+
+	uint32_t at	   = target;
+	int32_t remain = (int32_t)(at - timestamp);
+	if (remain > 0) return false;
+	armed = 0;
+
+	int32_t span   = (int32_t)(timestamp - previous);
+	int32_t before = span + remain;	 // 前のサンプルから指定時刻まで
+	if (before >= 0 && span > 0) {
+		// 前後のサンプルを線形補間して正規化する
+		float k	   = (float)before / span;
+		Quaternion r = p * (1.0f - k);
+		r += q * (p.x * q.x + p.y * q.y + p.z * q.z + p.w * q.w < 0.0f ? -k : k);
+		r.normalize();
+		q = r;
+
+		frame->timestamp = at;
+		frame->offset	  = 0;
+	} else {
+		// 受け取った時点で指定時刻を過ぎていた、より近い前のサンプルを使う
+		if (span > 0) {
+			q		= p;
+			timestamp = previous;
+		}
+		int32_t late	  = (int32_t)(timestamp - at);
+		frame->timestamp = timestamp;
+		frame->offset	  = late > 0x7fff ? 0x7fff : late;
+	}
+
+	frame->flags	   = flags | DATA_FLAG_SYNC;
+	frame->id	   = id;
+	frame->reserved = 0;
+	frame->ahrs	   = data_pack(q, 0);
+	data_seal(frame);
+	return true;
+}
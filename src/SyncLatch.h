@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+/// Worker側でCOMMAND_SYNCの時刻の姿勢を保持する
+/// 指定時刻を挟む2サンプルを補間する、指定時刻を過ぎてから受け取った場合は直後のサンプルを使う
+class SyncLatch {
+    public:
+	SyncLatch();
+
+	/// スレーブタスクでCOMMAND_SYNCを受け取った時に呼び出します、idが0なら何もしない
+	void arm(const uint8_t* command, uint32_t received_at);
+	/// AHRS更新毎に呼び出します、指定時刻を過ぎていればframeを作ってtrueを返します
+	bool update(uint32_t timestamp, Quaternion q, uint8_t flags, data_sync_u* frame);
+
+    private:
+	volatile uint32_t target;
+	volatile uint8_t armed;	 // 保持待ちのid、0なら無し
+
+	uint32_t last_time;
+	Quaternion last;
+};
@@ -0,0 +1,70 @@
+#include "Telemetry.h"
+
+#include <esp_timer.h>
+
+static int16_t saturate(int32_t value) { return value > 32767 ? 32767 : value < -32767 ? -32767 : value; }
+
+Telemetry::Telemetry() {
+	last_sample  = 0;
+	window_start = 0;
+	window_count = 0;
+	rate		   = 0;
+
+	calibration = 0;
+	temperature = TELEMETRY_NO_TEMPERATURE;
+	for (int i = 0; i < 3; i++) bias[i] = 0;
+
+	imu_errors	= 0;
+	slave_errors	= 0;
+	command_errors = 0;
+}
+
+void Telemetry::update(uint32_t timestamp) {
+	// ゼロバイアス測定の後、最初の更新から数え始める
+	if (last_sample == 0) window_start = timestamp;
+	last_sample = timestamp;
+
+	window_count++;
+	uint32_t elapsed = timestamp - window_start;
+	if (elapsed >= rate_window_us) {
+		rate		   = (uint64_t)window_count * 1000000 / elapsed;
+		window_start = timestamp;
+		window_count = 0;
+	}
+}
+
+void Telemetry::set_temperature(int16_t adc) {
+	// MPU6886: 326.8 LSB/度、0で25度
+	temperature = saturate((int32_t)adc * 10000 / 32680 + 2500);
+}
+
+void Telemetry::set_offset(Vector3<int32_t> offset) {
+	bias[0] = saturate(-offset.x);
+	bias[1] = saturate(-offset.y);
+	bias[2] = saturate(-offset.z);
+}
+
+void Telemetry::fill(data_telemetry_u* telemetry, uint8_t flags, uint32_t now) {
+	uint32_t age = now - last_sample;
+	// 最初の期間が終わるまでは、それまでの回数から求める
+	uint16_t r	  = rate;
+	uint32_t elapsed = last_sample - window_start;
+	if (r == 0 && elapsed > 0) r = (uint64_t)window_count * 1000000 / elapsed;
+
+	telemetry->flags		   = flags | DATA_FLAG_TELEMETRY;
+	telemetry->calibration	   = calibration;
+	telemetry->reserved	   = 0;
+	telemetry->uptime		   = esp_timer_get_time() / 1000;
+	telemetry->fusion_rate	   = age >= rate_window_us ? 0 : r;
+	telemetry->sample_age	   = last_sample == 0 || age > 0xffff ? 0xffff : age;
+	telemetry->temperature	   = temperature;
+	telemetry->bias[0]		   = bias[0];
+	telemetry->bias[1]		   = bias[1];
+	telemetry->bias[2]		   = bias[2];
+	telemetry->imu_errors	   = imu_errors;
+	telemetry->slave_errors   = slave_errors;
+	telemetry->command_errors = command_errors;
+	telemetry->reserved2	   = 0;
+	telemetry->reserved3	   = 0;
+	data_seal(telemetry);
+}
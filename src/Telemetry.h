@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Vector3.h"
+#include "data.h"
+
+/// Worker側で動作状況を集計し、COMMAND_GET_TELEMETRYの応答を作る
+/// カウンタは排他せずに加算するので、タスク間で重なればまれに数え漏れる
+class Telemetry {
+    public:
+	Telemetry();
+
+	/// AHRS更新毎に呼び出します
+	void update(uint32_t timestamp);
+	/// Calibration::Modeのビット、0なら完了
+	void set_calibration(uint8_t mode);
+	/// MPU6886のTEMP_OUTの値
+	void set_temperature(int16_t adc);
+	/// Calibrationの補正値（ゼロバイアスの符号を反転したもの）
+	void set_offset(Vector3<int32_t> offset);
+
+	void count_imu_error();
+	void count_slave_error();
+	void count_command_error();
+
+	/// スレーブタスクから呼び出します
+	void fill(data_telemetry_u* telemetry, uint8_t flags, uint32_t now);
+
+	/// AHRS更新回数を数える期間 [us]
+	static const uint32_t rate_window_us = 1000000;
+
+    private:
+	volatile uint32_t last_sample;
+	uint32_t window_start;
+	uint16_t window_count;
+	volatile uint16_t rate;
+
+	volatile uint8_t calibration;
+	volatile int16_t temperature;
+	volatile int16_t bias[3];
+
+	volatile uint16_t imu_errors;
+	volatile uint16_t slave_errors;
+	volatile uint16_t command_errors;
+};
+
+inline void Telemetry::set_calibration(uint8_t mode) { calibration = mode; }
+inline void Telemetry::count_imu_error() { imu_errors++; }
+inline void Telemetry::count_slave_error() { slave_errors++; }
+inline void Telemetry::count_command_error() { command_errors++; }
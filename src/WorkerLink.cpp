@@ -0,0 +1,528 @@
+#include "WorkerLink.h"
+
+#include <esp_timer.h>
+
+using namespace ESPIDF;
+
+// COMMAND_GET_RAWで姿勢を計算するMadgwickAHRSのbeta、Workerと同じ値
+#define FUSION_BETA 1.0f
+
+static size_t reply_length(uint8_t command) {
+	switch (command) {
+		case COMMAND_GET_QUATERNION:
+			return sizeof(data_u);
+		case COMMAND_GET_BATCH:
+			return sizeof(data_batch_u);
+		case COMMAND_GET_DELTA:
+			return sizeof(data_delta_u);
+		case COMMAND_GET_RAW:
+			return sizeof(data_raw_u);
+		default:
+			return sizeof(data_v2_u);
+	}
+}
+
+WorkerLink::WorkerLink() : fusion(FUSION_BETA) {
+	protocol	    = PROTOCOL_VERSION_1;
+	reply	    = COMMAND_GET_QUATERNION_V2;
+	staged	    = false;
+	stage	    = Stage::Command;
+	stage_confirmed = false;
+	empty_reads    = 0;
+	adaptive	    = 0;
+	unchanged	    = false;
+	misses	    = 0;
+	fallback_at    = 0;
+	sequence_valid = false;
+	sequence	    = 0;
+	lost		    = 0;
+	fresh	    = 0;
+
+	for (int i = 0; i < BATCH_SAMPLES; i++) samples[i] = {0, Quaternion::identify()};
+	fusion_time  = 0;
+	fusion_valid = false;
+
+	sync_busy	   = false;
+	sync_remain = 0;
+	sync_target = 0;
+	sync_late	   = 0;
+	synced	   = {0, 0, {0, Quaternion::identify()}};
+
+	ping_busy	    = false;
+	ping_ready	    = false;
+	ping_sent_at	    = 0;
+	ping_returned_at = 0;
+	ping_command[0]  = COMMAND_PING;
+	ping_command[1]  = 0;
+
+	telemetry_busy		 = false;
+	telemetry_ready	 = false;
+	telemetry_command[0] = COMMAND_GET_TELEMETRY;
+	telemetry.version	 = 0;
+	health			 = 0;
+}
+
+void WorkerLink::begin(uint8_t address, i2c_callback_t callback, void* context, uint8_t reply, bool staged) {
+	this->reply  = reply;
+	this->staged = staged;
+
+	request.address	 = address;
+	request.command	 = command;
+	request.retries	 = 1;
+	request.prepare	 = nullptr;
+	request.callback	 = callback;
+	request.context	 = context;
+
+	// 書き込みのみ、時刻を揃えるため再試行しない
+	sync_request.address		= address;
+	sync_request.command		= sync_command;
+	sync_request.command_length = sizeof(sync_command);
+	sync_request.buffer		= nullptr;
+	sync_request.length		= 0;
+	sync_request.delay_us	= 0;
+	sync_request.retries	= 0;
+	sync_request.prepare	= prepare_sync;
+	sync_request.callback	= on_sync_complete;
+	sync_request.context	= this;
+
+	// 往復時間が変わるので再試行しない
+	ping_request.address		= address;
+	ping_request.command		= ping_command;
+	ping_request.command_length = sizeof(ping_command);
+	ping_request.buffer		= ping_buffer.raw;
+	ping_request.length		= sizeof(data_ping_u);
+	ping_request.delay_us	= ping_delay_us;
+	ping_request.retries	= 0;
+	ping_request.prepare	= prepare_ping;
+	ping_request.callback	= on_ping_complete;
+	ping_request.context	= this;
+
+	telemetry_request.address		 = address;
+	telemetry_request.command		 = telemetry_command;
+	telemetry_request.command_length = sizeof(telemetry_command);
+	telemetry_request.buffer		 = telemetry_buffer.raw;
+	telemetry_request.length		 = sizeof(data_telemetry_u);
+	telemetry_request.delay_us	 = ping_delay_us;
+	telemetry_request.retries	 = 1;
+	telemetry_request.prepare	 = nullptr;
+	telemetry_request.callback	 = on_telemetry_complete;
+	telemetry_request.context	 = this;
+
+	set_protocol(PROTOCOL_VERSION_2);
+}
+
+void WorkerLink::set_protocol(uint8_t protocol) {
+	this->protocol = protocol;
+	request.buffer = buffer.v1.raw;
+
+	// GET_*コマンドを受け取ったWorkerはstagedを解除する
+	command[0]		    = protocol == PROTOCOL_VERSION_1 ? COMMAND_GET_QUATERNION : reply;
+	request.command_length = 1;
+	request.delay_us	    = 15;
+	request.length	    = reply_length(command[0]);
+
+	if (command[0] == COMMAND_GET_DELTA) {
+		// 受け取り済みのキーフレームを毎回通知する
+		command[1]		    = deltas.get_keyframe();
+		request.command_length = 2;
+	}
+	stage			    = Stage::Command;
+	empty_reads		    = 0;
+	unchanged		    = false;
+
+	misses	    = 0;
+	sequence_valid = false;
+	fusion_valid   = false;
+}
+
+void WorkerLink::fall_back() {
+	set_protocol(PROTOCOL_VERSION_1);
+	fallback_at = esp_timer_get_time();
+}
+
+void WorkerLink::set_staged() {
+	// 応答の種類を指定して、読み出しは行わない
+	command[1]		    = command[0];
+	command[0]		    = COMMAND_SET_STAGED;
+	request.command_length = 2;
+	if (adaptive && reply != COMMAND_GET_RAW) {
+		// 同じ書き込みで静止中の短い応答も要求する、未対応のWorkerは無視する
+		command[2]		    = COMMAND_SET_ADAPTIVE;
+		command[3]		    = adaptive;
+		request.command_length = 4;
+	}
+	request.length	    = 0;
+	stage			    = Stage::Request;
+	stage_confirmed	    = false;
+}
+
+Quaternion WorkerLink::get_rotation() {
+	// 直近のサンプルが最後に入っている、decode前は単位クォータニオン
+	return samples[BATCH_SAMPLES - 1].q;
+}
+
+esp_err_t WorkerLink::decode(size_t* count) {
+	*count = fresh = 0;
+	if (ping_ready) accept_ping();
+	if (telemetry_ready) accept_telemetry();
+	if (protocol == PROTOCOL_VERSION_1) {
+		esp_err_t err = decode_v1(count);
+		// 起動が遅れたv2のWorkerやファームウェアの更新に備えて、時々v2を試し直す
+		if (esp_timer_get_time() - fallback_at >= reprobe_us) set_protocol(PROTOCOL_VERSION_2);
+		return err;
+	}
+	if (stage != Stage::Command) return decode_staged(count);
+
+	// スレーブタスクがコマンドを受け取って書き込む前に読み出すとTX FIFOは空
+	// v2非対応のWorkerも未知のコマンドに応答しないので空になるが、一時的な空とは回数で区別する
+	// stagedと同じく重複として扱い、ポーリングの間隔は空けない
+	if (buffer.v2.version == DATA_EMPTY) {
+		if (++empty_reads >= stale_limit) fall_back();
+		return ESP_OK;
+	}
+	empty_reads = 0;
+
+	if (buffer.v2.version != PROTOCOL_VERSION_2) {
+		if (++misses >= fallback_misses) fall_back();
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	misses = 0;
+
+	if (buffer.v2.flags & DATA_FLAG_SYNC) return decode_sync(count);
+	esp_err_t err = decode_reply(count);
+	if (err == ESP_OK && staged) set_staged();
+
+	// 保持した姿勢は次の要求で読み出す
+	if (sync_remain > 0 && stage == Stage::Command) {
+		command[0]		    = COMMAND_GET_SYNC;
+		request.command_length = 1;
+	}
+	return err;
+}
+
+esp_err_t WorkerLink::decode_staged(size_t* count) {
+	if (stage == Stage::Request) {
+		// 以降はAHRS更新毎にWorkerが書き込んだ応答を読み出すだけ
+		command[0]		    = command[1];
+		request.command_length = 0;
+		request.delay_us	    = 0;
+		request.length	    = reply_length(reply);
+		stage			    = Stage::Staged;
+		return ESP_OK;
+	}
+
+	// キーフレームの通知は1度だけ書き込む、受け取れていなければ再送される
+	request.command_length = 0;
+
+	// 前回の読み出し以降にAHRSが更新されていなければTX FIFOは空
+	if (buffer.v2.version == DATA_EMPTY) {
+		if (++empty_reads >= stale_limit) {
+			// 一度も応答が無ければCOMMAND_SET_STAGED非対応とみなす
+			if (!stage_confirmed) staged = false;
+			set_protocol(PROTOCOL_VERSION_2);
+		}
+		return ESP_OK;
+	}
+	empty_reads = 0;
+
+	if (buffer.v2.version != PROTOCOL_VERSION_2) {
+		if (++misses >= fallback_misses) set_protocol(PROTOCOL_VERSION_2);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	misses = 0;
+
+	// 保持した姿勢はstagedの応答の代わりに1度だけ書き込まれる
+	if (buffer.v2.flags & DATA_FLAG_SYNC) return decode_sync(count);
+	if (sync_remain > 0) sync_remain--;
+
+	if (buffer.v2.flags & DATA_FLAG_UNCHANGED) return decode_status(count);
+	if (unchanged) {
+		// 動き出した、先頭しか読んでいないので次から全体を読み出す
+		unchanged	    = false;
+		request.length = reply_length(reply);
+		return ESP_OK;
+	}
+
+	// 読み出し中にWorkerがTX FIFOを書き直すと前後が混ざるが、CRCで破棄される
+	esp_err_t err = decode_reply(count);
+	if (err == ESP_OK) stage_confirmed = true;
+	return err;
+}
+
+esp_err_t WorkerLink::decode_reply(size_t* count) {
+	esp_err_t err;
+	switch (reply) {
+		case COMMAND_GET_BATCH:
+			err = decode_batch(count);
+			break;
+		case COMMAND_GET_DELTA:
+			err = decode_delta(count);
+			break;
+		case COMMAND_GET_RAW:
+			err = decode_raw(count);
+			break;
+		default:
+			err = decode_v2(count);
+			break;
+	}
+	fresh = *count;
+	return err;
+}
+
+esp_err_t WorkerLink::decode_v1(size_t* count) {
+	data_u* data = &buffer.v1;
+	if (data->header != SYNC_HEADER || data->footer != SYNC_FOOTER) return ESP_ERR_INVALID_RESPONSE;
+
+	samples[BATCH_SAMPLES - 1] = {0, data->ahrs};
+	*count = fresh			  = 1;
+	return ESP_OK;
+}
+
+esp_err_t WorkerLink::decode_v2(size_t* count) {
+	data_v2_u* data = &buffer.v2;
+	if (!data_verify(data)) return ESP_ERR_INVALID_CRC;
+	if (data->flags & DATA_FLAG_CALIBRATING) return ESP_OK;
+
+	accept(data->sequence, 1, count);
+	if (*count > 1) *count = 1;
+	if (*count) samples[BATCH_SAMPLES - 1] = {data->timestamp, data->ahrs};
+	return ESP_OK;
+}
+
+esp_err_t WorkerLink::decode_batch(size_t* count) {
+	data_batch_u* data = &buffer.batch;
+	if (!data_verify(data)) return ESP_ERR_INVALID_CRC;
+	if ((data->flags & DATA_FLAG_CALIBRATING) || data->count == 0) return ESP_OK;
+
+	accept(data->sequence, BATCH_SAMPLES, count);
+	if (*count > data->count) {
+		lost += *count - data->count;
+		*count = data->count;
+	}
+
+	// 新しい順に並んでいるので、古い順にsamplesの末尾へ詰める
+	for (int i = 0; i < *count; i++) {
+		packed_quaternion_t* p			= data->samples + i;
+		samples[BATCH_SAMPLES - 1 - i] = {data->timestamp - (uint32_t)p->age * BATCH_AGE_UNIT_US, data_unpack(*p)};
+	}
+	return ESP_OK;
+}
+
+esp_err_t WorkerLink::decode_delta(size_t* count) {
+	data_delta_u* data = &buffer.delta;
+	if (!data_verify(data)) return ESP_ERR_INVALID_CRC;
+	if (data->flags & DATA_FLAG_CALIBRATING) return ESP_OK;
+
+	uint32_t timestamps[DELTA_SAMPLES];
+	Quaternion decoded[DELTA_SAMPLES];
+	uint8_t n;
+	bool known = deltas.decode(data, timestamps, decoded, &n);
+
+	// 新しいキーフレームを受け取った、または基準のキーフレームを持っていなければ通知する
+	if (!known || (data->flags & DATA_FLAG_KEYFRAME)) acknowledge_keyframe();
+	if (!known || n == 0) return ESP_OK;
+
+	accept(data->sequence, DELTA_SAMPLES, count);
+	if (*count > n) {
+		lost += *count - n;
+		*count = n;
+	}
+
+	for (int i = 0; i < *count; i++) samples[BATCH_SAMPLES - 1 - i] = {timestamps[i], decoded[i]};
+	return ESP_OK;
+}
+
+esp_err_t WorkerLink::decode_status(size_t* count) {
+	data_status_u* data = &buffer.status;
+	if (!data_verify(data)) return ESP_ERR_INVALID_CRC;
+	stage_confirmed = true;
+
+	// 以降は静止中の短い応答の長さだけ読み出す
+	unchanged	    = true;
+	request.length = sizeof(data_status_u);
+	if (data->flags & DATA_FLAG_CALIBRATING) return ESP_OK;
+
+	// 静止中のサンプルは最新の1つで代表する、飛ばした分は失ったとみなさない
+	accept(data->sequence, 1, count);
+	if (*count > 1) *count = 1;
+	if (*count) samples[BATCH_SAMPLES - 1] = {data->timestamp, data_unpack(data->ahrs)};
+	fresh = *count;
+	return ESP_OK;
+}
+
+esp_err_t WorkerLink::decode_raw(size_t* count) {
+	data_raw_u* data = &buffer.raw;
+	if (!data_verify(data)) return ESP_ERR_INVALID_CRC;
+	if ((data->flags & DATA_FLAG_CALIBRATING) || data->count == 0) return ESP_OK;
+
+	accept(data->sequence, RAW_SAMPLES, count);
+	if (*count > data->count) {
+		lost += *count - data->count;
+		*count = data->count;
+	}
+
+	// 新しい順に並んでいるので、古いものから順にAHRSへ通す
+	for (int i = *count - 1; i >= 0; i--) {
+		raw_sample_t* r = data->samples + i;
+		uint32_t time   = data->timestamp - (uint32_t)r->age * BATCH_AGE_UNIT_US;
+		// 取りこぼした間はこのサンプルの角速度が続いたとみなす
+		uint32_t gap = time - fusion_time;
+		if (gap > fusion_gap_us) gap = fusion_gap_us;
+		float dt = fusion_valid ? gap * 1e-6f : 0.0f;
+
+		Vector3<float> gyro  = {r->gx * RAW_GYRO_SCALE, r->gy * RAW_GYRO_SCALE, r->gz * RAW_GYRO_SCALE};
+		Vector3<float> accel = {r->ax * RAW_ACCEL_SCALE, r->ay * RAW_ACCEL_SCALE, r->az * RAW_ACCEL_SCALE};
+		fusion.update(gyro, accel, dt);
+		fusion_time  = time;
+		fusion_valid = true;
+
+		samples[BATCH_SAMPLES - 1 - i] = {time, fusion.q};
+	}
+	return ESP_OK;
+}
+
+void WorkerLink::acknowledge_keyframe() {
+	command[1] = deltas.get_keyframe();
+	if (stage == Stage::Staged) {
+		// 読み出しはそのまま、次の要求でのみ書き込む
+		command[0]		    = COMMAND_ACK_KEYFRAME;
+		request.command_length = 2;
+	}
+}
+
+bool WorkerLink::sync(I2CQueue* queue, uint8_t id, int64_t target, TickType_t timeout) {
+	if (sync_busy || protocol == PROTOCOL_VERSION_1) return false;
+
+	sync_target	   = target;
+	sync_command[0] = COMMAND_SYNC;
+	sync_command[1] = id;
+	sync_busy	   = queue->submit(&sync_request, timeout);
+	return sync_busy;
+}
+
+void WorkerLink::prepare_sync(i2c_request_t* request) {
+	WorkerLink* self = (WorkerLink*)request->context;
+
+	// 書き込みにかかる時間は全Workerで同じなので、残り時間だけを渡せば揃う
+	int64_t lead	   = self->sync_target - esp_timer_get_time();
+	self->sync_late = lead < 0 ? -lead : 0;
+	if (lead < 0) lead = 0;
+	if (lead > 0xffff) lead = 0xffff;
+	self->sync_command[2] = lead & 0xff;
+	self->sync_command[3] = lead >> 8;
+}
+
+void WorkerLink::on_sync_complete(i2c_request_t* request) {
+	WorkerLink* self = (WorkerLink*)request->context;
+	if (request->result == ESP_OK) self->sync_remain = sync_polls;
+	self->sync_busy = false;
+}
+
+esp_err_t WorkerLink::decode_sync(size_t* count) {
+	data_sync_u* data = &buffer.sync;
+	if (!data_verify(data)) return ESP_ERR_INVALID_CRC;
+
+	// コマンド毎の応答なら、指定したidを受け取るか回数を使い切るまで読み出しに行く
+	bool expected = data->id == sync_command[1];
+	if (stage == Stage::Command && !expected && sync_remain > 1) {
+		sync_remain--;
+	} else {
+		sync_remain = 0;
+		if (stage == Stage::Command) {
+			command[0]		    = reply;
+			request.command_length = reply == COMMAND_GET_DELTA ? 2 : 1;
+		}
+	}
+
+	if (!expected || synced.id == data->id || (data->flags & DATA_FLAG_CALIBRATING)) return ESP_OK;
+
+	int32_t offset = data->offset + sync_late;
+
+	synced.id			= data->id;
+	synced.offset		= offset > 0x7fff ? 0x7fff : offset;
+	synced.sample		= {data->timestamp, data_unpack(data->ahrs)};
+	samples[BATCH_SAMPLES - 1] = synced.sample;
+	*count = fresh			= 1;
+	return ESP_OK;
+}
+
+bool WorkerLink::ping(I2CQueue* queue, TickType_t timeout) {
+	if (ping_busy || ping_ready || protocol == PROTOCOL_VERSION_1) return false;
+
+	ping_command[1] = ping_command[1] % 255 + 1;
+	ping_busy	    = queue->submit(&ping_request, timeout);
+	return ping_busy;
+}
+
+void WorkerLink::prepare_ping(i2c_request_t* request) {
+	WorkerLink* self   = (WorkerLink*)request->context;
+	self->ping_sent_at = esp_timer_get_time();
+}
+
+void WorkerLink::on_ping_complete(i2c_request_t* request) {
+	// 推定はdecodeを呼ぶタスクで行う
+	WorkerLink* self	       = (WorkerLink*)request->context;
+	self->ping_returned_at = esp_timer_get_time();
+	self->ping_ready	       = request->result == ESP_OK;
+	self->ping_busy	       = false;
+}
+
+void WorkerLink::accept_ping() {
+	ping_ready	     = false;
+	data_ping_u* data = &ping_buffer;
+
+	// 応答を書き込む前にstagedの応答を読み出した場合などは捨てる
+	if (data->version != PROTOCOL_VERSION_2 || !(data->flags & DATA_FLAG_PING) || data->id != ping_command[1]) return;
+	if (!data_verify(data)) return;
+
+	clock.add(ping_sent_at, data->received, data->replied, ping_returned_at);
+}
+
+bool WorkerLink::request_telemetry(I2CQueue* queue, TickType_t timeout) {
+	// ポーリングされていない間も前回の結果を反映する
+	if (telemetry_ready) accept_telemetry();
+	if (telemetry_busy || protocol == PROTOCOL_VERSION_1) return false;
+
+	telemetry_busy = queue->submit(&telemetry_request, timeout);
+	return telemetry_busy;
+}
+
+void WorkerLink::on_telemetry_complete(i2c_request_t* request) {
+	WorkerLink* self	      = (WorkerLink*)request->context;
+	self->telemetry_ready = request->result == ESP_OK;
+	self->telemetry_busy  = false;
+}
+
+void WorkerLink::accept_telemetry() {
+	telemetry_ready	     = false;
+	data_telemetry_u* data = &telemetry_buffer;
+
+	// stagedの応答を読み出した場合や、COMMAND_GET_TELEMETRY非対応のWorkerは捨てる
+	if (data->version != PROTOCOL_VERSION_2 || !(data->flags & DATA_FLAG_TELEMETRY)) return;
+	if (!data_verify(data)) return;
+
+	uint8_t h = 0;
+	if (data->calibration || (data->flags & DATA_FLAG_CALIBRATING)) {
+		// 測定中はAHRSを更新しない
+		h |= WORKER_HEALTH_CALIBRATING;
+	} else {
+		if (data->fusion_rate < health_min_rate) h |= WORKER_HEALTH_SLOW;
+		if (data->sample_age > health_max_age_us) h |= WORKER_HEALTH_STALE;
+	}
+	if (telemetry.version == PROTOCOL_VERSION_2 &&
+	    (data->imu_errors != telemetry.imu_errors || data->slave_errors != telemetry.slave_errors || data->command_errors != telemetry.command_errors)) {
+		h |= WORKER_HEALTH_ERRORS;
+	}
+
+	health	= h;
+	telemetry = *data;
+}
+
+void WorkerLink::accept(uint16_t sequence, size_t depth, size_t* count) {
+	// 初回と、Workerの再起動で連番が戻った・応答の深さより先に飛んだ場合は数え直す
+	// 1サンプル分のみ新しいとみなし、飛んだ分は失ったとみなさない
+	int16_t step   = (int16_t)(sequence - this->sequence);
+	*count		   = sequence_valid && step >= 0 && step <= depth ? step : 1;
+	sequence_valid = true;
+	this->sequence = sequence;
+}
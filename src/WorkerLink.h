@@ -0,0 +1,203 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ClockSync.h"
+#include "DeltaCodec.h"
+#include "MadgwickAHRS.h"
+#include "Vector3.h"
+#include "data.h"
+#include "i2cqueue.h"
+
+struct worker_sample_t {
+	uint32_t time;	// Worker側のサンプル時刻 [us]、v1では0
+	Quaternion q;
+};
+
+struct worker_sync_t {
+	uint8_t id;		// 0なら未受信
+	int16_t offset;	// 保持した時刻と指定した時刻の差 [us]、書き込みが間に合わなかった分を含む
+	worker_sample_t sample;
+};
+
+// テレメトリから判断したWorkerの劣化の理由
+#define WORKER_HEALTH_CALIBRATING ((uint8_t)0x01)  // ゼロバイアス測定中
+#define WORKER_HEALTH_SLOW ((uint8_t)0x02)		  // AHRSの更新レートが低い
+#define WORKER_HEALTH_STALE ((uint8_t)0x04)	  // 最新サンプルが古い
+#define WORKER_HEALTH_ERRORS ((uint8_t)0x08)	  // 前回からエラーが増えた
+
+/// Parent側で1台のWorkerとのプロトコル（v1 / v2 / バッチ転送）を扱う
+/// v2（replyで指定した応答）から始めて、応答が無ければv1に切り替え、reprobe_us毎にv2を試し直す
+/// v2の応答が得られた後は、WorkerにTX FIFOへ応答を先に書かせてコマンド無しで読み出す（staged）
+class WorkerLink {
+    public:
+	WorkerLink();
+
+	/// reply: COMMAND_GET_QUATERNION_V2 / COMMAND_GET_BATCH / COMMAND_GET_DELTA / COMMAND_GET_RAW
+	/// COMMAND_GET_RAWはWorkerのIMUの値からParent側で姿勢を計算する
+	void begin(uint8_t address, ESPIDF::i2c_callback_t callback, void* context, uint8_t reply = COMMAND_GET_BATCH, bool staged = true);
+	ESPIDF::i2c_request_t* get_request();
+
+	/// 完了した要求の応答を検証します、countには前回から増えたサンプル数が入る（0なら重複）
+	esp_err_t decode(size_t* count);
+
+	uint8_t get_protocol();
+	/// コマンド無しで読み出しているか
+	bool is_staged();
+	/// 最新の姿勢
+	Quaternion get_rotation();
+	/// 直近のdecodeで得た新しいサンプル（古い順）
+	const worker_sample_t* get_samples();
+	/// 連番の飛びから数えた、受け取れなかったサンプル数
+	/// Workerの再起動で連番が戻った・応答の深さより先に飛んだ場合は数え直し、失ったとはみなさない
+	uint32_t get_lost();
+
+	/// stagedで静止中は短い応答（data_status_u）だけを読み出す、しきい値 [0.1度]、0なら使わない
+	/// 次にstagedを要求する時に反映される、beginの前に呼び出すこと
+	void set_adaptive(uint8_t tenth_degrees);
+	/// 直近の応答でWorkerが静止中と通知したか
+	bool is_unchanged();
+
+	/// targetの時刻の姿勢をWorkerに保持させます、前回の要求が送信中・v1・キューが一杯ならfalse
+	/// targetはesp_timer_get_time基準、バスに出す直前に残り時間を詰めるので全Workerで揃う
+	/// 保持した姿勢はdecodeで通常のサンプルと同様に1つ増え、get_syncでも得られる
+	bool sync(ESPIDF::I2CQueue* queue, uint8_t id, int64_t target, TickType_t timeout);
+	const worker_sync_t* get_sync();
+	/// 保持させた姿勢をまだ受け取っていなければtrue、指定時刻を過ぎたら読み出しに行く
+	bool is_sync_pending();
+
+	/// v2以外の応答がこの回数続けば、v2非対応とみなす
+	static const uint8_t fallback_misses = 4;
+	/// TX FIFOが空の読み出しがこの回数続けば、stagedならコマンド毎の応答に戻し、コマンド毎ならv2非対応とみなす
+	static const uint8_t stale_limit = 32;
+	/// v1に切り替えてからv2を試し直すまでの時間 [us]
+	static const int64_t reprobe_us = 10000000;
+	/// Workerとの往復から時計のずれを測ります、前回の要求が送信中・v1・キューが一杯ならfalse
+	/// 結果は次のdecodeでget_clockに反映される
+	bool ping(ESPIDF::I2CQueue* queue, TickType_t timeout);
+	/// Workerの時刻（worker_sample_t::time）をParentのesp_timer_get_timeに変換する
+	ClockSync* get_clock();
+
+	/// Workerの動作状況を要求します、前回の要求が送信中・v1・キューが一杯ならfalse
+	/// 結果は次のdecodeか次の要求でget_telemetry / get_healthに反映される
+	bool request_telemetry(ESPIDF::I2CQueue* queue, TickType_t timeout);
+	/// 直近のテレメトリ、受け取っていなければversionが0
+	const data_telemetry_u* get_telemetry();
+	/// 直近のテレメトリから判断した劣化の理由（WORKER_HEALTH_*）、0なら正常
+	uint8_t get_health();
+
+	/// AHRSの更新レートがこれを下回れば劣化とみなす [Hz]
+	static const uint16_t health_min_rate = 100;
+	/// 最新サンプルがこれより古ければ劣化とみなす [us]
+	static const uint16_t health_max_age_us = 50000;
+	/// 保持した姿勢をこの回数の読み出しまで待つ
+	static const uint8_t sync_polls = 4;
+	/// COMMAND_PING / COMMAND_GET_TELEMETRYの書き込みから応答を読み出すまでの待ち時間、Workerのスレーブタスクが起きて書き込む程度
+	static const uint32_t ping_delay_us = 300;
+	/// COMMAND_GET_RAWでサンプルの間隔をこれ以下に制限して積分する [us]
+	static const uint32_t fusion_gap_us = 100000;
+
+    private:
+	void set_protocol(uint8_t protocol);
+	void fall_back();
+	void set_staged();
+	esp_err_t decode_staged(size_t* count);
+	esp_err_t decode_reply(size_t* count);
+	esp_err_t decode_v1(size_t* count);
+	esp_err_t decode_v2(size_t* count);
+	esp_err_t decode_batch(size_t* count);
+	esp_err_t decode_delta(size_t* count);
+	esp_err_t decode_status(size_t* count);
+	esp_err_t decode_raw(size_t* count);
+	void acknowledge_keyframe();
+	esp_err_t decode_sync(size_t* count);
+	static void prepare_sync(ESPIDF::i2c_request_t* request);
+	static void on_sync_complete(ESPIDF::i2c_request_t* request);
+	void accept_ping();
+	static void prepare_ping(ESPIDF::i2c_request_t* request);
+	static void on_ping_complete(ESPIDF::i2c_request_t* request);
+	void accept_telemetry();
+	static void on_telemetry_complete(ESPIDF::i2c_request_t* request);
+	/// depthは応答が持てるサンプル数、countには連番から求めた新しいサンプル数が入る
+	void accept(uint16_t sequence, size_t depth, size_t* count);
+
+	ESPIDF::i2c_request_t request;
+	union {
+		data_u v1;
+		data_v2_u v2;
+		data_batch_u batch;
+		data_delta_u delta;
+		data_sync_u sync;
+		data_status_u status;
+		data_raw_u raw;
+	} buffer;
+
+	enum class Stage : uint8_t {
+		Command,	// コマンドを書き込んでから読み出す
+		Request,	// COMMAND_SET_STAGEDを送信中
+		Staged,	// 読み出しのみ
+	};
+
+	uint8_t command[4];
+	uint8_t protocol;
+	uint8_t misses;
+	int64_t fallback_at;  // v1に切り替えた時刻
+	uint8_t reply;
+	bool staged;
+	Stage stage;
+	bool stage_confirmed;  // stagedで有効な応答を1度でも得たか
+	uint8_t empty_reads;
+	uint8_t adaptive;
+	bool unchanged;
+	bool sequence_valid;
+	uint16_t sequence;
+	uint32_t lost;
+	DeltaDecoder deltas;
+
+	size_t fresh;
+	worker_sample_t samples[BATCH_SAMPLES];
+
+	MadgwickAHRS fusion;
+	uint32_t fusion_time;  // 最後に積分したサンプルの時刻
+	bool fusion_valid;
+
+	ESPIDF::i2c_request_t sync_request;
+	uint8_t sync_command[4];
+	int64_t sync_target;
+	int32_t sync_late;	// 書き込んだ時点で指定時刻を過ぎていた時間 [us]
+	volatile bool sync_busy;
+	volatile uint8_t sync_remain;  // コマンド毎の応答でCOMMAND_GET_SYNCを送る残り回数
+	worker_sync_t synced;
+
+	ESPIDF::i2c_request_t ping_request;
+	uint8_t ping_command[2];
+	data_ping_u ping_buffer;
+	int64_t ping_sent_at;
+	int64_t ping_returned_at;
+	volatile bool ping_busy;
+	volatile bool ping_ready;  // 完了したがaccept_pingしていない
+	ClockSync clock;
+
+	ESPIDF::i2c_request_t telemetry_request;
+	uint8_t telemetry_command[1];
+	data_telemetry_u telemetry_buffer;
+	data_telemetry_u telemetry;
+	volatile bool telemetry_busy;
+	volatile bool telemetry_ready;	// 完了したがaccept_telemetryしていない
+	uint8_t health;
+};
+
+inline ESPIDF::i2c_request_t* WorkerLink::get_request() { return &request; }
+inline uint8_t WorkerLink::get_protocol() { return protocol; }
+inline bool WorkerLink::is_staged() { return stage == Stage::Staged; }
+inline const worker_sample_t* WorkerLink::get_samples() { return samples + BATCH_SAMPLES - fresh; }
+inline uint32_t WorkerLink::get_lost() { return lost; }
+inline void WorkerLink::set_adaptive(uint8_t tenth_degrees) { adaptive = tenth_degrees; }
+inline bool WorkerLink::is_unchanged() { return unchanged; }
+inline const worker_sync_t* WorkerLink::get_sync() { return &synced; }
+inline bool WorkerLink::is_sync_pending() { return sync_remain > 0; }
+inline ClockSync* WorkerLink::get_clock() { return &clock; }
+inline const data_telemetry_u* WorkerLink::get_telemetry() { return &telemetry; }
+inline uint8_t WorkerLink::get_health() { return health; }
@@ -0,0 +1,225 @@
+#include "WorkerSlave.h"
+
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <string.h>
+
+using namespace ESPIDF;
+
+// Gyro scale (±2000 degree/seconds Range by int16_t data -> rad / seconds)
+// (1.0f / 32768.0f * 2000.0f / 180.0f * 3.14159265358979323846264338327950288f);
+static const float s = 0.00106526443603169529841533860372f;
+
+// Accelemeter scale (± 8G Range by int16_t data -> m/s^2)
+static const float t = 8.0 / 32768.0;
+
+WorkerSlave::WorkerSlave(I2CSlave* slave, worker_clock_t clock, void* context) : ahrs(1.0f) {
+	this->slave	= slave;
+	this->clock	= clock;
+	this->context = context;
+	protocol	     = PROTOCOL_VERSION_2;
+	staged_reply  = 0;
+	// Workerの時刻は0から始まるとは限らない
+	hold_until    = get_time();
+	reply	     = 0;
+	written	     = 0;
+	fifo_lock     = xSemaphoreCreateMutex();
+
+	ahrs.reset();
+
+	memset(&packet, 0, sizeof(packet));
+	packet.v1.header = SYNC_HEADER;
+	packet.v1.ahrs	  = Quaternion::identify();
+	packet.v1.footer = SYNC_FOOTER;
+
+	packet.v2.flags	    = DATA_FLAG_CALIBRATING;
+	packet.v2.sequence  = 0;
+	packet.v2.timestamp = 0;
+	packet.v2.ahrs	    = Quaternion::identify();
+	packet.v2.reserved  = 0;
+
+	packet.sync.flags = DATA_FLAG_SYNC;
+	data_seal(&packet.sync);
+	publish();
+}
+
+uint32_t WorkerSlave::get_time() { return clock ? clock(context) : (uint32_t)esp_timer_get_time(); }
+
+void WorkerSlave::hold_reply(uint32_t now, uint32_t duration) {
+	if ((int32_t)(now + duration - hold_until) > 0) hold_until = now + duration;
+}
+
+bool WorkerSlave::is_holding(uint32_t now) { return (int32_t)(hold_until - now) > 0; }
+
+void WorkerSlave::write_fifo(uint8_t* data, size_t length) {
+	if (slave->write_bytes(data, length, true, 10 / portTICK_RATE_MS) < (int)length) telemetry.count_slave_error();
+}
+
+void WorkerSlave::write_reply(worker_packet_t* packet, uint8_t command) {
+	switch (command) {
+		case COMMAND_GET_QUATERNION:
+			write_fifo(packet->v1.raw, sizeof(data_u));
+			break;
+		case COMMAND_GET_QUATERNION_V2:
+			write_fifo(packet->v2.raw, sizeof(data_v2_u));
+			break;
+		case COMMAND_GET_BATCH:
+			write_fifo(packet->batch.raw, sizeof(data_batch_u));
+			break;
+		case COMMAND_GET_DELTA:
+			write_fifo(packet->delta.raw, sizeof(data_delta_u));
+			break;
+		case COMMAND_GET_SYNC:
+			write_fifo(packet->sync.raw, sizeof(data_sync_u));
+			break;
+		case COMMAND_GET_RAW:
+			write_fifo(packet->raw.raw, sizeof(data_raw_u));
+			break;
+	}
+}
+
+void WorkerSlave::serve() {
+	data_ping_u ping;
+	data_telemetry_u health;
+
+	// COMMAND_SYNCの受信時刻を得るため、1byte目は受信するまで待つ
+	// i2c_slave_read_bufferは要求した長さに達するまで待つので、残りは別に読み出す
+	size_t length	   = slave->read_bytes(rx, 1, 1);
+	uint32_t received_at = get_time();
+	if (length > 0) length += slave->read_bytes(rx + 1, sizeof(rx) - 1, 0);
+
+	uint8_t previous = reply;
+	for (size_t i = 0; i < length;) {
+		size_t n = data_command_length(rx[i]);
+		if (n == 0 || i + n > length) {
+			telemetry.count_command_error();
+			break;
+		}
+
+		// v1のWorkerは未知のコマンドを受け取ると応答しなくなる
+		if (protocol < PROTOCOL_VERSION_2 && rx[i] != COMMAND_GET_QUATERNION) {
+			reply = 0;
+			i += n;
+			continue;
+		}
+
+		switch (rx[i]) {
+			case COMMAND_GET_QUATERNION:
+			case COMMAND_GET_QUATERNION_V2:
+			case COMMAND_GET_BATCH:
+			case COMMAND_GET_SYNC:
+			case COMMAND_GET_RAW:
+				staged_reply = 0;
+				reply	   = rx[i];
+				break;
+			case COMMAND_GET_DELTA:
+				staged_reply = 0;
+				reply	   = rx[i];
+				deltas.acknowledge(rx[i + 1]);
+				break;
+			case COMMAND_ACK_KEYFRAME:
+				deltas.acknowledge(rx[i + 1]);
+				break;
+			case COMMAND_SET_STAGED:
+				// 以降のTX FIFOはAHRSタスクが書き込む
+				staged_reply = data_stageable(rx[i + 1]) ? rx[i + 1] : 0;
+				reply	   = 0;
+				break;
+			case COMMAND_SYNC:
+				latch.arm(rx + i, received_at);
+				break;
+			case COMMAND_SET_ADAPTIVE:
+				gate.set_threshold(rx[i + 1]);
+				break;
+			case COMMAND_PING:
+				ping.flags	   = DATA_FLAG_PING;
+				ping.id		   = rx[i + 1];
+				ping.reserved  = 0;
+				ping.received  = received_at;
+				ping.reserved2 = 0;
+				xSemaphoreTake(fifo_lock, portMAX_DELAY);
+				ping.replied = get_time();
+				data_seal(&ping);
+				write_fifo(ping.raw, sizeof(data_ping_u));
+				hold_reply(ping.replied, ping_hold_us);
+				xSemaphoreGive(fifo_lock);
+				break;
+			case COMMAND_GET_TELEMETRY:
+				published.read(&replying);
+				xSemaphoreTake(fifo_lock, portMAX_DELAY);
+				telemetry.fill(&health, replying.v2.flags, get_time());
+				write_fifo(health.raw, sizeof(data_telemetry_u));
+				hold_reply(get_time(), ping_hold_us);
+				xSemaphoreGive(fifo_lock);
+				break;
+		}
+		i += n;
+	}
+
+	// コマンドが変わった場合はすぐに、それ以外はtick毎に書き直す
+	TickType_t now = xTaskGetTickCount();
+	if (reply == 0 || (reply == previous && now == written)) return;
+	published.read(&replying);
+	xSemaphoreTake(fifo_lock, portMAX_DELAY);
+	if (reply != previous || !is_holding(get_time())) {
+		write_reply(&replying, reply);
+		written = now;
+	}
+	xSemaphoreGive(fifo_lock);
+}
+
+void WorkerSlave::set_calibrating(bool calibrating) {
+	if (calibrating) {
+		packet.v2.flags |= DATA_FLAG_CALIBRATING;
+	} else {
+		packet.v2.flags &= ~DATA_FLAG_CALIBRATING;
+	}
+	publish();
+}
+
+Quaternion WorkerSlave::update(uint32_t timestamp, Vector3<int32_t> g, Vector3<int32_t> a) {
+	ahrs.update(g * s, a * t);
+
+	packet.v1.ahrs	    = ahrs.q;
+	packet.v2.sequence  = samples.push(timestamp, ahrs.q);
+	raws.push(timestamp, g, a);
+	deltas.push(timestamp, ahrs.q);
+	packet.v2.timestamp = timestamp;
+	packet.v2.ahrs	    = ahrs.q;
+	telemetry.update(timestamp);
+
+	bool synced = latch.update(timestamp, ahrs.q, packet.v2.flags, &packet.sync);
+	bool idle	= gate.update(packet.v2.sequence, ahrs.q);
+	if (idle) gate.fill(&packet.status, packet.v2.flags, packet.v2.sequence, timestamp, ahrs.q);
+	publish(synced, idle);
+
+	return ahrs.q;
+}
+
+void WorkerSlave::publish(bool synced, bool idle) {
+	data_seal(&packet.v2);
+	samples.fill(&packet.batch, packet.v2.flags);
+	deltas.fill(&packet.delta, packet.v2.flags);
+	raws.fill(&packet.raw, packet.v2.flags, packet.v2.sequence);
+	published.publish(packet);
+
+	// Parentの読み出しと重なった場合は途中で切り替わるが、CRCで検出できる
+	// スレーブタスクが書いたping・テレメトリの応答を消さないよう、保持期間の確認から書き込みまでをまとめて行う
+	uint8_t reply = staged_reply;
+	xSemaphoreTake(fifo_lock, portMAX_DELAY);
+	uint32_t now = get_time();
+	if (synced) {
+		hold_reply(now, sync_hold_us);
+		if (reply) reply = COMMAND_GET_SYNC;
+	} else if (is_holding(now)) {
+		reply = 0;
+	}
+
+	// 静止中は短い応答にして、Parentの読み出しを減らす
+	if (reply && reply != COMMAND_GET_SYNC && reply != COMMAND_GET_RAW && idle) {
+		write_fifo(packet.status.raw, sizeof(data_status_u));
+	} else if (reply) {
+		write_reply(&packet, reply);
+	}
+	xSemaphoreGive(fifo_lock);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "DeltaCodec.h"
+#include "MadgwickAHRS.h"
+#include "MotionGate.h"
+#include "RawBatch.h"
+#include "SampleBatch.h"
+#include "Snapshot.h"
+#include "SyncLatch.h"
+#include "Telemetry.h"
+#include "Vector3.h"
+#include "data.h"
+#include "i2c.h"
+
+/// AHRSの更新毎に作り直す応答一式、スレーブタスクはSnapshotから待たずに読み出す
+struct worker_packet_t {
+	data_u v1;
+	data_v2_u v2;
+	data_batch_u batch;
+	data_delta_u delta;
+	data_sync_u sync;
+	data_status_u status;
+	data_raw_u raw;
+};
+
+/// Workerの時刻 [us] を返す
+typedef uint32_t (*worker_clock_t)(void* context);
+
+/// Worker側のI2Cスレーブ、Parentからのコマンドを解釈してTX FIFOに応答を書き込む
+/// AHRSタスクがupdateで姿勢を計算して応答一式を公開し、スレーブタスクがserveでコマンドを受け取る
+/// 実機のWorkerとシミュレータで共通
+class WorkerSlave {
+    public:
+	/// clockがnullptrならesp_timer_get_timeをWorkerの時刻とする
+	WorkerSlave(ESPIDF::I2CSlave* slave, worker_clock_t clock = nullptr, void* context = nullptr);
+
+	/// スレーブタスクから繰り返し呼び出します
+	/// 1byte目を受信するまで最大1tick待ち、受信が無くても直前のCOMMAND_GET_*の応答をtick毎に書き直す
+	void serve();
+
+	/// 以降はAHRSタスクから呼び出します
+	/// ゼロバイアスの測定中はDATA_FLAG_CALIBRATINGを付けて公開する
+	void set_calibrating(bool calibrating);
+	/// IMUの値でAHRSを更新して公開します、timestampはIMUを読み出す前のWorkerの時刻
+	/// 更新後の姿勢を返します
+	Quaternion update(uint32_t timestamp, Vector3<int32_t> gyro, Vector3<int32_t> accel);
+
+	/// 対応するプロトコルの最大バージョン、v1ならCOMMAND_GET_QUATERNION以外を無視する（v1のWorkerの再現用）
+	void set_protocol(uint8_t protocol);
+	uint32_t get_time();
+	Telemetry* get_telemetry();
+	/// 最後に公開した応答一式
+	void read(worker_packet_t* packet);
+
+	/// 同期した姿勢の応答をTX FIFOに残す時間、この間は通常の応答を書き込まない
+	static const uint32_t sync_hold_us = 20000;
+	/// ping・テレメトリの応答をTX FIFOに残す時間
+	static const uint32_t ping_hold_us = 1000;
+
+    private:
+	void publish(bool synced = false, bool idle = false);
+	void hold_reply(uint32_t now, uint32_t duration);
+	bool is_holding(uint32_t now);
+	void write_fifo(uint8_t* data, size_t length);
+	void write_reply(worker_packet_t* packet, uint8_t command);
+
+	ESPIDF::I2CSlave* slave;
+	worker_clock_t clock;
+	void* context;
+	volatile uint8_t protocol;
+
+	Snapshot<worker_packet_t> published;
+	// 0以外ならAHRS更新毎にこの応答をTX FIFOへ書き込む（COMMAND_SET_STAGED）
+	volatile uint8_t staged_reply;
+	volatile uint32_t hold_until;
+	// TX FIFOのリセット・書き込みと保持期間の更新を、スレーブタスクとAHRSタスクの間で排他する
+	SemaphoreHandle_t fifo_lock;
+	Telemetry telemetry;
+	// スレーブタスクがParentから受け取ったキーフレームを通知する
+	DeltaEncoder deltas;
+	SyncLatch latch;
+	// COMMAND_SET_ADAPTIVEのしきい値はスレーブタスクから設定する
+	MotionGate gate;
+
+	// AHRSタスク側
+	MadgwickAHRS ahrs;
+	worker_packet_t packet;
+	SampleBatch samples;
+	RawBatch raws;
+
+	// スレーブタスク側
+	uint8_t rx[64];
+	worker_packet_t replying;
+	uint8_t reply;	  // 直前のCOMMAND_GET_*、受信が無くてもtick毎にこの応答を書き直す
+	TickType_t written;
+};
+
+inline void WorkerSlave::set_protocol(uint8_t protocol) { this->protocol = protocol; }
+inline Telemetry* WorkerSlave::get_telemetry() { return &telemetry; }
+inline void WorkerSlave::read(worker_packet_t* packet) { published.read(packet); }
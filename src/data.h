@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "Vector3.h"
@@ -13,10 +14,278 @@ union data_u {
 	};
 };
 
+/// プロトコルv2、COMMAND_GET_QUATERNION_V2 への応答
+/// 同期用のヘッダ・フッタの代わりに、連番・サンプル時刻・CRCを持つ
+union data_v2_u {
+	uint8_t raw[28];
+	struct {
+		uint8_t version;	 // PROTOCOL_VERSION_2
+		uint8_t flags;		 // DATA_FLAG_*
+		uint16_t sequence;	 // AHRS更新毎に加算
+		uint32_t timestamp;	 // IMU読み出し時刻、Worker側esp_timer_get_time()の下位32bit [us]
+		Quaternion ahrs;
+		uint16_t reserved;
+		uint16_t crc;		 // crc以外の全体に対するCRC-16/CCITT-FALSE
+	};
+};
+
+#define BATCH_SAMPLES 8
+#define BATCH_AGE_UNIT_US 16
+
+/// 圧縮した姿勢、w >= 0 に符号を揃えて x, y, z のみ持つ（wはノルムから復元する）
+struct packed_quaternion_t {
+	int16_t x, y, z;  // ×32767
+	uint16_t age;	  // 最新サンプルからの遅れ [BATCH_AGE_UNIT_US]
+};
+
+/// COMMAND_GET_BATCH への応答、Workerのリングバッファにある直近のサンプルを新しい順に持つ
+union data_batch_u {
+	uint8_t raw[76];
+	struct {
+		uint8_t version;	 // PROTOCOL_VERSION_2
+		uint8_t flags;		 // DATA_FLAG_*
+		uint16_t sequence;	 // samples[0]の連番、samples[i]は sequence - i
+		uint32_t timestamp;	 // samples[0]のサンプル時刻 [us]
+		uint8_t count;		 // 有効なサンプル数
+		uint8_t reserved;
+		packed_quaternion_t samples[BATCH_SAMPLES];
+		uint16_t crc;
+	};
+};
+
+#define DELTA_SAMPLES 8
+#define DELTA_KEYED_SAMPLES (DELTA_SAMPLES - 2)
+#define DELTA_SCALE 1024.0f	  // 差分のベクトル部 ×1024、±127で約±14度
+#define DELTA_AGE_UNIT_US 256
+#define DELTA_NO_KEYFRAME ((uint8_t)0)
+
+/// キーフレームからの差分回転、conj(key) * q のベクトル部（w >= 0）
+struct delta_sample_t {
+	int8_t x, y, z;	 // ×DELTA_SCALE
+	uint8_t age;	 // 最新サンプルからの遅れ [DELTA_AGE_UNIT_US]
+};
+
+/// COMMAND_GET_DELTA への応答、data_batch_uの姿勢をキーフレームからの差分で持つ
+/// Parentが受け取り済みと通知したキーフレームと異なる間は、先頭2サンプル分にキーフレームを載せる
+union data_delta_u {
+	uint8_t raw[44];
+	struct {
+		uint8_t version;	 // PROTOCOL_VERSION_2
+		uint8_t flags;		 // DATA_FLAG_*
+		uint16_t sequence;	 // 最新サンプルの連番
+		uint32_t timestamp;	 // 最新サンプルのサンプル時刻 [us]
+		uint8_t count;		 // 有効なサンプル数
+		uint8_t keyframe;	 // 差分の基準になるキーフレームのid（1 - 255）
+		union {
+			delta_sample_t samples[DELTA_SAMPLES];  // 新しい順
+			struct {
+				packed_quaternion_t key;  // DATA_FLAG_KEYFRAMEの場合のみ、ageは0
+				delta_sample_t keyed_samples[DELTA_KEYED_SAMPLES];
+			};
+		};
+		uint16_t crc;
+	};
+};
+
+/// COMMAND_SYNCで指定した時刻の姿勢、COMMAND_GET_SYNCへの応答
+/// stagedの場合は保持した直後にTX FIFOへ書き込む（DATA_FLAG_SYNCで通常の応答と区別する）
+union data_sync_u {
+	uint8_t raw[20];
+	struct {
+		uint8_t version;		  // PROTOCOL_VERSION_2
+		uint8_t flags;		  // DATA_FLAG_SYNC | DATA_FLAG_*
+		uint8_t id;			  // COMMAND_SYNCのid
+		uint8_t reserved;
+		uint32_t timestamp;		  // 保持した姿勢の時刻 [us]
+		int16_t offset;		  // timestamp - 指定された時刻 [us]、前後のサンプルで補間できれば0
+		packed_quaternion_t ahrs;  // ageは0
+		uint16_t crc;
+	};
+};
+
+/// COMMAND_PINGへの応答、Parentの送受信時刻と合わせて時計のずれを求める
+union data_ping_u {
+	uint8_t raw[16];
+	struct {
+		uint8_t version;	 // PROTOCOL_VERSION_2
+		uint8_t flags;		 // DATA_FLAG_PING
+		uint8_t id;			 // COMMAND_PINGのid
+		uint8_t reserved;
+		uint32_t received;	 // COMMAND_PINGを受信した時刻 [us]
+		uint32_t replied;	 // 応答をTX FIFOへ書き込んだ時刻 [us]
+		uint16_t reserved2;
+		uint16_t crc;
+	};
+};
+
+/// COMMAND_SET_ADAPTIVEで、静止中にstagedの応答の代わりに書き込む短い応答
+/// Parentは静止中はこの長さだけ読み出す、先頭はdata_v2_uなどと共通
+union data_status_u {
+	uint8_t raw[20];
+	struct {
+		uint8_t version;		  // PROTOCOL_VERSION_2
+		uint8_t flags;		  // DATA_FLAG_UNCHANGED | DATA_FLAG_*
+		uint16_t sequence;	  // 最新サンプルの連番
+		uint32_t timestamp;		  // 最新サンプルのサンプル時刻 [us]
+		uint16_t since;		  // この連番のサンプルから姿勢の変化がしきい値未満
+		packed_quaternion_t ahrs;  // 最新サンプル、ageは0
+		uint16_t crc;
+	};
+};
+
+#define RAW_SAMPLES BATCH_SAMPLES
+// Workerのジャイロ（±2000dps）・加速度（±8G）の1LSBあたりの値 [rad/s], [G]
+#define RAW_GYRO_SCALE 0.00106526443603169529841533860372f
+#define RAW_ACCEL_SCALE (8.0f / 32768.0f)
+
+/// ゼロバイアスを除いたIMUの値
+struct raw_sample_t {
+	int16_t gx, gy, gz;  // ×RAW_GYRO_SCALE
+	int16_t ax, ay, az;  // ×RAW_ACCEL_SCALE
+	uint16_t age;		  // 最新サンプルからの遅れ [BATCH_AGE_UNIT_US]
+};
+
+/// COMMAND_GET_RAW への応答、姿勢の代わりにIMUの値を新しい順に持つ（Parentで姿勢を計算する）
+union data_raw_u {
+	uint8_t raw[124];
+	struct {
+		uint8_t version;	 // PROTOCOL_VERSION_2
+		uint8_t flags;		 // DATA_FLAG_*
+		uint16_t sequence;	 // samples[0]の連番、samples[i]は sequence - i
+		uint32_t timestamp;	 // samples[0]のサンプル時刻 [us]
+		uint8_t count;		 // 有効なサンプル数
+		uint8_t reserved;
+		raw_sample_t samples[RAW_SAMPLES];
+		uint16_t crc;
+	};
+};
+
+#define TELEMETRY_NO_TEMPERATURE ((int16_t)-32768)
+
+/// COMMAND_GET_TELEMETRYへの応答、Workerの動作状況
+/// エラー数は起動からの累計で、桁あふれしても前回との差で見る
+union data_telemetry_u {
+	uint8_t raw[32];
+	struct {
+		uint8_t version;		// PROTOCOL_VERSION_2
+		uint8_t flags;		// DATA_FLAG_TELEMETRY | DATA_FLAG_*
+		uint8_t calibration;	// 実行中のゼロバイアス測定（Calibration::Mode）、0なら完了
+		uint8_t reserved;
+		uint32_t uptime;		// 起動からの時間 [ms]
+		uint16_t fusion_rate;	// 直近1秒のAHRS更新回数 [Hz]
+		uint16_t sample_age;	// 最新サンプルから応答を書き込むまでの時間 [us]、65535で打ち切り
+		int16_t temperature;	// IMUの温度 [0.01度]、読めなければTELEMETRY_NO_TEMPERATURE
+		int16_t bias[3];		// ジャイロのゼロバイアス推定値 [LSB]
+		uint16_t imu_errors;	// IMUの読み出しエラー
+		uint16_t slave_errors;	// TX FIFOに書き込めなかった応答
+		uint16_t command_errors;	// 未知・途中で切れたコマンド
+		uint16_t reserved2;
+		uint16_t reserved3;
+		uint16_t crc;
+	};
+};
+
 #define COMMAND_GET_QUATERNION ((uint8_t)0x23)
+#define COMMAND_GET_QUATERNION_V2 ((uint8_t)0x24)
+#define COMMAND_GET_BATCH ((uint8_t)0x25)
+// 2byte目の応答（COMMAND_GET_QUATERNION_V2 / COMMAND_GET_BATCH）をAHRS更新毎にTX FIFOへ書き込む
+// 以降Parentはコマンド無しで読み出すだけ、COMMAND_GET_* を受け取ると解除する
+#define COMMAND_SET_STAGED ((uint8_t)0x26)
+// 2byte目に受け取り済みのキーフレームid（無ければDELTA_NO_KEYFRAME）
+#define COMMAND_GET_DELTA ((uint8_t)0x27)
+// 応答を変えずにキーフレームの受け取りだけ通知する（staged用）、2byte目はCOMMAND_GET_DELTAと同じ
+#define COMMAND_ACK_KEYFRAME ((uint8_t)0x28)
+// 2byte目にid、3 - 4byte目に受信からの待ち時間 [us]（little endian）、その時刻の姿勢を保持する
+// 応答は変えない、Parentは書き込む直前に待ち時間を詰めて全Workerの時刻を揃える
+#define COMMAND_SYNC ((uint8_t)0x29)
+#define COMMAND_GET_SYNC ((uint8_t)0x2a)
+// 2byte目にid、受信時刻を記録してすぐにdata_ping_uを書き込む、応答は変えない
+#define COMMAND_PING ((uint8_t)0x2b)
+// 2byte目に姿勢変化のしきい値 [0.1度]、静止中のstagedの応答をdata_status_uにする（0で解除）
+#define COMMAND_SET_ADAPTIVE ((uint8_t)0x2c)
+// COMMAND_GET_BATCHと同様、stagedにもできる
+#define COMMAND_GET_RAW ((uint8_t)0x2d)
+// COMMAND_PINGと同じく受信してすぐにdata_telemetry_uを書き込む、応答は変えない
+#define COMMAND_GET_TELEMETRY ((uint8_t)0x2e)
 // #define COMMAND_SET_NEUTRAL_QUATERNION ((uint8_t)0x63)
 // #define COMMAND_SET_Z_DIRECTION ((uint8_t)0x67)
 // #define COMMAND_START_GYRO_CALIBRATION ((uint8_t)0xad)
 
 #define SYNC_HEADER ((uint32_t)0x01020304)
 #define SYNC_FOOTER ((uint32_t)0xa7f32249)
+
+#define PROTOCOL_VERSION_1 ((uint8_t)1)
+#define PROTOCOL_VERSION_2 ((uint8_t)2)
+
+#define DATA_FLAG_CALIBRATING ((uint8_t)0x01)  // ゼロバイアス測定中、姿勢は無効
+#define DATA_FLAG_KEYFRAME ((uint8_t)0x02)	   // data_delta_uがキーフレームを含む
+#define DATA_FLAG_SYNC ((uint8_t)0x04)	   // data_sync_u
+#define DATA_FLAG_PING ((uint8_t)0x08)	   // data_ping_u
+#define DATA_FLAG_UNCHANGED ((uint8_t)0x10)  // data_status_u
+#define DATA_FLAG_TELEMETRY ((uint8_t)0x20)  // data_telemetry_u
+
+// スレーブのTX FIFOが空の場合に読み出される値
+#define DATA_EMPTY ((uint8_t)0xff)
+
+/// COMMAND_SET_STAGEDで指定できる応答か
+inline bool data_stageable(uint8_t command) {
+	return command == COMMAND_GET_QUATERNION_V2 || command == COMMAND_GET_BATCH || command == COMMAND_GET_DELTA || command == COMMAND_GET_RAW;
+}
+
+/// 引数を含むコマンドの長さ、未知のコマンドは0
+inline size_t data_command_length(uint8_t command) {
+	switch (command) {
+		case COMMAND_GET_QUATERNION:
+		case COMMAND_GET_QUATERNION_V2:
+		case COMMAND_GET_BATCH:
+		case COMMAND_GET_SYNC:
+		case COMMAND_GET_RAW:
+		case COMMAND_GET_TELEMETRY:
+			return 1;
+		case COMMAND_SET_STAGED:
+		case COMMAND_GET_DELTA:
+		case COMMAND_ACK_KEYFRAME:
+		case COMMAND_PING:
+		case COMMAND_SET_ADAPTIVE:
+			return 2;
+		case COMMAND_SYNC:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+/// CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff)
+inline uint16_t data_crc16(const uint8_t* data, size_t length) {
+	uint16_t crc = 0xffff;
+	for (size_t i = 0; i < length; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+/// v2の応答にバージョンとCRCを書き込みます
+template <typename T>
+inline void data_seal(T* data) {
+	data->version = PROTOCOL_VERSION_2;
+	data->crc	  = data_crc16(data->raw, sizeof(T) - sizeof(uint16_t));
+}
+
+template <typename T>
+inline bool data_verify(const T* data) {
+	return data->crc == data_crc16(data->raw, sizeof(T) - sizeof(uint16_t));
+}
+
+inline packed_quaternion_t data_pack(Quaternion q, uint16_t age) {
+	float k = q.w < 0.0f ? -32767.0f : 32767.0f;
+	return {(int16_t)lroundf(q.x * k), (int16_t)lroundf(q.y * k), (int16_t)lroundf(q.z * k), age};
+}
+
+inline Quaternion data_unpack(packed_quaternion_t p) {
+	const float k = 1.0f / 32767.0f;
+	Quaternion q  = {p.x * k, p.y * k, p.z * k, 0.0f};
+	float ww	  = 1.0f - q.x * q.x - q.y * q.y - q.z * q.z;
+	q.w		  = ww > 0.0f ? sqrtf(ww) : 0.0f;
+	return q;
+}
@@ -73,6 +73,8 @@ class MPU6886 : public IIMU {
 	Vector3<float> getAccel();
 	Vector3<int16_t> getGyroAdc();
 	Vector3<float> getGyro();
+	Vector3<int16_t> getMagAdc();
+	Vector3<float> getMag();
 
 	int16_t getTemp();
 	int16_t getTempAndGyroAdc(Vector3<int16_t>* gyro);
@@ -80,6 +82,7 @@ class MPU6886 : public IIMU {
 
 	void getAccelAdc(Vector3<int16_t>* accel);
 	void getGyroAdc(Vector3<int16_t>* gyro);
+	void getMagAdc(Vector3<int16_t>* mag);
 
 	void calibrateZeroBias(uint8_t count, int32_t accel_threshould, int32_t gyro_threshould);
 	void updateAhrs(Quaternion* result);
@@ -97,6 +100,11 @@ class MPU6886 : public IIMU {
 
 inline void * MPU6886::getI2CMaster() { return i2c; }
 
+// 磁気センサは搭載していないので常に0
+inline Vector3<int16_t> MPU6886::getMagAdc() { return {0, 0, 0}; }
+inline Vector3<float> MPU6886::getMag() { return {0.0f, 0.0f, 0.0f}; }
+inline void MPU6886::getMagAdc(Vector3<int16_t>* mag) { *mag = {0, 0, 0}; }
+
 MPU6886::MPU6886(I2CMaster* i2c) {
 	gyro_scale = GFS_2000DPS;
 	accel_scale = AFS_8G;
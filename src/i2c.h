@@ -4,6 +4,8 @@
 #include <esp_log.h>
 #include <stdio.h>
 
+#include "I2CStatistics.h"
+
 namespace ESPIDF {
 
 struct wire_s {
@@ -31,6 +33,13 @@ static const wire_s M5Stack_Internal = {
     .io_sda	= (gpio_num_t)21,
     .i2c_speed = 400000};
 
+// Port Cを2本目のI2Cとして使う（UARTとは併用不可）
+static const wire_s M5Stack_PortC = {
+    .i2cnum	= (i2c_port_t)1,
+    .io_scl	= (gpio_num_t)17,
+    .io_sda	= (gpio_num_t)16,
+    .i2c_speed = 400000};
+
 static const wire_s M5Stick_Grove = {
     .i2cnum	= (i2c_port_t)1,
     .io_scl	= (gpio_num_t)33,
@@ -54,16 +63,29 @@ class I2CMaster {
 	esp_err_t get_last_error();
 
 	uint8_t read(uint8_t address, uint8_t registry);
-	esp_err_t read_bytes(uint8_t address, uint8_t registry, uint8_t* buffer, size_t buffer_length);
+	esp_err_t read_bytes(uint8_t address, uint8_t registry, uint8_t* buffer, size_t buffer_length, TickType_t wait = DEFAULT_WAIT_TICK);
 	esp_err_t write(uint8_t address, uint8_t registry, uint8_t data);
 	esp_err_t write_bytes(uint8_t address, uint8_t registry, uint8_t* data, size_t data_length);
 
+	/// レジスタ指定なしの送受信（Worker間通信用）
+	esp_err_t send_bytes(uint8_t address, const uint8_t* data, size_t data_length, TickType_t wait = DEFAULT_WAIT_TICK);
+	esp_err_t receive_bytes(uint8_t address, uint8_t* buffer, size_t buffer_length, TickType_t wait = DEFAULT_WAIT_TICK);
+
+	/// 設定するとトランザクション毎の時間・エラーを記録する（nullptrで無効）
+	void set_statistics(I2CStatistics* statistics);
+	I2CStatistics* get_statistics();
+
     private:
-	esp_err_t begin_transmission(uint8_t address, uint8_t registry);
+	esp_err_t begin_transmission(uint8_t address, uint8_t registry, TickType_t wait);
+	esp_err_t execute(uint8_t address, i2c_cmd_handle_t cmd, TickType_t wait);
 	i2c_port_t port;
 	esp_err_t last_error;
+	I2CStatistics* statistics;
 };
 
+inline void I2CMaster::set_statistics(I2CStatistics* statistics) { this->statistics = statistics; }
+inline I2CStatistics* I2CMaster::get_statistics() { return statistics; }
+
 class I2CSlave {
     public:
 	I2CSlave(const wire_s* conf, uint8_t slave_address);
@@ -73,8 +95,9 @@ class I2CSlave {
 
 	uint8_t read(TickType_t wait = DEFAULT_WAIT_TICK);
 	size_t read_bytes(uint8_t* buffer, size_t buffer_length, TickType_t wait = DEFAULT_WAIT_TICK);
-	esp_err_t write(uint8_t data, bool clear_buffer = false, TickType_t wait = DEFAULT_WAIT_TICK);
-	esp_err_t write_bytes(uint8_t* data, size_t data_length, bool clear_buffer = false, TickType_t wait = DEFAULT_WAIT_TICK);
+	/// TX FIFOに書き込めたバイト数を返す、失敗した場合は-1
+	int write(uint8_t data, bool clear_buffer = false, TickType_t wait = DEFAULT_WAIT_TICK);
+	int write_bytes(uint8_t* data, size_t data_length, bool clear_buffer = false, TickType_t wait = DEFAULT_WAIT_TICK);
 
     private:
 	i2c_port_t port;
@@ -1,5 +1,7 @@
 #include "i2c.h"
 
+#include <esp_timer.h>
+
 #define ACK_CHECK_EN 0x1	 /*!< I2C master will check ack from slave*/
 #define ACK_CHECK_DIS 0x0 /*!< I2C master will not check ack from slave */
 
@@ -8,6 +10,7 @@ namespace ESPIDF {
 I2CMaster::I2CMaster(const wire_s* wire) : I2CMaster(wire->i2cnum, wire->io_scl, wire->io_sda, wire->i2c_speed) {}
 I2CMaster::I2CMaster(i2c_port_t port, gpio_num_t scl, gpio_num_t sda, uint32_t freq_hz) {
 	this->port = port;
+	this->statistics = nullptr;
 	
 	i2c_config_t conf;
 	conf.mode		    = I2C_MODE_MASTER;
@@ -29,7 +32,19 @@ I2CMaster::I2CMaster(i2c_port_t port, gpio_num_t scl, gpio_num_t sda, uint32_t f
 
 esp_err_t I2CMaster::get_last_error() { return last_error; }
 
-esp_err_t I2CMaster::begin_transmission(uint8_t address, uint8_t registry) {
+esp_err_t I2CMaster::execute(uint8_t address, i2c_cmd_handle_t cmd, TickType_t wait) {
+	if (statistics == nullptr) {
+		last_error = i2c_master_cmd_begin(port, cmd, wait);
+	} else {
+		int64_t start = esp_timer_get_time();
+		last_error    = i2c_master_cmd_begin(port, cmd, wait);
+		statistics->record(address, last_error, esp_timer_get_time() - start);
+	}
+	i2c_cmd_link_delete(cmd);
+	return last_error;
+}
+
+esp_err_t I2CMaster::begin_transmission(uint8_t address, uint8_t registry, TickType_t wait) {
 	last_error = 0;
 	
 	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
@@ -37,18 +52,22 @@ esp_err_t I2CMaster::begin_transmission(uint8_t address, uint8_t registry) {
 	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, 1));
 	ESP_ERROR_CHECK(i2c_master_write_byte(cmd, registry, 1));
 	ESP_ERROR_CHECK(i2c_master_stop(cmd));
-	last_error = i2c_master_cmd_begin(port, cmd, DEFAULT_WAIT_TICK);
-	i2c_cmd_link_delete(cmd);
 
-	return last_error;
+	return execute(address, cmd, wait);
 }
 
-esp_err_t I2CMaster::read_bytes(uint8_t address, uint8_t registry, uint8_t* buffer, size_t buffer_length) {
+esp_err_t I2CMaster::read_bytes(uint8_t address, uint8_t registry, uint8_t* buffer, size_t buffer_length, TickType_t wait) {
 	if (buffer_length == 0) return ESP_OK;
 
-	last_error = begin_transmission(address, registry);
+	last_error = begin_transmission(address, registry, wait);
 	if (last_error != ESP_OK) return last_error;
 
+	return receive_bytes(address, buffer, buffer_length, wait);
+}
+
+esp_err_t I2CMaster::receive_bytes(uint8_t address, uint8_t* buffer, size_t buffer_length, TickType_t wait) {
+	if (buffer_length == 0) return ESP_OK;
+
 	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
 
 	i2c_master_start(cmd);
@@ -56,10 +75,17 @@ esp_err_t I2CMaster::read_bytes(uint8_t address, uint8_t registry, uint8_t* buff
 	i2c_master_read(cmd, buffer, buffer_length, I2C_MASTER_LAST_NACK);
 	i2c_master_stop(cmd);
 
-	last_error = i2c_master_cmd_begin(port, cmd, DEFAULT_WAIT_TICK);
-	i2c_cmd_link_delete(cmd);
 
-	return last_error;
+	return execute(address, cmd, wait);
+}
+
+esp_err_t I2CMaster::send_bytes(uint8_t address, const uint8_t* data, size_t data_length, TickType_t wait) {
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+	i2c_master_start(cmd);
+	i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
+	if (data_length > 0) i2c_master_write(cmd, (uint8_t*)data, data_length, ACK_CHECK_EN);
+	i2c_master_stop(cmd);
+	return execute(address, cmd, wait);
 }
 
 uint8_t I2CMaster::read(uint8_t address, uint8_t registry) {
@@ -75,9 +101,7 @@ esp_err_t I2CMaster::write(uint8_t address, uint8_t registry, uint8_t data) {
 	i2c_master_write_byte(cmd, registry, ACK_CHECK_EN);
 	i2c_master_write_byte(cmd, data, ACK_CHECK_EN);
 	i2c_master_stop(cmd);
-	last_error = i2c_master_cmd_begin(port, cmd, DEFAULT_WAIT_TICK);
-	i2c_cmd_link_delete(cmd);
-	return last_error;
+	return execute(address, cmd, DEFAULT_WAIT_TICK);
 }
 
 esp_err_t I2CMaster::write_bytes(uint8_t address, uint8_t registry, uint8_t* data, size_t data_length) {
@@ -87,9 +111,7 @@ esp_err_t I2CMaster::write_bytes(uint8_t address, uint8_t registry, uint8_t* dat
 	i2c_master_write_byte(cmd, registry, ACK_CHECK_EN);
 	i2c_master_write(cmd, data, data_length, ACK_CHECK_EN);
 	i2c_master_stop(cmd);
-	last_error = i2c_master_cmd_begin(port, cmd, DEFAULT_WAIT_TICK);
-	i2c_cmd_link_delete(cmd);
-	return last_error;
+	return execute(address, cmd, DEFAULT_WAIT_TICK);
 }
 
 }  // namespace ESPIDF
@@ -0,0 +1,69 @@
+#include "i2cqueue.h"
+
+#include <rom/ets_sys.h>
+
+namespace ESPIDF {
+
+I2CQueue::I2CQueue(I2CMaster* master, size_t depth, BaseType_t core) {
+	this->master = master;
+	queue	   = xQueueCreate(depth, sizeof(i2c_request_t*));
+
+	xTaskCreatePinnedToCore(bus_task, "i2c_bus", 1024 * 4, this, 15, nullptr, core);
+}
+
+bool I2CQueue::submit(i2c_request_t* request, TickType_t timeout, TickType_t wait) {
+	request->deadline = xTaskGetTickCount() + timeout;
+	request->result   = ESP_ERR_INVALID_STATE;
+	return xQueueSend(queue, &request, wait) == pdTRUE;
+}
+
+void I2CQueue::process(i2c_request_t* request) {
+	transfer(request);
+
+	for (int i = 0; i < request->retries && request->result != ESP_OK; i++) {
+		if ((int32_t)(request->deadline - xTaskGetTickCount()) <= 0) break;
+
+		I2CStatistics* statistics = master->get_statistics();
+		if (statistics) statistics->retry(request->address);
+		transfer(request);
+	}
+}
+
+void I2CQueue::transfer(i2c_request_t* request) {
+	// 期限はtick単位、オーバーフローを考慮して符号付きで比較する
+	int32_t remain = (int32_t)(request->deadline - xTaskGetTickCount());
+	if (remain <= 0) {
+		request->result = ESP_ERR_TIMEOUT;
+		return;
+	}
+
+	if (request->prepare) request->prepare(request);
+
+	request->result = ESP_OK;
+	if (request->command_length > 0) {
+		request->result = master->send_bytes(request->address, request->command, request->command_length, remain);
+		if (request->result != ESP_OK) return;
+		if (request->delay_us > 0) ets_delay_us(request->delay_us);
+
+		remain = (int32_t)(request->deadline - xTaskGetTickCount());
+		if (remain <= 0) remain = 1;
+	}
+
+	if (request->length > 0) {
+		request->result = master->receive_bytes(request->address, request->buffer, request->length, remain);
+	}
+}
+
+void I2CQueue::bus_task(void* arg) {
+	I2CQueue* self = (I2CQueue*)arg;
+	i2c_request_t* request;
+
+	while (true) {
+		if (xQueueReceive(self->queue, &request, portMAX_DELAY) != pdTRUE) continue;
+
+		self->process(request);
+		if (request->callback) request->callback(request);
+	}
+}
+
+}  // namespace ESPIDF
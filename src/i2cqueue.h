@@ -0,0 +1,54 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "i2c.h"
+
+namespace ESPIDF {
+
+struct i2c_request_t;
+
+/// バス所有タスクから呼ばれるため、重い処理はしないこと
+typedef void (*i2c_callback_t)(i2c_request_t* request);
+
+/// I2CQueueへ投入する1トランザクション分の要求
+/// 完了コールバックが呼ばれるまで、要求本体とバッファは呼び出し元で保持する
+struct i2c_request_t {
+	uint8_t address;
+	const uint8_t* command;	// 読み出し前に書き込むデータ（nullptr / 0byteなら書き込まない）
+	size_t command_length;
+	uint8_t* buffer;		// 読み出し先（0byteなら読み出さない）
+	size_t length;
+	uint32_t delay_us;		// 書き込みから読み出しまでの待ち時間
+	uint8_t retries;		// 失敗時に期限内で再試行する回数
+	i2c_callback_t prepare;	// バスに出す直前（再試行毎）に呼ばれる、nullptrなら呼ばない
+	TickType_t deadline;	// xTaskGetTickCount基準、期限切れの要求はバスに出さずにESP_ERR_TIMEOUT
+	esp_err_t result;
+	i2c_callback_t callback;
+	void* context;
+};
+
+/// 1つのバス所有タスクで要求を順に処理する非同期I2C
+class I2CQueue {
+    public:
+	I2CQueue(I2CMaster* master, size_t depth = 16, BaseType_t core = tskNO_AFFINITY);
+
+	/// timeout後をdeadlineとして投入します、キューが一杯ならfalse
+	bool submit(i2c_request_t* request, TickType_t timeout, TickType_t wait = 0);
+
+	I2CMaster* get_master();
+
+    private:
+	static void bus_task(void* arg);
+	void process(i2c_request_t* request);
+	void transfer(i2c_request_t* request);
+
+	I2CMaster* master;
+	QueueHandle_t queue;
+};
+
+inline I2CMaster* I2CQueue::get_master() { return master; }
+
+}  // namespace ESPIDF
@@ -37,12 +37,12 @@ uint8_t I2CSlave::read(TickType_t wait) {
 	return data;
 }
 
-esp_err_t I2CSlave::write(uint8_t data, bool clear_buffer, TickType_t wait) {
+int I2CSlave::write(uint8_t data, bool clear_buffer, TickType_t wait) {
 	if (clear_buffer) i2c_reset_tx_fifo(port);
 	return i2c_slave_write_buffer(port, &data, 1, wait);
 }
 
-esp_err_t I2CSlave::write_bytes(uint8_t* data, size_t data_length, bool clear_buffer, TickType_t wait) {
+int I2CSlave::write_bytes(uint8_t* data, size_t data_length, bool clear_buffer, TickType_t wait) {
 	if (clear_buffer) i2c_reset_tx_fifo(port);
 	return i2c_slave_write_buffer(port, data, data_length, wait);
 }